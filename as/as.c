@@ -8,16 +8,20 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <wchar.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "config.h"
 #include "encoding.h"
 #include "gost10859.h"
 #include "ieee.h"
+#include "obj.h"
 
-#define STSIZE          2000    /* размер таблицы символов */
+#define STINIT          1024    /* начальный размер таблицы символов */
 #define DATSIZE         4096    /* размер памяти в словах */
-#define MAXREL          10240   /* макс. перемещений */
 #define MAXLIBS         10      /* макс. библиотек */
-#define MAXLABELS       1000    /* макс. цифровых меток */
+#define MAXENTRY        32      /* макс. точек входа -e */
+#define KWSIZE          256     /* размер таблицы ключевых слов */
+#define KWMULT          10786   /* множитель хэша ключевых слов */
 
 /*
  * Lexical items.
@@ -35,50 +39,85 @@ enum {
 	LCONST,		/* .вещ */
 	LORG,		/* .адрес */
 	LTEXT,		/* .текст */
+	LOVL,		/* .оверлей */
+	LLOOP,		/* .цикл */
 };
 
-/*
- * Symbol/expression types.
- */
-#define TUNDF	0	/* неизвестный символ */
-#define TABS	1	/* константа */
-#define TTEXT	2	/* метка или функция */
-
-/*
- * Relocation flags.
- */
-#define RA1	1	/* адрес 1 */
-#define RA2	2	/* адрес 2 */
-#define RA3	4	/* адрес 3 */
-#define RRA	8	/* регистр адреса */
-#define RLAB	16	/* относительная метка */
-
 struct stab {
 	wchar_t *name;
 	int len;
 	int type;
 	int value;
-} stab [STSIZE];
+} *stab;
+
+/*
+ * Хэш-таблица имён: номер символа в stab плюс 1, 0 - пусто.
+ * Размер - степень двойки, заполнена не больше чем наполовину.
+ */
+int *hashtab;
+unsigned hashsize;
 
+/*
+ * Цифровые метки. Перед разрешением ссылок таблица сортируется
+ * по номеру метки, а метки одного номера - по адресу.
+ */
 struct labeltab {
 	int num;
 	int value;
-} labeltab [MAXLABELS];
+} *labeltab;
 
 struct reltab {
 	int addr;
 	int sym;
 	int flags;
-} reltab [MAXREL];
+} *reltab;
+
+/*
+ * Инструкции и директивы: совершенный хэш. Множитель KWMULT
+ * подобран так, что все ключевые слова попадают в разные ячейки,
+ * и поиск - одно сравнение строк. Хэш имени считает getname().
+ */
+struct kwtab {
+	const wchar_t *name;
+	int lex;		/* LCMD или директива */
+	int code;		/* код инструкции */
+} kwtab [KWSIZE];
+
+#define KWSLOT(h)	((((h) * 2654435769u) & 0xffffffff) >> 24)
+
+/*
+ * Пул литералов: значения без повторов. Хэш-таблица по значению
+ * хранит номер литерала плюс 1, 0 - пусто.
+ */
+struct littab {
+	uint64_t val;
+	int addr;		/* адрес слова в пуле */
+} *littab;
+int nlit, litsize;
+int *lithash;
+unsigned lithashsize;
+
+#define LITHASH(v)	((unsigned) ((v) * 0x9e3779b97f4a7c15ULL >> 40))
 
 struct libtab {
 	char *name;
+	OBJLIB *lib;		/* библиотека модулей или 0 - каталог */
 } libtab [MAXLIBS];
 
+char *entrytab [MAXENTRY];	/* -e: точки входа кроме начала */
+int nentry;
+
 char *infile, *infile1, *outfile;
 int debug;
+int relocatable;		/* -c: перемещаемый модуль */
+int optim;			/* -O: оптимизация */
+int timing;			/* -T: анализ времени выполнения */
+int orgused;			/* была директива .адрес */
+wchar_t *ovlname;		/* .оверлей: модуль - часть оверлея */
 int line;
+int stmtline;
 int filenum;
+char **srcfile;
 int count = 1;
 int reached;
 int blexflag, backlex, blextype;
@@ -87,20 +126,41 @@ int intval;
 int extref;
 int extflag;
 int stabfree;
+int stabsize;
 int nrel;
+int relsize;
 int nlib;
 int nlabels;
+int labelsize;
 int outaddr;
+unsigned namehash;
+
+/*
+ * Текст текущего файла: читается целиком и один раз
+ * декодируется в широкие символы.
+ */
+wchar_t *srcbuf, *srcp, *srcend;
+size_t srcsize;
 
 uint64_t ram [DATSIZE];
 unsigned char ram_dirty [DATSIZE];
+int ram_line [DATSIZE];
+unsigned char ram_file [DATSIZE];
+unsigned char ram_cmd [DATSIZE];	/* 1 - команда, 2 - слово модуля */
+int ram_loop [DATSIZE];			/* .цикл: не больше стольких повторений */
 
 void parse (void);
 void relocate (void);
 void libraries (void);
 void output (void);
+void output_module (void);
+void optimize (void);
+void timeanal (void);
 void makecmd (int code);
 int getexpr (int *s);
+int lookliteral (uint64_t val);
+void addfield (int addr, int flags, int v);
+void addreloc (int addr, int sym, int flags);
 
 /*
  * Инструкции M-20.
@@ -133,49 +193,199 @@ void uerror (char *s, ...)
 	exit (1);
 }
 
+/*
+ * Error about the name: the name is printed in local encoding.
+ */
+void nerror (char *s, wchar_t *sym)
+{
+	fprintf (stderr, "as: %s: ", s);
+	wchar_puts (sym, stderr);
+	fprintf (stderr, "\n");
+	if (outfile)
+		unlink (outfile);
+	exit (1);
+}
+
+/*
+ * Place the symbol number into the hash table.
+ */
+void hashinsert (int n)
+{
+	unsigned h;
+
+	h = obj_hash (stab[n].name) & (hashsize - 1);
+	while (hashtab [h])
+		h = (h + 1) & (hashsize - 1);
+	hashtab [h] = n + 1;
+}
+
+/*
+ * Make room for one more symbol: grow the table and rehash,
+ * when needed.
+ */
+void stabgrow ()
+{
+	int i;
+
+	if (stabfree >= stabsize) {
+		stabsize = stabsize ? stabsize * 2 : STINIT;
+		stab = realloc (stab, stabsize * sizeof (stab[0]));
+		if (! stab)
+			uerror ("мало памяти");
+	}
+	if (2 * (stabfree + 1) > hashsize) {
+		hashsize = hashsize ? hashsize * 2 : 2 * STINIT;
+		free (hashtab);
+		hashtab = calloc (hashsize, sizeof (hashtab[0]));
+		if (! hashtab)
+			uerror ("мало памяти");
+		for (i=0; i<stabfree; ++i)
+			hashinsert (i);
+	}
+}
+
 /*
  * Look up the symbol.
+ * Local names (starting with '.') are kept with the file number
+ * prefix, so they are unique among all files.
  */
 int lookname ()
 {
-	int i, len;
+	int len, n;
+	unsigned h;
 	struct stab *s;
+	wchar_t key [258];
 
-	len = wcslen (name);
-	s = 0;
 	if (name[0] == 'L')
 		name[0] = '.';
-	for (i=0; i<stabfree; ++i) {
-		if (! stab[i].len && ! s) {
-			s = stab+i;
-			continue;
+	if (name[0] == '.') {
+		key[0] = 'A' + filenum;
+		wcscpy (key+1, name);
+	} else
+		wcscpy (key, name);
+	len = wcslen (key);
+
+	if (hashsize) {
+		h = obj_hash (key) & (hashsize - 1);
+		while ((n = hashtab [h]) != 0) {
+			if (stab[n-1].len == len && ! wcscmp (stab[n-1].name, key))
+				return n - 1;
+			h = (h + 1) & (hashsize - 1);
 		}
-		if (name[0] == '.' && stab[i].len == len+1 &&
-		    stab[i].name[0] == 'A'+filenum &&
-		    ! wcscmp (stab[i].name+1, name))
-			return i;
-		if (stab[i].len == len && ! wcscmp (stab[i].name, name))
-			return i;
 	}
-	if (! s)
-		s = stab + stabfree++;
 
 	/* Add the new symbol. */
-	if (s >= stab + STSIZE)
-		uerror ("таблица символов переполнена");
-	s->name = malloc ((2 + len) * sizeof (wchar_t));
+	stabgrow ();
+	s = stab + stabfree;
+	s->name = malloc ((1 + len) * sizeof (wchar_t));
 	if (! s->name)
 		uerror ("мало памяти");
+	wcscpy (s->name, key);
 	s->len = len;
-	if (name[0] == '.') {
-		s->name[0] = 'A' + filenum;
-		wcscpy (s->name+1, name);
-		++s->len;
-	} else
-		wcscpy (s->name, name);
 	s->value = 0;
 	s->type = 0;
-	return s - stab;
+	hashinsert (stabfree);
+	return stabfree++;
+}
+
+/*
+ * Заполнение таблицы ключевых слов.
+ */
+void kwadd (const wchar_t *kw, int lex, int code)
+{
+	const wchar_t *cp;
+	unsigned h;
+	struct kwtab *k;
+
+	for (h=0, cp=kw; *cp; ++cp)
+		h = h * KWMULT + *cp;
+	k = &kwtab [KWSLOT (h)];
+	if (k->name)
+		uerror ("коллизия в таблице ключевых слов");
+	k->name = kw;
+	k->lex = lex;
+	k->code = code;
+}
+
+void kwinit ()
+{
+	int i;
+
+	for (i=0; i<64; ++i)
+		kwadd (opname[i], LCMD, i);
+	kwadd (L".это", LEQU, 0);
+	kwadd (L".перем", LDATA, 0);
+	kwadd (L".адрес", LORG, 0);
+	kwadd (L".вещ", LCONST, 0);
+	kwadd (L".текст", LTEXT, 0);
+	kwadd (L".оверлей", LOVL, 0);
+	kwadd (L".цикл", LLOOP, 0);
+}
+
+/*
+ * Чтение исходного файла целиком. Возвращает 0, если
+ * файл не открывается.
+ */
+int readsource (char *path)
+{
+	int fd;
+	struct stat st;
+	unsigned char *buf;
+	size_t len, size;
+	ssize_t n;
+
+	fd = open (path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	size = 4096;
+	if (fstat (fd, &st) == 0) {
+		if (S_ISDIR (st.st_mode)) {
+			close (fd);
+			return 0;
+		}
+		if (st.st_size >= size)
+			size = st.st_size + 1;
+	}
+	buf = malloc (size);
+	if (! buf)
+		uerror ("мало памяти");
+	len = 0;
+	while ((n = read (fd, buf + len, size - len)) > 0) {
+		len += n;
+		if (len == size) {
+			/* Файл вырос или это не обычный файл. */
+			size *= 2;
+			buf = realloc (buf, size);
+			if (! buf)
+				uerror ("мало памяти");
+		}
+	}
+	if (n < 0)
+		uerror ("ошибка чтения %s", path);
+	close (fd);
+
+	if (len > srcsize) {
+		srcsize = len;
+		free (srcbuf);
+		srcbuf = malloc (srcsize * sizeof (wchar_t));
+		if (! srcbuf)
+			uerror ("мало памяти");
+	}
+	srcp = srcbuf;
+	srcend = srcbuf + unicode_decode (buf, len, srcbuf);
+	free (buf);
+	return 1;
+}
+
+static inline int nextc ()
+{
+	return srcp < srcend ? *srcp++ : EOF;
+}
+
+static inline void backc (int c)
+{
+	if (c != EOF)
+		--srcp;
 }
 
 int main (int argc, char **argv)
@@ -183,6 +393,7 @@ int main (int argc, char **argv)
 	int i;
 	char *cp;
 
+	kwinit ();
 	for (i=1; i<argc; i++)
 		switch (argv[i][0]) {
 		case '-':
@@ -190,6 +401,19 @@ int main (int argc, char **argv)
 			case 'd':
 				debug++;
 				break;
+			case 'O':
+				optim++;
+				break;
+			case 'T':
+				timing++;
+				break;
+			case 'c':
+				/* Модуль начинается с адреса 0. */
+				if (infile1)
+					uerror ("флаг -c должен стоять перед файлами");
+				relocatable = 1;
+				count = 0;
+				break;
 			case 'o':
 				if (cp [1]) {
 					/* -ofile */
@@ -200,6 +424,18 @@ int main (int argc, char **argv)
 					/* -o file */
 					outfile = argv[++i];
 				break;
+			case 'e':
+				if (nentry >= MAXENTRY)
+					uerror ("слишком много точек входа");
+				if (cp [1]) {
+					/* -ename */
+					entrytab[nentry++] = cp+1;
+					while (*++cp);
+					--cp;
+				} else if (i+1 < argc)
+					/* -e name */
+					entrytab[nentry++] = argv[++i];
+				break;
 			case 'l':
 				if (nlib >= MAXLIBS)
 					uerror ("слишком много библиотек");
@@ -218,7 +454,7 @@ int main (int argc, char **argv)
 			infile = argv[i];
 			if (! infile1)
 				infile1 = infile;
-			if (! freopen (infile, "r", stdin))
+			if (! readsource (infile))
 				uerror ("не могу открыть");
 			line = 1;
 			parse ();
@@ -231,7 +467,8 @@ int main (int argc, char **argv)
 		if (! infile1) {
 			printf ("Ассемблер М-20\n");
 			printf ("Вызов:\n");
-			printf ("\tas20 [-d] [-o outfile.m20] [-l dir] infile.s ...\n\n");
+			printf ("\tas20 [-d] [-O [-e entry]] [-T] [-o outfile.m20] [-l dir|lib.a20] infile.s ...\n");
+			printf ("\tas20 -c [-d] [-o outfile.o20] infile.s ...\n\n");
 			return -1;
 		}
 		outfile = malloc (4 + strlen (infile1));
@@ -241,7 +478,7 @@ int main (int argc, char **argv)
 		cp = strrchr (outfile, '.');
 		if (! cp)
 			cp = outfile + strlen (outfile);
-		strcpy (cp, ".m20");
+		strcpy (cp, relocatable ? ".o20" : ".m20");
 		if (debug)
 			fprintf (stderr, "запись %s\n", outfile);
 	}
@@ -249,24 +486,23 @@ int main (int argc, char **argv)
 	if (! freopen (outfile, "w", stdout))
 		uerror ("не могу открыть %s", outfile);
 
+	if (relocatable) {
+		relocate ();
+		output_module ();
+		return 0;
+	}
 	if (! nlib)
 		libtab[nlib++].name = "/usr/local/lib/m20";
 	libraries ();
 	relocate ();
+	if (optim)
+		optimize ();
+	if (timing)
+		timeanal ();
 	output ();
 	return 0;
 }
 
-int lookcmd ()
-{
-	int i;
-
-	for (i=0; i<64; ++i)
-		if (! wcscmp (opname[i], name))
-			return i;
-	return -1;
-}
-
 int hexdig (int c)
 {
 	if (c <= '9')      return c - '0';
@@ -321,35 +557,35 @@ void getnum (int c)
 {
 	intval = 0;
 	if (c == '0') {
-		c = unicode_getc (stdin);
+		c = nextc ();
 		if (c == 'x' || c == 'X') {
-			while (is_hex (c = unicode_getc (stdin)))
+			while (is_hex (c = nextc ()))
 				intval = intval*16 + hexdig (c);
 			if (c >= 0)
-				unicode_ungetc (c);
+				backc (c);
 			return;
 		}
 		if (c == 'b' || c == 'B') {
-			while ((c = unicode_getc (stdin)) == '0' || c == '1')
+			while ((c = nextc ()) == '0' || c == '1')
 				intval = intval*2 + c - '0';
 			if (c >= 0)
-				unicode_ungetc (c);
+				backc (c);
 			return;
 		}
 		if (c >= 0)
-			unicode_ungetc (c);
-		while (is_octal (c = unicode_getc (stdin)))
+			backc (c);
+		while (is_octal (c = nextc ()))
 			intval = intval*8 + hexdig (c);
 		if (c >= 0)
-			unicode_ungetc (c);
+			backc (c);
 		return;
 	}
 	if (c >= 0)
-		unicode_ungetc (c);
-	while (is_digit (c = unicode_getc (stdin)))
+		backc (c);
+	while (is_digit (c = nextc ()))
 		intval = intval*10 + hexdig (c);
 	if (c >= 0)
-		unicode_ungetc (c);
+		backc (c);
 }
 
 /*
@@ -362,30 +598,127 @@ uint64_t getreal ()
 	char buf [80], *p;
 
 	do {
-		c = unicode_getc (stdin);
+		c = nextc ();
 	} while (c == ' ' || c == '\t');
 
 	p = buf;
 	while (c < 256 && strchr ("0123456789.+-eE", c)) {
 		*p++ = c;
-		c = unicode_getc (stdin);
+		c = nextc ();
 	}
-	unicode_ungetc (c);
+	backc (c);
 	*p = 0;
 	return ieee_to_m20 (strtod (buf, 0));
 }
 
+/*
+ * Read the literal value after "=".
+ * =0777, =0x1ff, =0b101 - word as is
+ * =1.5, =-2, =1e3      - real number, as .вещ
+ */
+uint64_t getliteral ()
+{
+	int c, c1;
+	uint64_t w;
+	char buf [80], *p, *end;
+	double d;
+
+	c = nextc ();
+	if (c == '0') {
+		c1 = nextc ();
+		w = 0;
+		if (c1 == 'x' || c1 == 'X') {
+			while (is_hex (c = nextc ()))
+				w = w*16 + hexdig (c);
+		} else if (c1 == 'b' || c1 == 'B') {
+			while ((c = nextc ()) == '0' || c == '1')
+				w = w*2 + c - '0';
+		} else if (is_octal (c1)) {
+			for (c=c1; is_octal (c); c=nextc ())
+				w = w*8 + hexdig (c);
+		} else {
+			/* Ноль или 0.5 - вещественное. */
+			backc (c1);
+			goto real;
+		}
+		backc (c);
+		if (w >> 45)
+			uerror ("слишком большой литерал");
+		return w;
+	}
+real:
+	/* Знак - только в начале и после порядка. */
+	p = buf;
+	while (p < buf + sizeof (buf) - 1 && c < 256 &&
+	    (strchr ("0123456789.eE", c) || ((c == '+' || c == '-') &&
+	    (p == buf || p[-1] == 'e' || p[-1] == 'E')))) {
+		*p++ = c;
+		c = nextc ();
+	}
+	backc (c);
+	*p = 0;
+	if (p == buf)
+		uerror ("пропущено значение литерала");
+	d = strtod (buf, &end);
+	if (*end)
+		uerror ("неверный литерал");
+	return ieee_to_m20 (d);
+}
+
+/*
+ * Find the literal in the pool, or add it.
+ * Return the literal number.
+ */
+int lookliteral (uint64_t val)
+{
+	unsigned h;
+	int i, n;
+
+	if (2 * (nlit + 1) > lithashsize) {
+		lithashsize = lithashsize ? lithashsize * 2 : 256;
+		free (lithash);
+		lithash = calloc (lithashsize, sizeof (lithash[0]));
+		if (! lithash)
+			uerror ("мало памяти");
+		for (i=0; i<nlit; ++i) {
+			h = LITHASH (littab[i].val) & (lithashsize - 1);
+			while (lithash [h])
+				h = (h + 1) & (lithashsize - 1);
+			lithash [h] = i + 1;
+		}
+	}
+	h = LITHASH (val) & (lithashsize - 1);
+	while ((n = lithash [h]) != 0) {
+		if (littab[n-1].val == val)
+			return n - 1;
+		h = (h + 1) & (lithashsize - 1);
+	}
+	if (nlit >= litsize) {
+		litsize = litsize ? litsize * 2 : 256;
+		littab = realloc (littab, litsize * sizeof (littab[0]));
+		if (! littab)
+			uerror ("мало памяти");
+	}
+	littab[nlit].val = val;
+	littab[nlit].addr = 0;
+	lithash [h] = nlit + 1;
+	return nlit++;
+}
+
 void getname (int c, int extname)
 {
 	wchar_t *cp;
+	unsigned h = 0;
 
-	for (cp=name; c>' ' && c!=':'; c=unicode_getc (stdin)) {
+	for (cp=name; c>' ' && c!=':'; c=nextc ()) {
 		if (! extname && ! is_letter (c) && ! is_digit (c))
 			break;
 		*cp++ = c;
+		h = h * KWMULT + c;
 	}
 	*cp = 0;
-	unicode_ungetc (c);
+	namehash = h;
+	backc (c);
 }
 
 /*
@@ -394,24 +727,25 @@ void getname (int c, int extname)
 int getlex (int *pval, int extname)
 {
 	int c;
+	struct kwtab *kw;
 
 	if (blexflag) {
 		blexflag = 0;
 		*pval = blextype;
 		return backlex;
 	}
-	for (;;) switch (c = unicode_getc (stdin)) {
+	for (;;) switch (c = nextc ()) {
 	case ';':
 	case '#':
-skiptoeol:      while ((c = unicode_getc (stdin)) != '\n')
+skiptoeol:      while ((c = nextc ()) != '\n')
 			if (c == EOF)
 				return LEOF;
 	case '\n':
 		++line;
-		c = unicode_getc (stdin);
+		c = nextc ();
 		if (c == '#')
 			goto skiptoeol;
-		unicode_ungetc (c);
+		backc (c);
 		*pval = line;
 		return LEOL;
 	case ' ':
@@ -420,21 +754,21 @@ skiptoeol:      while ((c = unicode_getc (stdin)) != '\n')
 	case EOF:
 		return LEOF;
 	case '<':
-		if ((c = unicode_getc (stdin)) == '<')
+		if ((c = nextc ()) == '<')
 			return LLSHIFT;
-		unicode_ungetc (c);
+		backc (c);
 		return '<';
 	case '>':
-		if ((c = unicode_getc (stdin)) == '>')
+		if ((c = nextc ()) == '>')
 			return LRSHIFT;
-		unicode_ungetc (c);
+		backc (c);
 		return '>';
 	case '\'':
-		c = unicode_getc (stdin);
+		c = nextc ();
 		if (c == '\'')
 			uerror ("неверная символьная константа");
 		if (c == '\\')
-			switch (c = unicode_getc (stdin)) {
+			switch (c = nextc ()) {
 			case 'a':  c = 0x07; break;
 			case 'b':  c = '\b'; break;
 			case 'f':  c = '\f'; break;
@@ -446,7 +780,7 @@ skiptoeol:      while ((c = unicode_getc (stdin)) != '\n')
 			case '\\': break;
 			default: uerror ("неверная символьная константа");
 			}
-		if (unicode_getc (stdin) != '\'')
+		if (nextc () != '\'')
 			uerror ("неверная символьная константа");
 		intval = c;
 		return LNUM;
@@ -466,16 +800,14 @@ skiptoeol:      while ((c = unicode_getc (stdin)) != '\n')
 		if (! is_letter (c))
 			uerror ("неверный символ: \\u%x", c);
 		getname (c, extname);
-		if (name[0] == '.') {
-			if (! name[1]) return '.';
-			if (! wcscmp (name, L".это"))   return LEQU;
-			if (! wcscmp (name, L".перем")) return LDATA;
-			if (! wcscmp (name, L".адрес")) return LORG;
-			if (! wcscmp (name, L".вещ"))   return LCONST;
-			if (! wcscmp (name, L".текст")) return LTEXT;
-		}
-		if ((*pval = lookcmd()) != -1)
-			return LCMD;
+		if (name[0] == '.' && ! name[1])
+			return '.';
+		kw = &kwtab [KWSLOT (namehash)];
+		if (kw->name && ! wcscmp (kw->name, name)) {
+			if (kw->lex == LCMD)
+				*pval = kw->code;
+			return kw->lex;
+		}
 		*pval = lookname ();
 		return LNAME;
 	}
@@ -499,7 +831,7 @@ int getterm ()
 	default:
 		uerror ("пропущен операнд");
 	case LNUM:
-		cval = unicode_getc (stdin);
+		cval = nextc ();
 		if (cval == L'в' || cval == L'н') {
 			if (cval == L'н')
 				extref = -intval;
@@ -509,7 +841,7 @@ int getterm ()
 			intval = 0;
 			return TUNDF;
 		}
-		unicode_ungetc (cval);
+		backc (cval);
 		return TABS;
 	case LNAME:
 		if (stab[cval].type == TUNDF) {
@@ -525,6 +857,12 @@ int getterm ()
 		extflag |= RRA;
 		intval = 0;
 		return TABS;
+	case '=':
+		/* Литерал: адрес слова из пула констант. */
+		extref = lookliteral (getliteral ());
+		extflag |= RLIT;
+		intval = 0;
+		return TUNDF;
 	case '(':
 		getexpr (&s);
 		if (getlex (&cval, 0) != ')')
@@ -538,7 +876,7 @@ int getterm ()
  * Put the type of expression into *s.
  *
  * expr = [term] {op term}...
- * term = LNAME | LNUM | "." | "(" expr ")"
+ * term = LNAME | LNUM | "." | "=" literal | "(" expr ")"
  * op   = "+" | "-" | "&" | "|" | "^" | "~" | "<<" | ">>" | "/" | "*" | "%"
  */
 int getexpr (int *s)
@@ -546,6 +884,7 @@ int getexpr (int *s)
 	int clex, cval, s2, rez;
 
 	/* Get the first item. */
+	extflag &= ~RLIT;
 	switch (clex = getlex (&cval, 0)) {
 	default:
 		ungetlex (clex, cval);
@@ -557,6 +896,7 @@ int getexpr (int *s)
 	case '.':
 	case '(':
 	case '@':
+	case '=':
 		ungetlex (clex, cval);
 		*s = getterm ();
 		rez = intval;
@@ -637,6 +977,8 @@ int getexpr (int *s)
 			break;
 		default:
 			ungetlex (clex, cval);
+			if ((extflag & RLIT) && rez)
+				uerror ("литерал нельзя складывать");
 			intval = rez;
 			return rez;
 		}
@@ -650,6 +992,8 @@ void store_word (int addr, uint64_t val)
 {
 	ram [addr] = val;
 	ram_dirty [addr] = 1;
+	ram_line [addr] = stmtline;
+	ram_file [addr] = filenum;
 	if (debug)
 		fprintf (stderr, "слово %0o: %03o %04o %04o %04o\n", addr,
 			(int) (val >> 36), (int) (val >> 24) & 07777,
@@ -667,13 +1011,13 @@ void getstring ()
 	n = 0;
 	w = 0;
 	for (;;) {
-		switch (c = unicode_getc (stdin)) {
+		switch (c = nextc ()) {
 		case EOF:
 			uerror ("незакрытая текстовая строка");
 		case '"':
 			break;
 		case '\\':
-			switch (c = unicode_getc (stdin)) {
+			switch (c = nextc ()) {
 			case EOF:
 				uerror ("незакрытая текстовая строка");
 			case '\n':
@@ -681,14 +1025,14 @@ void getstring ()
 			case '0': case '1': case '2': case '3':
 			case '4': case '5': case '6': case '7':
 				cval = c & 07;
-				c = unicode_getc (stdin);
+				c = nextc ();
 				if (c>='0' && c<='7') {
 					cval = cval<<3 | (c & 7);
-					c = unicode_getc (stdin);
+					c = nextc ();
 					if (c>='0' && c<='7') {
 						cval = cval<<3 | (c & 7);
-					} else unicode_ungetc (c);
-				} else unicode_ungetc (c);
+					} else backc (c);
+				} else backc (c);
 				c = cval;
 				break;
 			case 't':
@@ -733,8 +1077,15 @@ void parse ()
 {
 	int clex, cval, tval;
 
+	/* Имя файла для таблицы строк. */
+	srcfile = realloc (srcfile, (filenum + 1) * sizeof (char*));
+	if (! srcfile)
+		uerror ("мало памяти");
+	srcfile [filenum] = strdup (infile);
+
 	for (;;) {
 		clex = getlex (&cval, 1);
+		stmtline = line;
 		switch (clex) {
 		case LEOF:
 			return;
@@ -800,8 +1151,13 @@ void parse ()
 			}
 			break;
 		case LNUM:
-			if (nlabels >= MAXLABELS)
-				uerror ("слишком много цифровых меток");
+			if (nlabels >= labelsize) {
+				labelsize = labelsize ? labelsize * 2 : 256;
+				labeltab = realloc (labeltab,
+					labelsize * sizeof (labeltab[0]));
+				if (! labeltab)
+					uerror ("мало памяти");
+			}
 			labeltab[nlabels].num = intval;
 			labeltab[nlabels].value = count;
 			++nlabels;
@@ -815,8 +1171,29 @@ void parse ()
 			getexpr (&tval);
 			if (tval != TABS)
 				uerror ("неверное значение .адрес");
+			if (relocatable)
+				uerror (".адрес нельзя использовать в модуле");
+			orgused = 1;
 			count = intval;
 			break;
+		case LOVL:		/* .оверлей имя */
+			if (! relocatable)
+				uerror (".оверлей можно использовать только в модуле");
+			if (getlex (&cval, 1) != LNAME)
+				uerror ("нет имени оверлея");
+			if (ovlname && wcscmp (ovlname, name) != 0)
+				uerror ("модуль может входить только в один оверлей");
+			ovlname = wcsdup (name);
+			if (! ovlname)
+				uerror ("мало памяти");
+			break;
+		case LLOOP:		/* .цикл число */
+			getexpr (&tval);
+			if (tval != TABS || intval <= 0)
+				uerror ("неверное число повторений .цикл");
+			if (count < DATSIZE)
+				ram_loop [count] = intval;
+			break;
 		default:
 			uerror ("синтаксическая ошибка");
 		}
@@ -898,29 +1275,193 @@ void output ()
 		if (ram_dirty [i])
 			break;
 	printf ("; %04o  T  <конец>\n", i);
+
+	/*
+	 * Выдаем таблицу строк исходного текста.
+	 */
+	printf ("\n; Таблица строк\n");
+	for (i=0; i<filenum; ++i)
+		printf ("; файл %d  %s\n", i, srcfile[i]);
+	for (i=0; i<DATSIZE; ++i)
+		if (ram_dirty [i] && ram_line [i])
+			printf ("; %04o  %d  %d\n", i, ram_file [i], ram_line [i]);
+}
+
+/*
+ * Write the relocatable module.
+ */
+void output_module ()
+{
+	OBJMOD m;
+	struct reltab *r;
+	struct stab *s;
+	int i;
+
+	memset (&m, 0, sizeof (m));
+	m.size = count;
+	m.overlay = ovlname;
+	m.nfiles = filenum;
+	m.file = srcfile;
+	m.word = malloc ((count + 1) * sizeof (OBJWORD));
+	m.rel = malloc ((nrel + 1) * sizeof (OBJREL));
+	m.sym = malloc ((stabfree + 1) * sizeof (OBJSYM));
+	if (! m.word || ! m.rel || ! m.sym)
+		uerror ("мало памяти");
+
+	for (i=0; i<DATSIZE; ++i) {
+		if (! ram_dirty [i])
+			continue;
+		m.word[m.nwords].addr = i;
+		m.word[m.nwords].val = ram [i];
+		m.word[m.nwords].file = ram_file [i];
+		m.word[m.nwords].line = ram_line [i];
+		++m.nwords;
+	}
+	for (r=reltab; r<reltab+nrel; ++r) {
+		m.rel[m.nrel].addr = r->addr;
+		m.rel[m.nrel].flags = r->flags & (RA1 | RA2 | RA3);
+		if (r->flags & RBASE) {
+			m.rel[m.nrel++].name = 0;
+			continue;
+		}
+		if (r->flags & RLIT) {
+			m.rel[m.nrel].flags |= RLIT;
+			m.rel[m.nrel].name = 0;
+			m.rel[m.nrel++].lit = littab[r->sym].val;
+			continue;
+		}
+		s = stab + r->sym;
+		if (s->type != TUNDF)
+			continue;
+		if (s->name[1] == '.')
+			nerror ("неопределено", s->name + 1);
+		m.rel[m.nrel++].name = s->name;
+	}
+	for (s=stab; s<stab+stabfree; ++s) {
+		if (s->type == TUNDF || s->name[1] == '.')
+			continue;
+		m.sym[m.nsym].name = s->name;
+		m.sym[m.nsym].type = s->type;
+		m.sym[m.nsym].value = s->value;
+		++m.nsym;
+	}
+	obj_write (&m, stdout);
+}
+
+/*
+ * Add the relocatable module at the current address.
+ */
+void loadmodule (OBJMOD *m)
+{
+	int i, n, base, addr;
+
+	if (debug)
+		fprintf (stderr, "модуль %s\n", m->name);
+	if (m->overlay)
+		uerror ("%s: оверлеи собирает ld20", m->name);
+	base = count;
+	if (base + m->size > DATSIZE)
+		uerror ("%s: недостаточно памяти", m->name);
+	srcfile = realloc (srcfile, (filenum + m->nfiles) * sizeof (char*));
+	if (! srcfile)
+		uerror ("мало памяти");
+	for (i=0; i<m->nfiles; ++i)
+		srcfile [filenum + i] = strdup (m->file[i]);
+
+	for (i=0; i<m->nwords; ++i) {
+		addr = base + m->word[i].addr;
+		ram [addr] = m->word[i].val;
+		ram_dirty [addr] = 1;
+		ram_line [addr] = m->word[i].line;
+		ram_file [addr] = filenum + m->word[i].file;
+		ram_cmd [addr] = 2;
+	}
+	for (i=0; i<m->nsym; ++i) {
+		wcscpy (name, m->sym[i].name);
+		n = lookname ();
+		if (stab[n].type != TUNDF)
+			nerror ("имя определено дважды", name);
+		stab[n].type = m->sym[i].type;
+		stab[n].value = m->sym[i].value;
+		if (m->sym[i].type == TTEXT)
+			stab[n].value += base;
+	}
+	for (i=0; i<m->nrel; ++i) {
+		addr = base + m->rel[i].addr;
+		if (m->rel[i].flags & RLIT) {
+			addreloc (addr, lookliteral (m->rel[i].lit),
+				m->rel[i].flags);
+			continue;
+		}
+		if (! m->rel[i].name) {
+			addfield (addr, m->rel[i].flags, base);
+			if (optim)
+				addreloc (addr, 0, RBASE | m->rel[i].flags);
+			continue;
+		}
+		wcscpy (name, m->rel[i].name);
+		addreloc (addr, lookname (), m->rel[i].flags);
+	}
+	count = base + m->size;
+	filenum += m->nfiles;
+}
+
+/*
+ * Library file name: dir/name.lib, the name in UTF-8.
+ */
+void libpath (char *path, int size, char *dir, wchar_t *name)
+{
+	FILE *fd;
+
+	fd = fmemopen (path, size - 1, "w");
+	if (! fd)
+		uerror ("мало памяти");
+	fprintf (fd, "%s/", dir);
+	obj_putname (name, fd);
+	fprintf (fd, ".lib");
+	fclose (fd);
+	path [size - 1] = 0;
 }
 
 /*
  * Resolve pending references, adding
  * modules from libraries.
+ * A library is either a directory of source files name.lib,
+ * or an archive of modules made by lib20: then the module
+ * is found in its directory, and the names it needs are
+ * appended to the table and resolved further in the same pass.
  */
 void libraries ()
 {
-	struct stab *s;
-	int n, undefined;
-	char name [256];
+	int i, n, m, undefined;
+	char path [256];
+	OBJMOD *mod;
+
+	for (n=0; n<nlib; ++n)
+		libtab[n].lib = obj_libopen (libtab[n].name);
 
 	/* For every undefined reference,
-	 * add the module from the library. */
+	 * add the module from the library.
+	 * The table grows while parsing, so index it by number. */
 	undefined = 0;
-	for (s=stab; s<stab+stabfree; ++s) {
-		if (s->type != TUNDF)
+	for (i=0; i<stabfree; ++i) {
+		if (stab[i].type != TUNDF)
 			continue;
 
 		for (n=0; n<nlib; ++n) {
-			sprintf (name, "%s/%ls.lib", libtab[n].name, s->name);
-			if (freopen (name, "r", stdin)) {
-				infile = name;
+			if (libtab[n].lib) {
+				m = obj_libfind (libtab[n].lib, stab[i].name);
+				if (m < 0 || libtab[n].lib->loaded [m])
+					continue;
+				mod = obj_libload (libtab[n].lib, m);
+				loadmodule (mod);
+				obj_free (mod);
+				break;
+			}
+			libpath (path, sizeof (path), libtab[n].name,
+				stab[i].name);
+			if (readsource (path)) {
+				infile = path;
 				line = 1;
 				parse ();
 				infile = 0;
@@ -930,11 +1471,14 @@ void libraries ()
 		}
 		if (n >= nlib) {
 			fprintf (stderr, "as: неопределено: ");
-			wchar_puts (s->name, stderr);
+			wchar_puts (stab[i].name, stderr);
 			fprintf (stderr, "\n");
 			++undefined;
 		}
 	}
+	for (n=0; n<nlib; ++n)
+		if (libtab[n].lib)
+			obj_libclose (libtab[n].lib);
 	if (undefined > 0) {
 		fprintf (stderr, "as: останов\n");
 		unlink (outfile);
@@ -942,33 +1486,93 @@ void libraries ()
 	}
 }
 
+int compare_label (const void *pa, const void *pb)
+{
+	const struct labeltab *a = pa, *b = pb;
+
+	if (a->num != b->num)
+		return a->num < b->num ? -1 : 1;
+	if (a->value != b->value)
+		return a->value < b->value ? -1 : 1;
+	return 0;
+}
+
 /*
  * Find the relative label address,
  * by the reference address and the label number.
  * Backward references have negative label numbers.
+ * The table is sorted by number and address, so both
+ * directions are a binary search for the first label
+ * (num, value) greater than (num, addr).
  */
 int findlabel (int addr, int sym)
 {
 	struct labeltab *p;
-
+	int num = sym < 0 ? -sym : sym;
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = nlabels;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		p = labeltab + mid;
+		if (p->num < num || (p->num == num && p->value <= addr))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 	if (sym < 0) {
-		/* Backward reference. */
-		for (p=labeltab+nlabels-1; p>=labeltab; --p)
-			if (p->value <= addr && p->num == -sym)
-				return p->value;
+		/* Backward reference: the last one at or before addr. */
+		if (lo > 0 && labeltab[lo-1].num == num)
+			return labeltab[lo-1].value;
 		uerror ("неопределенная метка %dн по адресу %d", -sym, addr);
 	} else {
-		/* Forward reference. */
-		for (p=labeltab; p<labeltab+nlabels; ++p)
-			if (p->value > addr && p->num == sym)
-				return p->value;
+		/* Forward reference: the first one after addr. */
+		if (lo < nlabels && labeltab[lo].num == num)
+			return labeltab[lo].value;
 		uerror ("неопределенная метка %dп по адресу %d", sym, addr);
 	}
 	return 0;
 }
 
+/*
+ * Add the value to the address fields of the word.
+ */
+void addfield (int addr, int flags, int v)
+{
+	int f;
+
+	for (f=RA1; f<=RA3; f<<=1) {
+		if (! (flags & f))
+			continue;
+		switch (f) {
+		case RA1:
+			v += ram [addr] >> 24 & 07777;
+			ram [addr] &= ~0777700000000LL;
+			ram [addr] |= (uint64_t) (v & 07777) << 24;
+			break;
+		case RA2:
+			v += ram [addr] >> 12 & 07777;
+			ram [addr] &= ~077770000LL;
+			ram [addr] |= (uint64_t) (v & 07777) << 12;
+			break;
+		case RA3:
+			v += ram [addr] & 07777;
+			ram [addr] &= ~07777LL;
+			ram [addr] |= v & 07777;
+			break;
+		}
+	}
+}
+
 /*
  * Allocate constants and relocate references.
+ * In a relocatable module, references to labels are marked
+ * with RBASE, and references to undefined names and literals
+ * are kept. With -O they are marked too: the optimiser finds
+ * address fields by them.
+ * The literal pool is placed after the program and the
+ * library modules, one word for every distinct value.
  */
 void relocate ()
 {
@@ -976,35 +1580,45 @@ void relocate ()
 	struct reltab *r;
 	int tsize;
 
+	if (! relocatable && nlit > 0) {
+		for (n=DATSIZE-1; n>0 && ! ram_dirty [n]; --n)
+			continue;
+		if (count <= n)
+			count = n + 1;
+		stmtline = 0;
+		for (n=0; n<nlit; ++n) {
+			if (count >= DATSIZE)
+				uerror ("Недостаточно памяти для литералов");
+			littab[n].addr = count;
+			store_word (count++, littab[n].val);
+		}
+	}
 	tsize = 0;
 	for (n=0; n<DATSIZE; ++n)
 		if (ram_dirty [n])
 			++tsize;
 
 	/* Relocate pending references. */
+	qsort (labeltab, nlabels, sizeof (labeltab[0]), compare_label);
 	for (r=reltab; r<reltab+nrel; ++r) {
-		if (r->flags & RLAB)
+		if (r->flags & RBASE)
+			continue;
+		if (r->flags & RLIT) {
+			if (relocatable)
+				continue;
+			v = littab[r->sym].addr;
+			if (optim)
+				r->flags |= RBASE;
+		} else if (r->flags & RLAB) {
 			v = findlabel (r->addr, r->sym);
-		else
+			if (relocatable || optim)
+				r->flags |= RBASE;
+		} else {
 			v = stab[r->sym].value;
-
-		switch (r->flags & ~RLAB) {
-		case RA1:
-			v += ram [r->addr] >> 24 & 07777;
-			ram [r->addr] &= ~0777700000000LL;
-			ram [r->addr] |= (uint64_t) (v & 07777) << 24;
-			break;
-		case RA2:
-			v += ram [r->addr] >> 12 & 07777;
-			ram [r->addr] &= ~077770000LL;
-			ram [r->addr] |= (uint64_t) (v & 07777) << 12;
-			break;
-		case RA3:
-			v += ram [r->addr] & 07777;
-			ram [r->addr] &= ~07777LL;
-			ram [r->addr] |= v & 07777;
-			break;
+			if ((relocatable || optim) && stab[r->sym].type == TTEXT)
+				r->flags |= RBASE;
 		}
+		addfield (r->addr, r->flags, v);
 	}
 	fprintf (stderr, "Занято %d слов памяти\n", tsize);
 	if (count > DATSIZE)
@@ -1014,8 +1628,12 @@ void relocate ()
 
 void addreloc (int addr, int sym, int flags)
 {
-	if (nrel >= MAXREL)
-		uerror ("слишком много перемещений");
+	if (nrel >= relsize) {
+		relsize = relsize ? relsize * 2 : 1024;
+		reltab = realloc (reltab, relsize * sizeof (reltab[0]));
+		if (! reltab)
+			uerror ("мало памяти");
+	}
 	reltab[nrel].addr = addr;
 	reltab[nrel].sym = sym;
 	reltab[nrel].flags = flags;
@@ -1042,6 +1660,8 @@ void makecmd (int code)
 	getexpr (&type);
 	if (type == TUNDF)
 		addreloc (count, extref, extflag | RA1);
+	else if (type == TTEXT && (relocatable || optim))
+		addreloc (count, 0, RBASE | RA1);
 	a1 = intval & 07777;
 	a2 = a3 = 0;
 	ra = 0;
@@ -1057,6 +1677,8 @@ void makecmd (int code)
 		getexpr (&type);
 		if (type == TUNDF)
 			addreloc (count, extref, extflag | RA2);
+		else if (type == TTEXT && (relocatable || optim))
+			addreloc (count, 0, RBASE | RA2);
 		a2 = intval & 07777;
 		if (extflag & RRA)
 			ra |= 2;
@@ -1070,11 +1692,1529 @@ void makecmd (int code)
 			getexpr (&type);
 			if (type == TUNDF)
 				addreloc (count, extref, extflag | RA3);
+			else if (type == TTEXT && (relocatable || optim))
+				addreloc (count, 0, RBASE | RA3);
 			a3 = intval & 07777;
 			if (extflag & RRA)
 				ra |= 1;
 		}
 	}
+	ram_cmd [count] = 1;
 	store_word (count++, (uint64_t) code << 36 | (uint64_t) ra << 42 |
 		(uint64_t) a1 << 24 | a2 << 12 | a3);
 }
+
+/*
+ * Оптимизатор (флаг -O).
+ *
+ * Работает над готовым образом ram[] после разрешения ссылок.
+ * Адресные поля команд известны по таблице перемещений: с -O
+ * ссылки на метки и имена программы отмечаются RBASE, как в модуле.
+ * Слова, которые программа читает или пишет как данные (адресная
+ * арифметика над командами, ячейки возврата), не меняются
+ * и не удаляются. Удаление со сжатием образа делается, только если
+ * все переходы и адреса кода известны; иначе остаются замены на месте.
+ * Выгода считается по временам команд М-20 из симулятора.
+ */
+
+/* Назначение адреса команды. */
+#define FR	1	/* чтение ячейки */
+#define FW	2	/* запись ячейки */
+#define FJ	4	/* адрес перехода */
+#define FV	8	/* значение: сдвиг, регистр адреса, признак */
+#define FB	16	/* граница массива обмена */
+
+/* Передача управления. */
+#define CSEQ	0	/* следующая команда */
+#define CJUMP	1	/* переход по а2 */
+#define CCOND	2	/* переход по а2 или следующая команда */
+#define CCALL	3	/* переход по а2 с возвратом по а1 */
+#define CSTOP	4	/* останов */
+
+/* Признак Ω. */
+#define OSET	1	/* команда вырабатывает Ω */
+#define OTEST	2	/* команда проверяет Ω */
+
+/* Отметки слов. */
+#define MREAD	1	/* читается как данные */
+#define MWRITE	2	/* записывается */
+#define MRET	4	/* ячейка возврата из подпрограммы */
+#define MTARGET	8	/* адрес перехода */
+#define MREACH	16	/* достижимо от начала */
+#define MDEL	32	/* удаляется */
+#define MINDEX	64	/* база массива или адрес как значение */
+#define MMERGE	128	/* слиты с другим словом того же значения */
+
+/*
+ * Команды М-20: назначение адресов, передача управления, признак Ω
+ * и время выполнения в полумикросекундах, базовое и на разряд сдвига,
+ * как в таблице m20_timing симулятора (simh/m20_cpu.c).
+ */
+#define O(a1,a2,a3,c,w,t,sh)	{ { a1, a2, a3 }, c, w, t, sh }
+#define OADD	O(FR, FR, FW, CSEQ,  OSET,  59, 0)
+#define OLOG	O(FR, FR, FW, CSEQ,  OSET,  48, 0)
+#define OBAD	O(FV, FV, FV, CSTOP, 0,      0, 0)
+#define OLOOP	O(FV, FJ, FV, CCOND, OTEST, 48, 0)
+
+const struct optab {
+	unsigned char f [3];	/* назначение а1, а2, а3 */
+	unsigned char cls;	/* передача управления */
+	unsigned char omega;
+	short time;		/* время, 0.5 мкс */
+	short shift;		/* добавка на разряд сдвига */
+} optab [64] = {
+/* 000 */ O(FR, 0,  FW, CSEQ,  0,     48,  0),	OADD, OADD, OADD,
+/* 004 */ O(FR, FR, FW, CSEQ,  OSET,  272, 0),
+/* 005 */ O(FR, FR, FW, CSEQ,  OSET,  140, 0),
+/* 006 */ O(FV, FR, FW, CSEQ,  OSET,  123, 0),	OLOG,
+/* 010 */ OBAD,	OLOOP,
+/* 012 */ O(FV, FJ, FV, CCOND, 0,     48,  0),	OLOG,
+/* 014 */ O(FV, FR, FW, CSEQ,  OSET,  123, 3),	OLOG,
+/* 016 */ O(FJ, FJ, FW, CCALL, 0,     48,  0),	OBAD,
+/* 020 */ O(FV, 0,  FW, CSEQ,  0,     48,  0),	OADD, OADD, OADD,
+/* 024 */ O(FR, FR, FW, CSEQ,  OSET,  272, 0),
+/* 025 */ O(FR, FR, FW, CSEQ,  OSET,  140, 0),
+/* 026 */ O(FR, FR, FW, CSEQ,  OSET,  123, 0),	OLOG,
+/* 030 */ OBAD,	OLOOP,
+/* 032 */ O(FV, FJ, FV, CCOND, 0,     48,  0),	OLOG,
+/* 034 */ O(FR, FR, FW, CSEQ,  OSET,  48,  3),	OLOG,
+/* 036 */ O(FR, FJ, FW, CCOND, OTEST, 48,  0),	OBAD,
+/* 040 */ OBAD,	OADD, OADD, OADD,
+/* 044 */ O(FR, 0,  FW, CSEQ,  OSET,  550, 0),
+/* 045 */ O(FR, FR, FW, CSEQ,  OSET,  140, 0),
+/* 046 */ O(FV, FR, FW, CSEQ,  OSET,  123, 0),
+/* 047 */ O(0,  0,  FW, CSEQ,  OSET,  48,  0),
+/* 050 */ O(FV, FV, FB, CSEQ,  0,     48,  0),	OLOOP,
+/* 052 */ O(FV, FV, FW, CSEQ,  0,     48,  0),	OLOG,
+/* 054 */ O(FV, FR, FW, CSEQ,  OSET,  123, 3),	OLOG,
+/* 056 */ O(FR, FJ, FW, CJUMP, 0,     48,  0),	OBAD,
+/* 060 */ OBAD,	OADD, OADD, OADD,
+/* 064 */ O(FR, 0,  FW, CSEQ,  OSET,  550, 0),
+/* 065 */ O(FR, FR, FW, CSEQ,  OSET,  140, 0),
+/* 066 */ O(FR, FR, FW, CSEQ,  OSET,  123, 0),
+/* 067 */ O(FR, 0,  FW, CSEQ,  0,     120, 0),
+/* 070 */ O(FB, FJ, FW, CCOND, 0,     48,  0),	OLOOP,
+/* 072 */ O(FV, FR, FW, CSEQ,  0,     48,  0),	OLOG,
+/* 074 */ O(FR, FR, FW, CSEQ,  OSET,  48,  3),	OLOG,
+/* 076 */ O(FR, FJ, FW, CCOND, OTEST, 48,  0),
+/* 077 */ O(FV, FV, FW, CSTOP, 0,     48,  0),
+};
+
+unsigned char opt_addr [DATSIZE];	/* адресные поля: RA1, RA2, RA3 */
+unsigned char opt_mark [DATSIZE];
+int opt_stack [3*DATSIZE + 1];
+char *opt_why;				/* почему нельзя сжимать код */
+int opt_whyaddr;
+int rrused;				/* программа читает регистр результата */
+
+int opcode (int a)
+{
+	return ram [a] >> 36 & 077;
+}
+
+int opflags (int a)
+{
+	return ram [a] >> 42 & 7;
+}
+
+/*
+ * Адрес n (0 - а1, 1 - а2, 2 - а3) слова a.
+ */
+int field (int a, int n)
+{
+	return ram [a] >> (24 - 12*n) & 07777;
+}
+
+void setfield (int a, int n, int v)
+{
+	int sh = 24 - 12*n;
+
+	ram [a] &= ~((uint64_t) 07777 << sh);
+	ram [a] |= (uint64_t) (v & 07777) << sh;
+}
+
+/*
+ * Адрес n - перемещаемый адрес программы.
+ */
+int isaddr (int a, int n)
+{
+	return opt_addr [a] & (RA1 << n);
+}
+
+/*
+ * Адрес n модифицируется регистром адреса.
+ */
+int ramod (int a, int n)
+{
+	return opflags (a) & (4 >> n);
+}
+
+int iscode (int a)
+{
+	return a > 0 && a < DATSIZE && ram_cmd [a];
+}
+
+void nocompact (int a, char *why)
+{
+	if (! opt_why) {
+		opt_why = why;
+		opt_whyaddr = a;
+	}
+}
+
+/*
+ * Время команды в полумикросекундах.
+ */
+int optime (int a)
+{
+	const struct optab *t = &optab [opcode (a)];
+	int n = (field (a, 0) & 0177) - 64;
+
+	return t->time + t->shift * (n > 0 ? n : -n);
+}
+
+/*
+ * Разбор адресов команды a: отметки слов, на которые она
+ * ссылается, и проверка, можно ли сжимать код.
+ */
+void optscan (int a)
+{
+	const struct optab *t = &optab [opcode (a)];
+	int n, f, v;
+
+	if (opt_mark [a] & MRET) {
+		/* Содержимое заменит команда пв. */
+		return;
+	}
+	if (opcode (a) == 020 && (field (a, 0) == 5 || ramod (a, 0)))
+		rrused = 1;
+	for (n=0; n<3; ++n) {
+		f = t->f [n];
+		v = field (a, n);
+		if (f & FJ) {
+			if (opcode (a) == 070 && v == 0 && ! isaddr (a, n))
+				continue;
+			if (ramod (a, n))
+				nocompact (a, "переход по регистру адреса");
+			else if (! isaddr (a, n))
+				nocompact (a, "переход по числовому адресу");
+			else
+				opt_mark [v] |= MTARGET;
+			continue;
+		}
+		if (ramod (a, n)) {
+			/* База массива: сам массив неизвестен. */
+			if (isaddr (a, n))
+				opt_mark [v] |= MINDEX;
+			if (isaddr (a, n) && iscode (v))
+				nocompact (a, "адресная арифметика над кодом");
+			continue;
+		}
+		if (! isaddr (a, n)) {
+			if ((f & (FR | FW | FB)) && v > 0 && v < count)
+				nocompact (a, "числовой адрес внутри программы");
+			continue;
+		}
+		if (f & FR)
+			opt_mark [v] |= MREAD;
+		if (f & FW)
+			opt_mark [v] |= MWRITE;
+		if (f & (FV | FB))
+			opt_mark [v] |= MINDEX;
+		if ((f & (FV | FB)) && iscode (v))
+			nocompact (a, "адрес команды используется как значение");
+	}
+}
+
+/*
+ * Чистый переход: пб 0, адрес, 0 без модификации,
+ * не изменяемый программой.
+ */
+int purejump (int a)
+{
+	return ram_cmd [a] == 1 && ! (opt_mark [a] & MWRITE) &&
+		opcode (a) == 056 && opflags (a) == 0 &&
+		field (a, 0) == 0 && ! isaddr (a, 0) &&
+		field (a, 2) == 0 && ! isaddr (a, 2) && isaddr (a, 1);
+}
+
+/*
+ * Слово можно менять: команда ассемблера, которую программа
+ * не читает и не пишет как данные.
+ */
+int changeable (int a)
+{
+	return ram_cmd [a] == 1 && ! (opt_mark [a] & (MREAD | MWRITE | MDEL));
+}
+
+/*
+ * Признак Ω, выработанный перед командой a, больше не нужен:
+ * на линейном участке его затирает другая команда раньше,
+ * чем проверяет.
+ */
+int omega_dead (int a)
+{
+	const struct optab *t;
+	int steps;
+
+	for (steps=0; steps<32 && a<DATSIZE; ++a) {
+		if (opt_mark [a] & MDEL)
+			continue;
+		if (ram_cmd [a] != 1 || (opt_mark [a] & MWRITE))
+			return 0;
+		t = &optab [opcode (a)];
+		if (t->omega & OTEST)
+			return 0;
+		if (t->omega & OSET)
+			return 1;
+		if (t->cls != CSEQ)
+			return 0;
+		++steps;
+	}
+	return 0;
+}
+
+/*
+ * Обход графа переходов от начала программы.
+ */
+void reach (int entry)
+{
+	const struct optab *t;
+	int sp, a;
+
+	sp = 0;
+	opt_stack [sp++] = entry;
+	while (sp > 0) {
+		a = opt_stack [--sp];
+		if (a <= 0 || a >= DATSIZE || (opt_mark [a] & MREACH))
+			continue;
+		opt_mark [a] |= MREACH;
+		if (opt_mark [a] & MRET) {
+			/* Сюда подпрограмма запишет возврат. */
+			continue;
+		}
+		if (! ram_cmd [a]) {
+			if (opt_mark [a] & MWRITE) {
+				/* Команда, построенная программой. */
+				opt_stack [sp++] = a + 1;
+				continue;
+			}
+			nocompact (a, "выполнение данных");
+			continue;
+		}
+		t = &optab [opcode (a)];
+		switch (t->cls) {
+		case CSTOP:
+			/* После пуска с пульта - следующая команда. */
+			if (a+1 < DATSIZE && ram_cmd [a+1])
+				opt_stack [sp++] = a + 1;
+			break;
+		case CJUMP:
+			opt_stack [sp++] = field (a, 1);
+			break;
+		case CCALL:
+			opt_stack [sp++] = field (a, 1);
+			opt_stack [sp++] = field (a, 0);
+			break;
+		case CCOND:
+			opt_stack [sp++] = field (a, 1);
+			/* пропуск */
+		default:
+			opt_stack [sp++] = a + 1;
+			break;
+		}
+		if ((opt_mark [a] & MWRITE) && t->cls != CSEQ && t->cls != CCOND)
+			opt_stack [sp++] = a + 1;
+	}
+}
+
+/*
+ * Слово a программа может выполнить не на своём месте: команду,
+ * которую она читает или пишет как данные (шаблон, копируемый
+ * в другую ячейку), или адрес программы в слове данных.
+ * Их переходы - тоже точки входа обхода. Переходы по числовому
+ * адресу и по регистру адреса уже запретили сжатие в optscan().
+ */
+void reachcopy (int a)
+{
+	const struct optab *t;
+	int n;
+
+	if (opt_mark [a] & MRET)
+		return;
+	if (! ram_cmd [a]) {
+		for (n=0; n<3; ++n)
+			if (isaddr (a, n) && iscode (field (a, n)))
+				reach (field (a, n));
+		return;
+	}
+	if (! (opt_mark [a] & (MREAD | MWRITE)))
+		return;
+	t = &optab [opcode (a)];
+	for (n=0; n<3; ++n)
+		if ((t->f [n] & FJ) && isaddr (a, n) && ! ramod (a, n))
+			reach (field (a, n));
+}
+
+/*
+ * Пересылка, которая ничего не меняет в памяти:
+ * сама в себя или в нулевую ячейку.
+ */
+int nullmove (int a)
+{
+	int fl = opflags (a);
+
+	if (opcode (a) != 000)
+		return 0;
+	if (field (a, 2) == 0 && ! isaddr (a, 2) && ! (fl & 1))
+		return 1;
+	return field (a, 0) == field (a, 2) &&
+		! isaddr (a, 0) == ! isaddr (a, 2) &&
+		! (fl & 4) == ! (fl & 1);
+}
+
+/*
+ * Пересылка b повторяет только что выполненную пересылку a:
+ * то же самое или обратно.
+ */
+int samemove (int a, int b)
+{
+	if (opcode (a) != 000 || opcode (b) != 000 ||
+	    opflags (a) != 0 || opflags (b) != 0)
+		return 0;
+	if (ram [a] == ram [b] && opt_addr [a] == opt_addr [b])
+		return 1;
+	return field (a, 2) != 0 &&
+		field (b, 0) == field (a, 2) &&
+		field (b, 2) == field (a, 0) &&
+		! isaddr (b, 0) == ! isaddr (a, 2) &&
+		! isaddr (b, 2) == ! isaddr (a, 0);
+}
+
+/*
+ * Две команды сдвига подряд сдвигают одну ячейку в одну сторону:
+ * сдв n, x, y; сдв m, y, y - это сдв n+m, x, y.
+ * Для сдвига мантиссы симулятор не обрезает разряды при сдвиге
+ * влево, поэтому объединяются только сдвиги вправо.
+ */
+int mergeshift (int a, int b)
+{
+	int n, m;
+
+	if (opcode (b) != opcode (a) || (opt_mark [b] & MTARGET) ||
+	    (opflags (a) & 5) || opflags (b) || isaddr (b, 0) ||
+	    field (b, 1) != field (a, 2) || field (b, 2) != field (a, 2) ||
+	    ! isaddr (b, 1) != ! isaddr (a, 2) ||
+	    ! isaddr (b, 2) != ! isaddr (a, 2))
+		return 0;
+	n = (field (a, 0) & 0177) - 64;
+	m = (field (b, 0) & 0177) - 64;
+	if (n * m <= 0 || n + m > 63 || n + m < -63)
+		return 0;
+	if (opcode (a) == 014 && n > 0)
+		return 0;
+	setfield (a, 0, (field (a, 0) & ~0177) | (64 + n + m));
+	return 1;
+}
+
+/*
+ * Сдвиг a заменяется пересылкой: на ноль разрядов - из а2 в а3,
+ * логический на 45 и больше - нуля в а3.
+ */
+int shiftmove (int a)
+{
+	int n, fl = opflags (a);
+
+	n = (field (a, 0) & 0177) - 64;
+	if (n != 0 && (opcode (a) != 054 || (n < 45 && n > -45)))
+		return 0;
+	if (optab[000].time >= optime (a) || ! omega_dead (a + 1))
+		return 0;
+	if (n == 0) {
+		setfield (a, 0, field (a, 1));
+		opt_addr [a] = (opt_addr [a] & RA3) |
+			(isaddr (a, 1) ? RA1 : 0);
+		fl = (fl & 1) | (fl & 2 ? 4 : 0);
+	} else {
+		setfield (a, 0, 0);
+		opt_addr [a] &= RA3;
+		fl &= 1;
+	}
+	setfield (a, 1, 0);
+	ram [a] &= 0777777777777LL;
+	ram [a] |= (uint64_t) fl << 42;
+	return 1;
+}
+
+/*
+ * Переход на следующую оставшуюся команду.
+ */
+int jumpnext (int a)
+{
+	int op = opcode (a), t;
+
+	if ((op != 056 && op != 036 && op != 076) || opflags (a) ||
+	    field (a, 0) || isaddr (a, 0) || field (a, 2) || isaddr (a, 2) ||
+	    ! isaddr (a, 1) || field (a, 1) <= a)
+		return 0;
+	for (t=a+1; t<field (a, 1); ++t)
+		if (! (opt_mark [t] & MDEL))
+			return 0;
+	return 1;
+}
+
+/*
+ * Массивы обмена с внешними устройствами: от первого мб
+ * до последнего ма. Пары команд не сопоставляются.
+ */
+void xferrange (int *lo, int *hi)
+{
+	int a, v;
+
+	*lo = DATSIZE;
+	*hi = 0;
+	for (a=1; a<DATSIZE; ++a) {
+		if (! ram_cmd [a] || (opt_mark [a] & MDEL))
+			continue;
+		if (opcode (a) == 070 && field (a, 0) != 0) {
+			v = ramod (a, 0) ? 0 : field (a, 0);
+			if (v < *lo)
+				*lo = v;
+		}
+		if (opcode (a) == 050) {
+			v = ramod (a, 2) ? DATSIZE : field (a, 2);
+			if (v > *hi)
+				*hi = v;
+		}
+	}
+}
+
+int compare_word (const void *pa, const void *pb)
+{
+	int a = *(const int*) pa, b = *(const int*) pb;
+
+	if (ram [a] != ram [b])
+		return ram [a] < ram [b] ? -1 : 1;
+	if (opt_addr [a] != opt_addr [b])
+		return opt_addr [a] < opt_addr [b] ? -1 : 1;
+	return a - b;
+}
+
+/*
+ * Слияние одинаковых слов данных: констант .вещ, литералов
+ * и слов модулей. Слово сливается, если программа его не пишет
+ * и не выполняет, и оно не входит в массив, к которому обращаются
+ * по регистру адреса, через адрес-значение или обменом с внешним
+ * устройством. Копия удаляется, ссылки на неё при сжатии
+ * переводятся на первое слово: same [копия] = первое.
+ */
+int mergeconst (int *same)
+{
+	int a, n, i, first, nc, indexed, lo, hi;
+	int *cand = opt_stack;
+
+	xferrange (&lo, &hi);
+	/* Адреса в словах данных - тоже адреса-значения. */
+	for (a=1; a<DATSIZE; ++a)
+		if (ram_dirty [a] && ! (opt_mark [a] & (MREACH | MDEL)))
+			for (n=0; n<3; ++n)
+				if (isaddr (a, n))
+					opt_mark [field (a, n)] |= MINDEX;
+
+	nc = 0;
+	indexed = 0;
+	for (a=1; a<DATSIZE; ++a) {
+		if (ram_cmd [a] == 1 || (opt_mark [a] & MREACH))
+			indexed = 0;
+		if (opt_mark [a] & MINDEX)
+			indexed = 1;
+		if (indexed || ! ram_dirty [a] || (a >= lo && a <= hi) ||
+		    (opt_mark [a] & (MWRITE | MRET | MTARGET | MREACH | MDEL)))
+			continue;
+		cand [nc++] = a;
+	}
+	qsort (cand, nc, sizeof (int), compare_word);
+	n = 0;
+	first = 0;
+	for (i=0; i<nc; ++i) {
+		a = cand [i];
+		if (! first || ram [a] != ram [first] ||
+		    opt_addr [a] != opt_addr [first]) {
+			first = a;
+			continue;
+		}
+		same [a] = first;
+		opt_mark [a] |= MDEL | MMERGE;
+		++n;
+	}
+	return n;
+}
+
+/*
+ * Неиспользуемые подпрограммы и данные.
+ * Память программы делится на участки по именам, цифровым меткам,
+ * литералам и границам файлов и модулей. Участок жив, если в нём
+ * есть достижимая команда или точка входа, или на него ссылается
+ * адрес из живого участка. Массив, к которому обращаются
+ * по регистру адреса или через адрес-значение, оживляет участки
+ * данных за ним до следующей команды; массивы обмена с внешними
+ * устройствами живы целиком. Мёртвые участки удаляются.
+ * Возвращает число удалённых слов.
+ */
+int deadcode (int *root, int nroot)
+{
+	static int seg [DATSIZE];		/* начало участка слова */
+	static unsigned char live [DATSIZE];	/* по началу участка */
+	int a, n, v, sp, indexed, lo, hi, ndead;
+	struct stab *s;
+
+	if (count > DATSIZE)
+		return 0;
+	seg [0] = 0;
+	for (a=1; a<count; ++a)
+		seg [a] = (ram_dirty [a] && ram_dirty [a-1] &&
+			ram_file [a] != ram_file [a-1]) ? a : seg [a-1];
+	seg [1] = 1;
+	for (s=stab; s<stab+stabfree; ++s)
+		if (s->type == TTEXT && s->value > 0 && s->value < count)
+			seg [s->value] = s->value;
+	for (n=0; n<nlabels; ++n)
+		if (labeltab[n].value > 0 && labeltab[n].value < count)
+			seg [labeltab[n].value] = labeltab[n].value;
+	for (n=0; n<nlit; ++n)
+		seg [littab[n].addr] = littab[n].addr;
+	for (a=2; a<count; ++a)
+		if (seg [a] != a)
+			seg [a] = seg [a-1];
+
+#define LIVE(x)	if (! live [seg [x]]) { \
+			live [seg [x]] = 1; \
+			opt_stack [sp++] = seg [x]; \
+		}
+	sp = 0;
+	for (a=1; a<count; ++a)
+		if (opt_mark [a] & MREACH)
+			LIVE (a);
+	for (n=0; n<nroot; ++n)
+		LIVE (root [n]);
+	xferrange (&lo, &hi);
+	for (a=lo>1 ? lo : 1; a<=hi && a<count; ++a)
+		LIVE (a);
+	for (;;) {
+		while (sp > 0) {
+			v = opt_stack [--sp];
+			for (a=v; a<count && seg [a] == v; ++a) {
+				if (opt_mark [a] & MDEL)
+					continue;
+				for (n=0; n<3; ++n)
+					if (isaddr (a, n) && field (a, n) > 0 &&
+					    field (a, n) < count)
+						LIVE (field (a, n));
+			}
+		}
+		indexed = 0;
+		for (a=1; a<count; ++a) {
+			if (ram_cmd [a] == 1 || (opt_mark [a] & MREACH))
+				indexed = 0;
+			if ((opt_mark [a] & MINDEX) && live [seg [a]])
+				indexed = 1;
+			if (indexed)
+				LIVE (a);
+		}
+		if (sp == 0)
+			break;
+	}
+#undef LIVE
+
+	ndead = 0;
+	for (a=1; a<count; ++a) {
+		if (live [seg [a]] || (opt_mark [a] & MDEL))
+			continue;
+		opt_mark [a] |= MDEL;
+		++ndead;
+	}
+	return ndead;
+}
+
+void optimize ()
+{
+	static int newaddr [DATSIZE], same [DATSIZE];
+	int a, b, n, t, entry, ndel, nunreach, nthread, nrepl, saved;
+	int nmerge, ndead, nroot, root [MAXENTRY];
+	wchar_t ename [256];
+	int compact;
+	struct reltab *r;
+	struct stab *s;
+
+	for (r=reltab; r<reltab+nrel; ++r)
+		if (r->flags & RBASE)
+			opt_addr [r->addr] |= r->flags & (RA1 | RA2 | RA3);
+	if (orgused)
+		nocompact (0, "программа размещена директивой .адрес");
+	for (a=0; a<DATSIZE; ++a)
+		if (ram_cmd [a] && opcode (a) == 016 &&
+		    isaddr (a, 2) && ! ramod (a, 2))
+			opt_mark [field (a, 2)] |= MRET;
+	for (a=0; a<DATSIZE; ++a)
+		if (ram_cmd [a])
+			optscan (a);
+
+	entry = 0;
+	for (s=stab; s<stab+stabfree; ++s)
+		if (s->type == TTEXT && s->len == 6 &&
+		    ! wcscmp (s->name, L"начало"))
+			entry = s->value;
+	if (! entry)
+		nocompact (0, "нет метки начало");
+
+	/* Переходы на переходы. */
+	nthread = 0;
+	saved = 0;
+	for (a=0; a<DATSIZE && ! rrused; ++a) {
+		if (! changeable (a) || ramod (a, 1) || ! isaddr (a, 1))
+			continue;
+		switch (optab [opcode (a)].cls) {
+		case CJUMP: case CCOND: case CCALL:
+			break;
+		default:
+			continue;
+		}
+		t = field (a, 1);
+		for (n=0; n<16 && purejump (t); ++n) {
+			if (field (t, 1) == t || field (t, 1) == a)
+				break;
+			t = field (t, 1);
+			saved += optab[056].time;
+		}
+		if (t != field (a, 1)) {
+			setfield (a, 1, t);
+			opt_mark [t] |= MTARGET;
+			++nthread;
+		}
+	}
+
+	if (entry)
+		reach (entry);
+
+	/* Точки входа -e: подпрограммы или данные. */
+	nroot = 0;
+	for (n=0; n<nentry; ++n) {
+		if (strlen (entrytab[n]) >= 256)
+			uerror ("%s: слишком длинное имя", entrytab[n]);
+		ename [unicode_decode ((unsigned char*) entrytab[n],
+			strlen (entrytab[n]), ename)] = 0;
+		for (s=stab; s<stab+stabfree; ++s)
+			if (s->type == TTEXT && ! wcscmp (s->name, ename))
+				break;
+		if (s >= stab+stabfree)
+			uerror ("%s: нет такой метки", entrytab[n]);
+		root [nroot++] = s->value;
+		if (ram_cmd [s->value])
+			reach (s->value);
+	}
+	for (a=1; a<DATSIZE; ++a)
+		reachcopy (a);
+	compact = ! opt_why;
+
+	/* Удаление и замена команд. */
+	ndel = nunreach = nrepl = 0;
+	for (a=1; a<DATSIZE; ++a) {
+		if (! changeable (a))
+			continue;
+		if (compact && ! (opt_mark [a] & MREACH)) {
+			opt_mark [a] |= MDEL;
+			++nunreach;
+			continue;
+		}
+		if (compact && ! rrused && nullmove (a)) {
+			opt_mark [a] |= MDEL;
+			saved += optime (a);
+			continue;
+		}
+		for (b=a-1; b>0 && (opt_mark [b] & MDEL); --b)
+			continue;
+		if (compact && ! (opt_mark [a] & MTARGET) && b > 0 &&
+		    ram_cmd [b] == 1 && ! (opt_mark [b] & MWRITE) &&
+		    samemove (b, a)) {
+			opt_mark [a] |= MDEL;
+			saved += optime (a);
+			continue;
+		}
+		if (opcode (a) == 054 || opcode (a) == 014) {
+			for (b=a+1; compact && b<DATSIZE && changeable (b); ++b) {
+				t = optime (a) + optime (b);
+				if (! mergeshift (a, b))
+					break;
+				saved += t - optime (a);
+				opt_mark [b] |= MDEL;
+				++nrepl;
+			}
+			t = optime (a);
+			if (shiftmove (a)) {
+				saved += t - optime (a);
+				++nrepl;
+			}
+		}
+	}
+	for (a=1; a<DATSIZE && compact && ! rrused; ++a) {
+		if (changeable (a) && jumpnext (a)) {
+			opt_mark [a] |= MDEL;
+			saved += optime (a);
+		}
+	}
+
+	ndead = compact ? deadcode (root, nroot) : 0;
+	nmerge = compact ? mergeconst (same) : 0;
+
+	/* Сжатие образа. */
+	for (a=0; a<DATSIZE; ++a)
+		if (opt_mark [a] & MDEL)
+			++ndel;
+	if (ndel > 0) {
+		n = 0;
+		for (a=0; a<DATSIZE; ++a) {
+			newaddr [a] = a - n;
+			if (opt_mark [a] & MDEL)
+				++n;
+		}
+		for (a=0; a<DATSIZE; ++a)
+			if (opt_mark [a] & MMERGE)
+				newaddr [a] = newaddr [same [a]];
+		for (a=0; a<DATSIZE; ++a) {
+			if (opt_mark [a] & MDEL)
+				continue;
+			for (n=0; n<3; ++n)
+				if (isaddr (a, n))
+					setfield (a, n, newaddr [field (a, n)]);
+			b = newaddr [a];
+			ram [b] = ram [a];
+			ram_dirty [b] = ram_dirty [a];
+			ram_line [b] = ram_line [a];
+			ram_file [b] = ram_file [a];
+			ram_cmd [b] = ram_cmd [a];
+			ram_loop [b] = ram_loop [a];
+		}
+		for (a=DATSIZE-ndel; a<DATSIZE; ++a) {
+			ram [a] = 0;
+			ram_dirty [a] = 0;
+			ram_line [a] = 0;
+			ram_cmd [a] = 0;
+			ram_loop [a] = 0;
+		}
+		for (s=stab; s<stab+stabfree; ++s) {
+			if (s->type != TTEXT || s->value < 0 ||
+			    s->value >= DATSIZE)
+				continue;
+			if ((opt_mark [s->value] & (MDEL | MREACH | MMERGE)) ==
+			    MDEL) {
+				/* Удалённая подпрограмма: из таблицы. */
+				if (debug) {
+					fprintf (stderr, "удалено: ");
+					obj_putname (s->name, stderr);
+					fprintf (stderr, "\n");
+				}
+				s->type = -1;
+				continue;
+			}
+			s->value = newaddr [s->value];
+		}
+		count -= ndel;
+	}
+
+	fprintf (stderr, "Оптимизация: удалено %d слов (недостижимых %d), "
+		"переходов сокращено %d, команд заменено %d\n",
+		ndel, nunreach, nthread, nrepl);
+	if (ndead > 0)
+		fprintf (stderr, "Неиспользуемые подпрограммы и данные: "
+			"%d слов\n", ndead);
+	if (nmerge > 0)
+		fprintf (stderr, "Слито одинаковых констант: %d\n", nmerge);
+	fprintf (stderr, "Экономия %d.%d мкс на каждое выполнение "
+		"изменённых команд\n", saved / 2, saved % 2 * 5);
+	if (opt_why)
+		fprintf (stderr, "Код не сжимается: %s, адрес %04o\n",
+			opt_why, opt_whyaddr);
+	if (ndel > 0)
+		fprintf (stderr, "Свободно %d слов\n", DATSIZE - count);
+}
+
+/*
+ * Анализ времени выполнения (-T).
+ * Подпрограмма - адрес перехода пв или начало программы. Граф
+ * переходов подпрограммы строится по командам образа; вызов пв
+ * стоит столько, сколько сама команда и вызванная подпрограмма,
+ * и продолжается по адресу возврата. Циклы выделяются по переходам
+ * назад и сворачиваются от внутренних к внешним: время цикла - число
+ * повторений тела на самый длинный проход плюс последний проход
+ * до выхода. Число повторений даёт цикл по регистру адреса
+ * (начальное значение - команда ра перед циклом, предел и шаг -
+ * команда цикла) или директива .цикл. Сдвиг на число из памяти
+ * или по регистру адреса в худшем случае - на 64 разряда.
+ * Времена - в полумикросекундах, как в optab.
+ */
+#define TNONE		(-1L)	/* пути нет */
+
+#define TUNBOUND	1	/* цикл с неизвестным числом повторений */
+#define TRECURSE	2	/* рекурсия */
+#define TINDIRECT	4	/* переход по регистру адреса */
+#define TENDLESS	8	/* цикл без выхода */
+
+struct tmloop {
+	int head;		/* вход в цикл */
+	int *body, nbody;
+	int *back, nback;	/* откуда переходы назад */
+	int *exit, nexit;	/* куда выходы из цикла */
+	int n, nbest;		/* повторений тела: худшее, лучшее */
+	long w, b;		/* время всего цикла */
+} *tmloop;
+int ntmloop;
+
+struct tmstep {
+	int addr;
+	int n;			/* повторений цикла, 0 - команда */
+	int last;		/* конец цикла */
+	long time;
+};
+
+struct tmrout {
+	int entry;
+	int state;		/* 0 - не считали, 1 - считаем, 2 - готово */
+	int flags;
+	long w, b;
+	struct tmstep *path;	/* самый длинный путь */
+	int npath;
+} *tmrout;
+int ntmrout;
+
+int tm_rout [DATSIZE];		/* номер подпрограммы плюс 1 по адресу входа */
+unsigned char tm_retcell [DATSIZE];
+int tm_rep [DATSIZE];		/* вершина, в которую свёрнута команда */
+int tm_lp [DATSIZE];		/* номер свёрнутого цикла плюс 1 */
+int tm_hl [DATSIZE];		/* номер цикла плюс 1 по входу */
+int tm_reg [DATSIZE];		/* отметка участка */
+int tm_seen [DATSIZE];
+int tm_mark [DATSIZE];
+unsigned char tm_busy [DATSIZE];
+long tm_itw [DATSIZE], tm_itb [DATSIZE];	/* до перехода назад */
+long tm_exw [DATSIZE], tm_exb [DATSIZE];	/* до выхода */
+int tm_next [DATSIZE];		/* продолжение самого длинного пути */
+int tm_stamp, tm_region, tm_head, tm_flags;
+
+/*
+ * Команда, которую можно выполнить: не ячейка возврата.
+ */
+int tmcode (int a)
+{
+	return iscode (a) && ! tm_retcell [a];
+}
+
+/*
+ * Команда меняет регистр адреса.
+ */
+int tmsetra (int a)
+{
+	switch (opcode (a)) {
+	case 052: case 072:
+	case 011: case 031: case 051: case 071:
+	case 012: case 032:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Время команды: лучшее и худшее.
+ */
+void tmtime (int a, long *w, long *b)
+{
+	const struct optab *t = &optab [opcode (a)];
+
+	*w = *b = optime (a);
+	if (t->shift && (opcode (a) == 034 || opcode (a) == 074 ||
+	    ramod (a, 0))) {
+		/* Сдвиг зависит от данных. */
+		*b = t->time;
+		*w = t->time + t->shift * 64;
+	}
+}
+
+/*
+ * Следующие команды внутри подпрограммы; вызов продолжается
+ * по адресу возврата. Возвращает их число.
+ */
+int tmsucc (int a, int *s)
+{
+	const struct optab *t = &optab [opcode (a)];
+	int n = 0;
+
+	switch (t->cls) {
+	case CSEQ:
+		s [n++] = a + 1;
+		break;
+	case CCOND:
+		s [n++] = a + 1;
+		if (opcode (a) == 070 && field (a, 1) == 0)
+			break;
+		/* пропуск */
+	case CJUMP:
+		if (ramod (a, 1))
+			tm_flags |= TINDIRECT;
+		else
+			s [n++] = field (a, 1);
+		break;
+	case CCALL:
+		if (! ramod (a, 0) && field (a, 0) != 0)
+			s [n++] = field (a, 0);
+		break;
+	}
+	return n;
+}
+
+/*
+ * Номер подпрограммы, которую вызывает команда a, или -1.
+ */
+int tmcallee (int a)
+{
+	if (opcode (a) != 016)
+		return -1;
+	if (ramod (a, 1)) {
+		tm_flags |= TINDIRECT;
+		return -1;
+	}
+	return tm_rout [field (a, 1)] - 1;
+}
+
+/*
+ * Время вершины графа: свёрнутого цикла или команды
+ * вместе с вызванной подпрограммой.
+ */
+void tmcost (int a, long *w, long *b)
+{
+	int r;
+
+	if (tm_lp [a]) {
+		*w = tmloop [tm_lp [a] - 1].w;
+		*b = tmloop [tm_lp [a] - 1].b;
+		return;
+	}
+	tmtime (a, w, b);
+	r = tmcallee (a);
+	if (r >= 0 && tmrout[r].state == 2) {
+		*w += tmrout[r].w;
+		*b += tmrout[r].b;
+	}
+}
+
+/*
+ * Самые длинный и короткий пути от вершины a до перехода
+ * на вход участка и до выхода из него. Участок - отмеченные
+ * tm_region вершины, вход - tm_head, -1 - вся подпрограмма.
+ */
+void tmeval (int a)
+{
+	struct tmloop *l;
+	int s [3], *succ, n, i, y;
+	long w, b, e;
+
+	if (tm_seen [a] == tm_region)
+		return;
+	tm_seen [a] = tm_region;
+	tm_busy [a] = 1;
+	tm_itw [a] = tm_itb [a] = tm_exw [a] = tm_exb [a] = TNONE;
+	tm_next [a] = -1;
+	tmcost (a, &w, &b);
+	if (tm_lp [a]) {
+		l = &tmloop [tm_lp [a] - 1];
+		succ = l->exit;
+		n = l->nexit;
+	} else {
+		succ = s;
+		n = tmsucc (a, s);
+	}
+	if (n == 0) {
+		/* Останов или переход по регистру адреса. */
+		tm_exw [a] = tm_exb [a] = 0;
+	}
+	for (i=0; i<n; ++i) {
+		y = succ [i];
+		if (y == tm_head) {
+			tm_itw [a] = 0;
+			tm_itb [a] = 0;
+			continue;
+		}
+		if (! tmcode (y) || tm_reg [y] != tm_region) {
+			/* Выход; возврат - ещё команда пв в ячейке. */
+			e = (tm_head < 0 && y > 0 && y < DATSIZE &&
+				tm_retcell [y]) ? optab[016].time : 0;
+			if (e > tm_exw [a]) {
+				tm_exw [a] = e;
+				tm_next [a] = -1;
+			}
+			if (tm_exb [a] == TNONE || e < tm_exb [a])
+				tm_exb [a] = e;
+			continue;
+		}
+		y = tm_rep [y];
+		if (tm_busy [y]) {
+			/* Цикл с несколькими входами. */
+			tm_flags |= TUNBOUND;
+			continue;
+		}
+		tmeval (y);
+		if (tm_itw [y] > tm_itw [a])
+			tm_itw [a] = tm_itw [y];
+		if (tm_itb [y] != TNONE &&
+		    (tm_itb [a] == TNONE || tm_itb [y] < tm_itb [a]))
+			tm_itb [a] = tm_itb [y];
+		if (tm_exw [y] > tm_exw [a]) {
+			tm_exw [a] = tm_exw [y];
+			tm_next [a] = y;
+		}
+		if (tm_exb [y] != TNONE &&
+		    (tm_exb [a] == TNONE || tm_exb [y] < tm_exb [a]))
+			tm_exb [a] = tm_exb [y];
+	}
+	if (tm_itw [a] != TNONE) {
+		tm_itw [a] += w;
+		tm_itb [a] += b;
+	}
+	if (tm_exw [a] != TNONE) {
+		tm_exw [a] += w;
+		tm_exb [a] += b;
+	}
+	tm_busy [a] = 0;
+}
+
+/*
+ * Число повторений тела цикла: директива .цикл перед входом
+ * или перед переходом назад, иначе цикл по регистру адреса:
+ * один переход назад командой цикла с модификацией а3
+ * (шаг), а перед входом - ра с начальным значением.
+ * Возвращает 0, если число неизвестно.
+ */
+int tmbound (struct tmloop *l, int *node, int nnode)
+{
+	int i, u, a, r0, lim, step, t, s [3], k;
+
+	l->n = ram_loop [l->head];
+	for (i=0; i<l->nback; ++i)
+		if (ram_loop [l->back[i]] > l->n)
+			l->n = ram_loop [l->back[i]];
+	if (l->n > 0) {
+		l->nbest = 1;
+		return 1;
+	}
+	l->n = l->nbest = 1;
+	if (l->nback != 1)
+		return 0;
+	u = l->back [0];
+	switch (opcode (u)) {
+	case 011: case 031: case 051: case 071:
+	case 012: case 032:
+		break;
+	default:
+		return 0;
+	}
+	if (ramod (u, 0) || ramod (u, 1) || ! ramod (u, 2))
+		return 0;
+
+	/* Регистр адреса в теле меняет только команда цикла,
+	 * в цикл входят только из предыдущей команды. */
+	for (i=0; i<l->nbody; ++i)
+		if (l->body[i] != u && tmsetra (l->body[i]))
+			return 0;
+	if (tm_rout [l->head])
+		return 0;
+	for (i=0; i<nnode; ++i) {
+		a = node [i];
+		if (tm_reg [a] == tm_region || a == l->head - 1)
+			continue;
+		for (k=tmsucc (a, s); k>0; --k)
+			if (s [k-1] == l->head)
+				return 0;
+	}
+	r0 = -1;
+	for (a=l->head-1, i=0; i<16 && tmcode (a); --a, ++i) {
+		if (opcode (a) == 052) {
+			if (! ramod (a, 1))
+				r0 = field (a, 1);
+			break;
+		}
+		if (tmsetra (a) || optab [opcode (a)].cls != CSEQ)
+			break;
+	}
+	if (r0 < 0)
+		return 0;
+
+	step = field (u, 2);
+	if (step >= 04000)
+		step -= 010000;
+	lim = field (u, 0);
+	switch (opcode (u)) {
+	case 011: case 051: case 012:
+		/* Пока RA < предела. */
+		if (step <= 0 || lim + step > 010000)
+			return 0;
+		t = r0 < lim ? (lim - r0 + step - 1) / step : 0;
+		break;
+	default:
+		/* Пока RA >= предела. */
+		if (step >= 0 || lim < -step)
+			return 0;
+		t = r0 >= lim ? (r0 - lim) / -step + 1 : 0;
+		break;
+	}
+	l->n = t + 1;
+	l->nbest = (opcode (u) == 012 || opcode (u) == 032) ? t + 1 : 1;
+	return 1;
+}
+
+int compare_loop (const void *pa, const void *pb)
+{
+	const struct tmloop *a = pa, *b = pb;
+
+	return a->nbody - b->nbody;
+}
+
+void tmadd (int **list, int *n, int v)
+{
+	int i;
+
+	for (i=0; i<*n; ++i)
+		if ((*list) [i] == v)
+			return;
+	*list = realloc (*list, (*n + 1) * sizeof (int));
+	if (! *list)
+		uerror ("мало памяти");
+	(*list) [(*n)++] = v;
+}
+
+/*
+ * Поиск переходов назад обходом в глубину.
+ */
+void tmdfs (int a)
+{
+	int s [3], n, y, h;
+
+	tm_busy [a] = 1;
+	tm_seen [a] = tm_region;
+	for (n=tmsucc (a, s); n>0; --n) {
+		y = s [n-1];
+		if (! tmcode (y) || tm_reg [y] != tm_region)
+			continue;
+		if (tm_busy [y]) {
+			h = tm_hl [y];
+			if (! h) {
+				tmloop = realloc (tmloop,
+					(ntmloop + 1) * sizeof (tmloop[0]));
+				if (! tmloop)
+					uerror ("мало памяти");
+				memset (&tmloop [ntmloop], 0,
+					sizeof (tmloop[0]));
+				tmloop [ntmloop].head = y;
+				h = tm_hl [y] = ++ntmloop;
+			}
+			tmadd (&tmloop [h-1].back, &tmloop [h-1].nback, a);
+		} else if (tm_seen [y] != tm_region)
+			tmdfs (y);
+	}
+	tm_busy [a] = 0;
+}
+
+/*
+ * Время подпрограммы r. Вызываемые подпрограммы
+ * считаются раньше.
+ */
+void tmroutine (int r)
+{
+	struct tmloop *l;
+	int *node, nnode, i, j, k, a, y, s [3], changed, last;
+	long itw, itb;
+
+	tmrout[r].state = 1;
+	tm_flags = 0;
+
+	/* Команды подпрограммы. */
+	node = malloc (DATSIZE * sizeof (int));
+	if (! node)
+		uerror ("мало памяти");
+	tm_region = ++tm_stamp;
+	nnode = 0;
+	node [nnode++] = tmrout[r].entry;
+	tm_reg [tmrout[r].entry] = tm_region;
+	for (i=0; i<nnode; ++i) {
+		for (k=tmsucc (node[i], s); k>0; --k) {
+			y = s [k-1];
+			if (tmcode (y) && tm_reg [y] != tm_region) {
+				tm_reg [y] = tm_region;
+				node [nnode++] = y;
+			}
+		}
+	}
+	for (i=0; i<nnode; ++i) {
+		j = tmcallee (node [i]);
+		if (j < 0)
+			continue;
+		if (tmrout[j].state == 1) {
+			tmrout[r].flags |= TRECURSE;
+			continue;
+		}
+		if (tmrout[j].state == 0)
+			tmroutine (j);
+		tmrout[r].flags |= tmrout[j].flags;
+	}
+
+	/* Вызываемые затёрли отметки. */
+	tm_flags = 0;
+	tm_region = ++tm_stamp;
+	for (i=0; i<nnode; ++i) {
+		a = node [i];
+		tm_reg [a] = tm_region;
+		tm_rep [a] = a;
+		tm_lp [a] = tm_hl [a] = 0;
+		tm_busy [a] = 0;
+	}
+	ntmloop = 0;
+	tmdfs (tmrout[r].entry);
+
+	/* Тела циклов: всё, откуда без входа в цикл
+	 * можно дойти до перехода назад. */
+	for (l=tmloop; l<tmloop+ntmloop; ++l) {
+		++tm_stamp;
+		for (i=0; i<l->nback; ++i)
+			tm_mark [l->back[i]] = tm_stamp;
+		tm_mark [l->head] = 0;
+		do {
+			changed = 0;
+			for (i=0; i<nnode; ++i) {
+				a = node [i];
+				if (tm_mark [a] == tm_stamp || a == l->head)
+					continue;
+				for (k=tmsucc (a, s); k>0; --k) {
+					if (s [k-1] != l->head && tmcode (s [k-1]) &&
+					    tm_mark [s [k-1]] == tm_stamp) {
+						tm_mark [a] = tm_stamp;
+						changed = 1;
+						break;
+					}
+				}
+			}
+		} while (changed);
+		tm_mark [l->head] = tm_stamp;
+		for (i=0; i<nnode; ++i)
+			if (tm_mark [node [i]] == tm_stamp)
+				tmadd (&l->body, &l->nbody, node [i]);
+	}
+	qsort (tmloop, ntmloop, sizeof (tmloop[0]), compare_loop);
+
+	/* Свёртка циклов, от внутренних к внешним. */
+	for (l=tmloop; l<tmloop+ntmloop; ++l) {
+		tm_region = ++tm_stamp;
+		tm_head = l->head;
+		for (i=0; i<l->nbody; ++i)
+			tm_reg [l->body[i]] = tm_region;
+		for (i=0; i<l->nbody; ++i)
+			for (k=tmsucc (l->body[i], s); k>0; --k)
+				if (! tmcode (s [k-1]) ||
+				    tm_reg [s [k-1]] != tm_region)
+					tmadd (&l->exit, &l->nexit, s [k-1]);
+		if (l->nexit == 0) {
+			/* Цикл без выхода: считаем один проход. */
+			tm_flags |= TENDLESS;
+			l->n = l->nbest = 1;
+		} else if (! tmbound (l, node, nnode)) {
+			tm_flags |= TUNBOUND;
+			for (last=l->head, i=0; i<l->nbody; ++i)
+				if (l->body[i] > last)
+					last = l->body[i];
+			fprintf (stderr, "Цикл %04o-%04o: неизвестно число "
+				"повторений, нужна директива .цикл\n",
+				l->head, last);
+		}
+		tmeval (l->head);
+		itw = tm_itw [l->head] == TNONE ? 0 : tm_itw [l->head];
+		itb = tm_itb [l->head] == TNONE ? 0 : tm_itb [l->head];
+		if (tm_exw [l->head] == TNONE) {
+			tm_flags |= TENDLESS;
+			tm_exw [l->head] = itw;
+			tm_exb [l->head] = itb;
+		}
+		l->w = (l->n - 1) * itw + tm_exw [l->head];
+		l->b = (l->nbest - 1) * itb + tm_exb [l->head];
+		for (i=0; i<l->nbody; ++i)
+			tm_rep [l->body[i]] = l->head;
+		tm_lp [l->head] = l - tmloop + 1;
+	}
+
+	/* Вся подпрограмма. */
+	tm_region = ++tm_stamp;
+	tm_head = -1;
+	for (i=0; i<nnode; ++i)
+		tm_reg [node [i]] = tm_region;
+	a = tm_rep [tmrout[r].entry];
+	tmeval (a);
+	if (tm_exw [a] == TNONE) {
+		tm_flags |= TENDLESS;
+		tm_exw [a] = tm_exb [a] = 0;
+	}
+	tmrout[r].w = tm_exw [a];
+	tmrout[r].b = tm_exb [a];
+	tmrout[r].flags |= tm_flags;
+
+	/* Самый длинный путь. */
+	tmrout[r].path = malloc ((nnode + 1) * sizeof (struct tmstep));
+	if (! tmrout[r].path)
+		uerror ("мало памяти");
+	for (; a >= 0 && tmrout[r].npath <= nnode; a = tm_next [a]) {
+		struct tmstep *p = &tmrout[r].path [tmrout[r].npath++];
+
+		p->addr = a;
+		p->n = 0;
+		p->last = a;
+		tmcost (a, &p->time, &itb);
+		if (tm_lp [a]) {
+			l = &tmloop [tm_lp [a] - 1];
+			p->n = l->n;
+			for (i=0; i<l->nbody; ++i)
+				if (l->body[i] > p->last)
+					p->last = l->body[i];
+		}
+	}
+
+	for (l=tmloop; l<tmloop+ntmloop; ++l) {
+		free (l->body);
+		free (l->back);
+		free (l->exit);
+	}
+	free (tmloop);
+	tmloop = 0;
+	ntmloop = 0;
+	free (node);
+	tmrout[r].state = 2;
+}
+
+/*
+ * Время в микросекундах.
+ */
+char *tmstr (long t)
+{
+	static char buf [4][32];
+	static int n;
+
+	n = (n + 1) % 4;
+	sprintf (buf [n], "%ld.%ld", t / 2, t % 2 * 5);
+	return buf [n];
+}
+
+/*
+ * Имя по адресу, 0 - нет.
+ */
+struct stab *tmname (int a)
+{
+	struct stab *s;
+
+	for (s=stab; s<stab+stabfree; ++s)
+		if (s->type == TTEXT && s->value == a)
+			return s;
+	return 0;
+}
+
+void timeanal ()
+{
+	struct tmrout *t, *crit;
+	struct tmstep *p;
+	struct stab *s;
+	int a, r, flags;
+
+	/* Ячейки возврата и входы подпрограмм. */
+	for (a=1; a<DATSIZE; ++a)
+		if (iscode (a) && opcode (a) == 016 && ! ramod (a, 2) &&
+		    field (a, 2) != 0)
+			tm_retcell [field (a, 2)] = 1;
+	tmrout = malloc (DATSIZE * sizeof (tmrout[0]));
+	if (! tmrout)
+		uerror ("мало памяти");
+	ntmrout = 0;
+	for (s=stab; s<stab+stabfree; ++s)
+		if (s->type == TTEXT && ! wcscmp (s->name, L"начало") &&
+		    tmcode (s->value)) {
+			memset (&tmrout [ntmrout], 0, sizeof (tmrout[0]));
+			tmrout [ntmrout].entry = s->value;
+			tm_rout [s->value] = ++ntmrout;
+		}
+	for (a=1; a<DATSIZE; ++a) {
+		if (! iscode (a) || tm_retcell [a] || opcode (a) != 016 ||
+		    ramod (a, 1) || ! tmcode (field (a, 1)) ||
+		    tm_rout [field (a, 1)])
+			continue;
+		memset (&tmrout [ntmrout], 0, sizeof (tmrout[0]));
+		tmrout [ntmrout].entry = field (a, 1);
+		tm_rout [field (a, 1)] = ++ntmrout;
+	}
+	if (ntmrout == 0) {
+		fprintf (stderr, "Анализ времени: нет начала и подпрограмм\n");
+		return;
+	}
+	for (r=0; r<ntmrout; ++r)
+		if (tmrout[r].state == 0)
+			tmroutine (r);
+
+	/* Таблица подпрограмм по адресам. */
+	fprintf (stderr, "Время выполнения, мкс:\n");
+	fprintf (stderr, "адрес      лучшее      худшее  подпрограмма\n");
+	flags = 0;
+	crit = 0;
+	for (a=1; a<DATSIZE; ++a) {
+		if (! tm_rout [a])
+			continue;
+		t = &tmrout [tm_rout [a] - 1];
+		fprintf (stderr, "%04o  %10s  %10s%c ", a, tmstr (t->b),
+			tmstr (t->w), (t->flags & (TUNBOUND | TENDLESS |
+			TRECURSE | TINDIRECT)) ? '+' : ' ');
+		s = tmname (a);
+		if (s)
+			obj_putname (s->name, stderr);
+		fprintf (stderr, "\n");
+		flags |= t->flags;
+	}
+	if (flags & TUNBOUND)
+		fprintf (stderr, "+ есть цикл с неизвестным числом "
+			"повторений: худшее время занижено\n");
+	if (flags & TENDLESS)
+		fprintf (stderr, "+ есть цикл без выхода\n");
+	if (flags & TRECURSE)
+		fprintf (stderr, "+ есть рекурсия: время рекурсивных "
+			"вызовов не учтено\n");
+	if (flags & TINDIRECT)
+		fprintf (stderr, "+ есть переходы по регистру адреса: "
+			"они не учтены\n");
+
+	/* Критический путь: начало или первая подпрограмма. */
+	crit = &tmrout [0];
+	fprintf (stderr, "Критический путь ");
+	s = tmname (crit->entry);
+	if (s)
+		obj_putname (s->name, stderr);
+	else
+		fprintf (stderr, "%04o", crit->entry);
+	fprintf (stderr, ", %s мкс:\n", tmstr (crit->w));
+	for (p=crit->path; p<crit->path+crit->npath; ++p) {
+		fprintf (stderr, "%04o  %10s  ", p->addr, tmstr (p->time));
+		if (p->n) {
+			fprintf (stderr, "цикл %04o-%04o, %d раз\n",
+				p->addr, p->last, p->n);
+			continue;
+		}
+		obj_putname (opname [opcode (p->addr)], stderr);
+		r = tmcallee (p->addr);
+		if (r >= 0) {
+			fprintf (stderr, " ");
+			s = tmname (tmrout[r].entry);
+			if (s)
+				obj_putname (s->name, stderr);
+			else
+				fprintf (stderr, "%04o", tmrout[r].entry);
+		}
+		fprintf (stderr, "\n");
+	}
+}
@@ -0,0 +1,744 @@
+/*
+ * Симулятор для ЭВМ М-20: пакетное выполнение.
+ * Copyright (GPL) 2008 Сергей Вакуленко <serge.vakulenko@gmail.com>
+ *
+ * N экземпляров одной программы (например, метод Монте-Карло
+ * с разными начальными значениями) выполняются одновременно.
+ * Состояние машины хранится по столбцам: ячейка addr экземпляра i
+ * лежит в bmem [addr*N + i], регистры - в массивах по экземплярам.
+ * За один шаг выбирается команда с наименьшим РВК среди работающих
+ * экземпляров, и она выполняется во всех экземплярах, где РВК и
+ * слово команды совпадают. Декодирование делается один раз на шаг,
+ * внутренние циклы идут по экземплярам и векторизуются компилятором.
+ * Разошедшиеся по ветвлениям экземпляры выполняются меньшими
+ * группами и снова сходятся, как только их РВК совпадут.
+ *
+ * Обращения к внешним устройствам в пакетном режиме не выполняются:
+ * такой экземпляр останавливается с ошибкой.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "ieee.h"
+#include "sim.h"
+
+static int bn;				/* количество экземпляров */
+static uint64_t *bmem;			/* память, bmem [addr*bn + i] */
+static unsigned char *bdirty;		/* признак записи в ячейку */
+static int *brvk;			/* РВК следующей команды */
+static int *bra;			/* РА */
+static unsigned char *bomega;		/* Ω */
+static uint64_t *brr;			/* РР */
+static uint64_t *brmr;			/* РМР */
+static double *btime;			/* модельное время, мкс */
+static double bdtime;			/* время быстрого пути, общее для всех */
+static char **berr;			/* сообщение об ошибке */
+static int *bact;			/* работающие экземпляры */
+static int *bgrp;			/* группа текущего шага */
+static int *bsel;			/* группа, выбранная из bact */
+static int bj;				/* номер в группе, для возврата по ошибке */
+static int bjump;			/* на шаге был переход или останов */
+static int bfill [DATSIZE];		/* в скольких экземплярах ячейка записана */
+static uint64_t *bnull;			/* сюда пишется результат с A3=0 */
+
+static jmp_buf bjmp;
+
+static void *balloc (size_t size)
+{
+	void *p;
+
+	p = calloc (bn, size);
+	if (! p)
+		uerror ("мало памяти");
+	return p;
+}
+
+/*
+ * Считывание слова из памяти экземпляра l.
+ */
+static inline uint64_t bload (int addr, int l)
+{
+	if (addr == 0)
+		return 0;
+	if (! bdirty [addr*bn + l])
+		uerror ("чтение неинициализированного слова памяти: %02o", addr);
+	return bmem [addr*bn + l];
+}
+
+/*
+ * Запись слова в память экземпляра l.
+ */
+static inline void bstore (int addr, int l, uint64_t val)
+{
+	if (addr == 0)
+		return;
+	bmem [addr*bn + l] = val;
+	if (! bdirty [addr*bn + l]) {
+		bdirty [addr*bn + l] = 1;
+		++bfill [addr];
+	}
+}
+
+/*
+ * Остановка экземпляра по ошибке.
+ */
+static void bfail (int l, int pc, char *msg)
+{
+	char buf [300];
+
+	snprintf (buf, sizeof (buf), "%04o: %s", pc, msg);
+	berr [l] = strdup (buf);
+	brvk [l] = -1;
+	bjump = 1;
+}
+
+/*
+ * Строка памяти ячейки addr для записи во всех экземплярах.
+ */
+static uint64_t *brow (int addr)
+{
+	if (addr == 0)
+		return bnull;
+	if (bfill [addr] != bn) {
+		memset (bdirty + addr*bn, 1, bn);
+		bfill [addr] = bn;
+	}
+	return bmem + addr*bn;
+}
+
+/*
+ * Быстрый путь: в группе все экземпляры, адреса не модифицируются,
+ * операнды записаны во всех экземплярах. Тогда каждая команда - это
+ * простой цикл по строкам памяти. Возвращает 0, если команда
+ * должна выполняться общим путём. Пока работает быстрый путь,
+ * ни один экземпляр не остановился, поэтому время команды
+ * копится один раз на всех в bdtime.
+ */
+static int bdense (int pc, uint64_t cmd, int n)
+{
+	int flags, op, a1, a2, a3, l, sh;
+	uint64_t *p1, *p2, *p3, x, y;
+
+	flags = cmd >> 42 & 7;
+	op = cmd >> 36 & 077;
+	a1 = cmd >> 24 & 07777;
+	a2 = cmd >> 12 & 07777;
+	a3 = cmd & 07777;
+	if (n != bn || (flags & 6))
+		return 0;
+	p1 = bmem + a1*bn;
+	p2 = bmem + a2*bn;
+
+/* Операнд должен быть записан во всех экземплярах. */
+#define NEED(a)	if (bfill [a] != bn) return 0
+
+	switch (op) {
+	case 011: /* переход по < и Ω=1 */
+	case 031: /* переход по >= и Ω=1 */
+	case 051: /* переход по < и Ω=0 */
+	case 071: /* переход по >= и Ω=0 */
+	case 012: /* переход по < */
+	case 032: /* переход по >= */
+		/* Модификация A3 допустима: он только заносится в РА. */
+		bjump = 1;
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			x = bra[l] < a1;
+			if (op & 020)
+				x = ! x;
+			if (! (op & 002))
+				x &= bomega[l] == ! (op & 040);
+			brvk[l] = x ? a2 : pc + 1;
+			bra[l] = (flags & 1) ? (a3 + bra[l]) & 07777 : a3;
+		}
+		return 1;
+	}
+	if (flags)
+		return 0;
+
+	switch (op) {
+	default:
+		return 0;
+	case 000: /* пересылка */
+		NEED (a1);
+		p3 = brow (a3);
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			p3[l] = brr[l] = p1[l];
+		}
+		break;
+	case 015: /* поразрядное сравнение (исключающее или) */
+		NEED (a1);
+		NEED (a2);
+		p3 = brow (a3);
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			p3[l] = brr[l] = p1[l] ^ p2[l];
+			bomega[l] = (brr[l] == 0);
+		}
+		break;
+	case 055: /* логическое умножение (и) */
+		NEED (a1);
+		NEED (a2);
+		p3 = brow (a3);
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			p3[l] = brr[l] = p1[l] & p2[l];
+			bomega[l] = (brr[l] == 0);
+		}
+		break;
+	case 075: /* логическое сложение (или) */
+		NEED (a1);
+		NEED (a2);
+		p3 = brow (a3);
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			p3[l] = brr[l] = p1[l] | p2[l];
+			bomega[l] = (brr[l] == 0);
+		}
+		break;
+	case 013: /* сложение команд */
+		NEED (a1);
+		NEED (a2);
+		p3 = brow (a3);
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			y = (p1[l] & MANTISSA) + (p2[l] & MANTISSA);
+			p3[l] = brr[l] = (p1[l] & ~MANTISSA) | (y & MANTISSA);
+			bomega[l] = (y & BIT37) != 0;
+		}
+		break;
+	case 033: /* вычитание команд */
+		NEED (a1);
+		NEED (a2);
+		p3 = brow (a3);
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			y = (p1[l] & MANTISSA) - (p2[l] & MANTISSA);
+			p3[l] = brr[l] = (p1[l] & ~MANTISSA) | (y & MANTISSA);
+			bomega[l] = (y & BIT37) != 0;
+		}
+		break;
+	case 014: /* сдвиг мантиссы по адресу */
+		NEED (a2);
+		sh = (a1 & 0177) - 64;
+		p3 = brow (a3);
+		bdtime += 61.5 + 1.5 * (sh>0 ? sh : -sh);
+		for (l=0; l<n; ++l) {
+			y = p2[l];
+			x = y & MANTISSA;
+			x = sh > 0 ? (x << sh) : (x >> -sh);
+			p3[l] = brr[l] = (y & ~MANTISSA) | x;
+			bomega[l] = (x & MANTISSA) == 0;
+		}
+		break;
+	case 054: /* сдвиг по адресу */
+		NEED (a2);
+		sh = (a1 & 0177) - 64;
+		p3 = brow (a3);
+		bdtime += 61.5 + 1.5 * (sh>0 ? sh : -sh);
+		for (l=0; l<n; ++l) {
+			x = sh > 0 ? (p2[l] << sh) & WORD : (p2[l] >> -sh);
+			p3[l] = brr[l] = x;
+			bomega[l] = (x == 0);
+		}
+		break;
+	case 036: /* передача управления по условию Ω=1 */
+	case 056: /* передача управления */
+	case 076: /* передача управления по условию Ω=0 */
+		NEED (a1);
+		bjump = 1;
+		p3 = brow (a3);
+		bdtime += 24;
+		for (l=0; l<n; ++l) {
+			p3[l] = brr[l] = p1[l];
+			brvk[l] = (op == 056 || bomega[l] == (op == 036)) ?
+				a2 : pc + 1;
+		}
+		return 1;
+	}
+#undef NEED
+	for (l=0; l<n; ++l)
+		brvk[l] = pc + 1;
+	return 1;
+}
+
+/*
+ * Выполнение одной команды в группе экземпляров bgrp [0..n-1].
+ * Возвращает 0, если это было обращение к внешнему устройству
+ * или ввод, которые в пакете не поддерживаются.
+ */
+static int bstep (int pc, uint64_t cmd, int n)
+{
+	int flags, op, a1, a2, a3, l, sh;
+	uint64_t x, y, r;
+
+	flags = cmd >> 42 & 7;
+	op = cmd >> 36 & 077;
+	a1 = cmd >> 24 & 07777;
+	a2 = cmd >> 12 & 07777;
+	a3 = cmd & 07777;
+
+/* Адреса команды с учётом модификации по РА экземпляра l. */
+#define A1	((flags & 4) ? (a1 + bra[l]) & 07777 : a1)
+#define A2	((flags & 2) ? (a2 + bra[l]) & 07777 : a2)
+#define A3	((flags & 1) ? (a3 + bra[l]) & 07777 : a3)
+
+/* Цикл по экземплярам группы; после ошибки продолжается со следующего. */
+#define FOREACH	for (; bj < n; ++bj) if ((l = bgrp[bj]), 1)
+
+	if (bdense (pc, cmd, n))
+		return 1;
+	RVK = pc;
+	bj = 0;
+	if (setjmp (bjmp)) {
+		bfail (bgrp[bj], pc, uerror_msg);
+		++bj;
+	}
+	switch (op) {
+	default:
+		FOREACH uerror ("неверная команда: %02o", op);
+		break;
+	case 010: /* ввод с перфокарт */
+	case 030: /* ввод с перфокарт без проверки к.суммы */
+	case 050: /* подготовка обращения к внешнему устройству */
+	case 070: /* выполнение обращения к внешнему устройству */
+		return 0;
+	/*
+	 * Логические операции.
+	 */
+	case 000: /* пересылка */
+		FOREACH {
+			brr[l] = bload (A1, l);
+			bstore (A3, l, brr[l]);
+			btime[l] += 24;
+		}
+		break;
+	case 020: /* чтение пультовых тумблеров */
+		FOREACH {
+			switch (A1) {
+			case 0: brr[l] = 0;    break;
+			case 1: brr[l] = l;    break;
+			case 2: brr[l] = RPU2; break;
+			case 3: brr[l] = RPU3; break;
+			case 4: brr[l] = RPU4; break;
+			case 5: /* RR */       break;
+			default: uerror ("неверный аргумент команды СЧП: %04o", A1);
+			}
+			bstore (A3, l, brr[l]);
+			btime[l] += 24;
+		}
+		break;
+	case 015: /* поразрядное сравнение (исключающее или) */
+	case 035: /* поразрядное сравнение с остановом */
+	case 055: /* логическое умножение (и) */
+	case 075: /* логическое сложение (или) */
+		FOREACH {
+			x = bload (A1, l);
+			y = bload (A2, l);
+			r = op == 055 ? x & y : op == 075 ? x | y : x ^ y;
+			brr[l] = r;
+			bstore (A3, l, r);
+			bomega[l] = (r == 0);
+			btime[l] += 24;
+			if (op == 035 && r)
+				uerror ("останов по несовпадению: РР=%015llo", r);
+		}
+		break;
+	case 013: /* сложение команд */
+	case 033: /* вычитание команд */
+		FOREACH {
+			x = bload (A1, l);
+			y = bload (A2, l) & MANTISSA;
+			y = op == 013 ? (x & MANTISSA) + y : (x & MANTISSA) - y;
+			brr[l] = (x & ~MANTISSA) | (y & MANTISSA);
+			bstore (A3, l, brr[l]);
+			bomega[l] = (y & BIT37) != 0;
+			btime[l] += 24;
+		}
+		break;
+	case 053: /* сложение кодов операций */
+	case 073: /* вычитание кодов операций */
+		FOREACH {
+			x = bload (A1, l);
+			y = bload (A2, l) & ~MANTISSA;
+			y = op == 053 ? (x & ~MANTISSA) + y : (x & ~MANTISSA) - y;
+			brr[l] = (x & MANTISSA) | (y & ~MANTISSA & WORD);
+			bstore (A3, l, brr[l]);
+			bomega[l] = (y & BIT46) != 0;
+			btime[l] += 24;
+		}
+		break;
+	case 014: /* сдвиг мантиссы по адресу */
+	case 034: /* сдвиг мантиссы по порядку числа */
+	case 054: /* сдвиг по адресу */
+	case 074: /* сдвиг по порядку числа */
+		FOREACH {
+			if (op & 020) {
+				sh = (int) (bload (A1, l) >> 36 & 0177) - 64;
+				btime[l] += 24 + 1.5 * (sh>0 ? sh : -sh);
+			} else {
+				sh = (A1 & 0177) - 64;
+				btime[l] += 61.5 + 1.5 * (sh>0 ? sh : -sh);
+			}
+			y = bload (A2, l);
+			if (op & 040) {
+				/* Сдвиг всего слова. */
+				r = y;
+				if (sh > 0)
+					r = (r << sh) & WORD;
+				else if (sh < 0)
+					r >>= -sh;
+				bomega[l] = (r == 0);
+			} else {
+				r = y & ~MANTISSA;
+				if (sh > 0)
+					r |= (y & MANTISSA) << sh;
+				else if (sh < 0)
+					r |= (y & MANTISSA) >> -sh;
+				bomega[l] = ((r & MANTISSA) == 0);
+			}
+			brr[l] = r;
+			bstore (A3, l, r);
+		}
+		break;
+	case 007: /* циклическое сложение */
+	case 027: /* циклическое вычитание */
+		FOREACH {
+			x = bload (A1, l);
+			y = bload (A2, l);
+			if (op == 007) {
+				r = (x & ~MANTISSA) + (y & ~MANTISSA);
+				y = (x & MANTISSA) + (y & MANTISSA);
+			} else {
+				r = (x & ~MANTISSA) - (y & ~MANTISSA);
+				y = (x & MANTISSA) - (y & MANTISSA);
+			}
+			if (r & BIT46)
+				r += BIT37;
+			if (y & BIT37)
+				y += 1;
+			r = (r & WORD) | (y & MANTISSA);
+			brr[l] = r;
+			bstore (A3, l, r);
+			bomega[l] = (y & BIT37) != 0;
+			btime[l] += 24;
+		}
+		break;
+	case 067: /* циклический сдвиг */
+		FOREACH {
+			x = bload (A1, l);
+			brr[l] = (x & 07777777) << 24 | (x >> 24 & 07777777);
+			bstore (A3, l, brr[l]);
+			btime[l] += 60;
+		}
+		break;
+	/*
+	 * Операции управления.
+	 * Омега не изменяется.
+	 */
+	case 016: /* передача управления с возвратом */
+		bjump = 1;
+		FOREACH {
+			brr[l] = 016000000000000LL | (A1 << 12);
+			bstore (A3, l, brr[l]);
+			brvk[l] = A2;
+			btime[l] += 24;
+		}
+		return 1;
+	case 036: /* передача управления по условию Ω=1 */
+	case 056: /* передача управления */
+	case 076: /* передача управления по условию Ω=0 */
+		bjump = 1;
+		FOREACH {
+			brr[l] = bload (A1, l);
+			bstore (A3, l, brr[l]);
+			if (op == 056 || bomega[l] == (op == 036))
+				brvk[l] = A2;
+			else
+				brvk[l] = pc + 1;
+			btime[l] += 24;
+		}
+		return 1;
+	case 077: /* останов машины */
+		bjump = 1;
+		FOREACH {
+			brr[l] = 0;
+			bstore (A3, l, 0);
+			btime[l] += 24;
+			if (A1 || A2)
+				uerror ("останов: A1=%04o, A2=%04o", A1, A2);
+			brvk[l] = -1;
+		}
+		return 1;
+	case 011: /* переход по < и Ω=1 */
+	case 031: /* переход по >= и Ω=1 */
+	case 051: /* переход по < и Ω=0 */
+	case 071: /* переход по >= и Ω=0 */
+	case 012: /* переход по < */
+	case 032: /* переход по >= */
+		bjump = 1;
+		FOREACH {
+			x = bra[l] < A1;
+			if (op & 020)
+				x = ! x;
+			if (! (op & 002))
+				x &= bomega[l] == ! (op & 040);
+			brvk[l] = x ? A2 : pc + 1;
+			bra[l] = A3;
+			btime[l] += 24;
+		}
+		return 1;
+	case 052: /* установка регистра адреса адресом */
+	case 072: /* установка регистра адреса числом */
+		FOREACH {
+			brr[l] = 052000000000000LL | (A1 << 12);
+			bstore (A3, l, brr[l]);
+			bra[l] = op == 052 ? A2 : bload (A2, l) >> 12 & 07777;
+			btime[l] += 24;
+		}
+		break;
+	/*
+	 * Арифметические операции.
+	 */
+	case 001: /* сложение */
+	case 021: case 041: case 061:
+	case 002: /* вычитание */
+	case 022: case 042: case 062:
+	case 003: /* вычитание модулей */
+	case 023: case 043: case 063:
+		FOREACH {
+			x = bload (A1, l);
+			y = bload (A2, l);
+			if ((op & 7) == 2)
+				y ^= SIGN;
+			else if ((op & 7) == 3) {
+				x &= ~SIGN;
+				y |= SIGN;
+			}
+			brr[l] = addition (x, y, op >> 4 & 1, op >> 5 & 1);
+			bstore (A3, l, brr[l]);
+			bomega[l] = (brr[l] & SIGN) != 0;
+			btime[l] += 29.5;
+		}
+		break;
+	case 005: /* умножение */
+	case 025: case 045: case 065:
+		FOREACH {
+			x = bload (A1, l);
+			y = bload (A2, l);
+			RMR = brmr[l];
+			brr[l] = multiplication (x, y, op >> 4 & 1, op >> 5 & 1);
+			brmr[l] = RMR;
+			bstore (A3, l, brr[l]);
+			bomega[l] = (int) (brr[l] >> 36 & 0177) > 0100;
+			btime[l] += 70;
+		}
+		break;
+	case 004: /* деление с округлением */
+	case 024: /* деление без округления */
+		FOREACH {
+			x = bload (A1, l);
+			y = bload (A2, l);
+			brr[l] = division (x, y, op >> 4 & 1);
+			bstore (A3, l, brr[l]);
+			bomega[l] = (int) (brr[l] >> 36 & 0177) > 0100;
+			btime[l] += 136;
+		}
+		break;
+	case 044: /* извлечение корня с округлением */
+	case 064: /* извлечение корня без округления */
+		FOREACH {
+			brr[l] = square_root (bload (A1, l), op >> 4 & 1);
+			bstore (A3, l, brr[l]);
+			bomega[l] = (int) (brr[l] >> 36 & 0177) > 0100;
+			btime[l] += 275;
+		}
+		break;
+	case 047: /* выдача младших разрядов произведения */
+		FOREACH {
+			brr[l] = brmr[l];
+			bstore (A3, l, brr[l]);
+			bomega[l] = (brr[l] & MANTISSA) == 0;
+			btime[l] += 24;
+		}
+		break;
+	case 006: /* сложение порядка с адресом */
+	case 026: /* сложение порядков чисел */
+	case 046: /* вычитание адреса из порядка */
+	case 066: /* вычитание порядков чисел */
+		FOREACH {
+			y = bload (A2, l);
+			if (op & 020) {
+				sh = (int) (y >> 36 & 0177) - 64;
+			} else
+				sh = (A1 & 0177) - 64;
+			if (op & 040)
+				sh = -sh;
+			brr[l] = add_exponent (y, sh);
+			bstore (A3, l, brr[l]);
+			bomega[l] = (int) (brr[l] >> 36 & 0177) > 0100;
+			btime[l] += 61.5;
+		}
+		break;
+	}
+#undef A1
+#undef A2
+#undef A3
+#undef FOREACH
+
+	/* Естественный порядок выполнения. */
+	for (bj=0; bj<n; ++bj) {
+		l = bgrp[bj];
+		if (brvk[l] >= 0)
+			brvk[l] = pc + 1;
+	}
+	return 1;
+}
+
+/*
+ * Выполнение n экземпляров программы из ram[]. Экземпляр получает
+ * свой номер в РПУ1 и, если задан адрес vary, добавленным к мантиссе
+ * этой ячейки. По окончании печатаются ячейки out[] всех экземпляров.
+ */
+void batch_run (int n, int vary, int *out, int nout)
+{
+	int i, k, l, addr, pc, nact, ngrp, same;
+	unsigned long long steps, total;
+	uint64_t cmd, diff, val [MAXOUT];
+	double host, usec;
+
+	bn = n;
+	bmem = balloc (DATSIZE * sizeof (uint64_t));
+	bdirty = balloc (DATSIZE);
+	brvk = balloc (sizeof (int));
+	bra = balloc (sizeof (int));
+	bomega = balloc (1);
+	brr = balloc (sizeof (uint64_t));
+	brmr = balloc (sizeof (uint64_t));
+	btime = balloc (sizeof (double));
+	berr = balloc (sizeof (char*));
+	bact = balloc (sizeof (int));
+	bsel = balloc (sizeof (int));
+	bnull = balloc (sizeof (uint64_t));
+
+	for (addr=0; addr<DATSIZE; ++addr) {
+		for (l=0; l<n; ++l) {
+			bmem [addr*n + l] = ram [addr];
+			bdirty [addr*n + l] = ram_dirty [addr];
+		}
+		bfill [addr] = ram_dirty [addr] ? n : 0;
+	}
+	/* Ячейка 0 всегда читается как ноль. */
+	memset (bmem, 0, n * sizeof (uint64_t));
+	bfill [0] = n;
+	for (l=0; l<n; ++l) {
+		if (vary > 0)
+			bmem [vary*n + l] = vary_word (ram [vary], l);
+		brvk [l] = start_address;
+		bact [l] = l;
+	}
+	nact = n;
+	bdtime = 0;
+	steps = 0;
+	total = 0;
+	uerror_jmp = &bjmp;
+	host = host_usec ();
+	pc = start_address;
+	same = 1;
+	while (nact > 0) {
+		if (same && pc < DATSIZE && bfill [pc] == n) {
+			/* Все экземпляры на одной команде: проверяем,
+			 * что слово команды у всех одинаково. */
+			cmd = bmem [pc*n + bact[0]];
+			diff = 0;
+			if (nact == n) {
+				for (l=0; l<n; ++l)
+					diff |= bmem [pc*n + l] ^ cmd;
+			} else {
+				for (i=0; i<nact; ++i)
+					diff |= bmem [pc*n + bact[i]] ^ cmd;
+			}
+			if (! diff) {
+				bgrp = bact;
+				ngrp = nact;
+				goto step;
+			}
+		}
+		l = -1;
+		for (i=0; i<nact; ++i)
+			if (brvk [bact[i]] == pc) {
+				l = bact[i];
+				break;
+			}
+		if (pc >= DATSIZE || ! bdirty [pc*n + l]) {
+			bfail (l, pc, pc >= DATSIZE ?
+				"выход за пределы памяти" :
+				"выполнение неинициализированного слова памяти");
+			goto compact;
+		}
+
+		/* Группа: тот же РВК и то же слово команды. */
+		cmd = bmem [pc*n + l];
+		bgrp = bsel;
+		ngrp = 0;
+		for (i=0; i<nact; ++i) {
+			l = bact[i];
+			if (brvk[l] == pc && bdirty [pc*n + l] &&
+			    bmem [pc*n + l] == cmd)
+				bgrp [ngrp++] = l;
+		}
+step:
+		++steps;
+		total += ngrp;
+		bjump = 0;
+		if (! bstep (pc, cmd, ngrp)) {
+			for (i=0; i<ngrp; ++i)
+				bfail (bgrp[i], pc, "обращение к внешнему устройству в пакетном режиме");
+		}
+		if (! bjump && ngrp == nact) {
+			/* Все экземпляры перешли к следующей команде. */
+			++pc;
+			same = 1;
+			continue;
+		}
+compact:
+		/* Убираем остановившиеся экземпляры и находим
+		 * наименьший РВК среди оставшихся. */
+		pc = -1;
+		same = 1;
+		for (i=0, k=0; i<nact; ++i) {
+			l = bact[i];
+			if (brvk[l] < 0)
+				continue;
+			bact [k++] = l;
+			if (pc < 0)
+				pc = brvk[l];
+			else if (brvk[l] != pc) {
+				same = 0;
+				if (brvk[l] < pc)
+					pc = brvk[l];
+			}
+		}
+		nact = k;
+	}
+	host = host_usec () - host;
+	uerror_jmp = 0;
+
+	usec = 0;
+	for (l=0; l<n; ++l) {
+		usec += btime[l] + bdtime;
+		for (i=0; i<nout; ++i)
+			val [i] = bmem [out[i]*n + l];
+		if (nout || berr[l])
+			print_instance (l, val, nout, berr[l]);
+	}
+	fflush (stdout);
+	if (stats) {
+		fprintf (stderr, "Статистика: команд %llu, модельное время %.1f мкс, время хоста %.1f мкс\n",
+			total, usec, host);
+		fprintf (stderr, "Пакет: экземпляров %d, шагов %llu, в среднем %.1f экземпляров на шаг\n",
+			n, steps, steps ? (double) total / steps : 0.0);
+	}
+}
@@ -22,6 +22,7 @@ static int unicode_backchar;
 
 static int (*local_getc) (FILE *fin);
 static void (*local_putc) (unsigned short ch, FILE *fout);
+static const unsigned short *local_table;	/* 0 - UTF-8 */
 
 /*
  * GOST-10859 encoding.
@@ -257,6 +258,41 @@ utf8_putc (unsigned short ch, FILE *fout)
 	putc ((ch & 0x3f) | 0x80, fout);
 }
 
+static const unsigned short koi8_to_unicode [256] = {
+	0x00,   0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,
+	0x08,   0x09,   0x0a,   0x0b,   0x0c,   0x0d,   0x0e,   0x0f,
+	0x10,   0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,
+	0x18,   0x19,   0x1a,   0x1b,   0x1c,   0x1d,   0x1e,   0x1f,
+	0x20,   0x21,   0x22,   0x23,   0x24,   0x25,   0x26,   0x27,
+	0x28,   0x29,   0x2a,   0x2b,   0x2c,   0x2d,   0x2e,   0x2f,
+	0x30,   0x31,   0x32,   0x33,   0x34,   0x35,   0x36,   0x37,
+	0x38,   0x39,   0x3a,   0x3b,   0x3c,   0x3d,   0x3e,   0x3f,
+	0x40,   0x41,   0x42,   0x43,   0x44,   0x45,   0x46,   0x47,
+	0x48,   0x49,   0x4a,   0x4b,   0x4c,   0x4d,   0x4e,   0x4f,
+	0x50,   0x51,   0x52,   0x53,   0x54,   0x55,   0x56,   0x57,
+	0x58,   0x59,   0x5a,   0x5b,   0x5c,   0x5d,   0x5e,   0x5f,
+	0x60,   0x61,   0x62,   0x63,   0x64,   0x65,   0x66,   0x67,
+	0x68,   0x69,   0x6a,   0x6b,   0x6c,   0x6d,   0x6e,   0x6f,
+	0x70,   0x71,   0x72,   0x73,   0x74,   0x75,   0x76,   0x77,
+	0x78,   0x79,   0x7a,   0x7b,   0x7c,   0x7d,   0x7e,   0x7f,
+	0x2500, 0x2502, 0x250c, 0x2510, 0x2514, 0x2518, 0x251c, 0x2524,
+	0x252c, 0x2534, 0x253c, 0x2580, 0x2584, 0x2588, 0x258c, 0x2590,
+	0x2591, 0x2592, 0x2593, 0x2320, 0x25a0, 0x2219, 0x221a, 0x2248,
+	0x2264, 0x2265, 0xa0,   0x2321, 0xb0,   0xb2,   0xb7,   0xf7,
+	0x2550, 0x2551, 0x2552, 0x0451, 0x2553, 0x2554, 0x2555, 0x2556,
+	0x2557, 0x2558, 0x2559, 0x255a, 0x255b, 0x255c, 0x255d, 0x255e,
+	0x255f, 0x2560, 0x2561, 0x0401, 0x2562, 0x2563, 0x2564, 0x2565,
+	0x2566, 0x2567, 0x2568, 0x2569, 0x256a, 0x256b, 0x256c, 0xa9,
+	0x044e, 0x0430, 0x0431, 0x0446, 0x0434, 0x0435, 0x0444, 0x0433,
+	0x0445, 0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e,
+	0x043f, 0x044f, 0x0440, 0x0441, 0x0442, 0x0443, 0x0436, 0x0432,
+	0x044c, 0x044b, 0x0437, 0x0448, 0x044d, 0x0449, 0x0447, 0x044a,
+	0x042e, 0x0410, 0x0411, 0x0426, 0x0414, 0x0415, 0x0424, 0x0413,
+	0x0425, 0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e,
+	0x041f, 0x042f, 0x0420, 0x0421, 0x0422, 0x0423, 0x0416, 0x0412,
+	0x042c, 0x042b, 0x0417, 0x0428, 0x042d, 0x0429, 0x0427, 0x042a,
+};
+
 /*
  * Read Unicode symbol from file.
  * Convert from KOI8-R encoding.
@@ -264,40 +300,6 @@ utf8_putc (unsigned short ch, FILE *fout)
 static int
 koi8_getc (FILE *fin)
 {
-	static const unsigned short koi8_to_unicode [256] = {
-		0x00,   0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,
-		0x08,   0x09,   0x0a,   0x0b,   0x0c,   0x0d,   0x0e,   0x0f,
-		0x10,   0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,
-		0x18,   0x19,   0x1a,   0x1b,   0x1c,   0x1d,   0x1e,   0x1f,
-		0x20,   0x21,   0x22,   0x23,   0x24,   0x25,   0x26,   0x27,
-		0x28,   0x29,   0x2a,   0x2b,   0x2c,   0x2d,   0x2e,   0x2f,
-		0x30,   0x31,   0x32,   0x33,   0x34,   0x35,   0x36,   0x37,
-		0x38,   0x39,   0x3a,   0x3b,   0x3c,   0x3d,   0x3e,   0x3f,
-		0x40,   0x41,   0x42,   0x43,   0x44,   0x45,   0x46,   0x47,
-		0x48,   0x49,   0x4a,   0x4b,   0x4c,   0x4d,   0x4e,   0x4f,
-		0x50,   0x51,   0x52,   0x53,   0x54,   0x55,   0x56,   0x57,
-		0x58,   0x59,   0x5a,   0x5b,   0x5c,   0x5d,   0x5e,   0x5f,
-		0x60,   0x61,   0x62,   0x63,   0x64,   0x65,   0x66,   0x67,
-		0x68,   0x69,   0x6a,   0x6b,   0x6c,   0x6d,   0x6e,   0x6f,
-		0x70,   0x71,   0x72,   0x73,   0x74,   0x75,   0x76,   0x77,
-		0x78,   0x79,   0x7a,   0x7b,   0x7c,   0x7d,   0x7e,   0x7f,
-		0x2500, 0x2502, 0x250c, 0x2510, 0x2514, 0x2518, 0x251c, 0x2524,
-		0x252c, 0x2534, 0x253c, 0x2580, 0x2584, 0x2588, 0x258c, 0x2590,
-		0x2591, 0x2592, 0x2593, 0x2320, 0x25a0, 0x2219, 0x221a, 0x2248,
-		0x2264, 0x2265, 0xa0,   0x2321, 0xb0,   0xb2,   0xb7,   0xf7,
-		0x2550, 0x2551, 0x2552, 0x0451, 0x2553, 0x2554, 0x2555, 0x2556,
-		0x2557, 0x2558, 0x2559, 0x255a, 0x255b, 0x255c, 0x255d, 0x255e,
-		0x255f, 0x2560, 0x2561, 0x0401, 0x2562, 0x2563, 0x2564, 0x2565,
-		0x2566, 0x2567, 0x2568, 0x2569, 0x256a, 0x256b, 0x256c, 0xa9,
-		0x044e, 0x0430, 0x0431, 0x0446, 0x0434, 0x0435, 0x0444, 0x0433,
-		0x0445, 0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e,
-		0x043f, 0x044f, 0x0440, 0x0441, 0x0442, 0x0443, 0x0436, 0x0432,
-		0x044c, 0x044b, 0x0437, 0x0448, 0x044d, 0x0449, 0x0447, 0x044a,
-		0x042e, 0x0410, 0x0411, 0x0426, 0x0414, 0x0415, 0x0424, 0x0413,
-		0x0425, 0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e,
-		0x041f, 0x042f, 0x0420, 0x0421, 0x0422, 0x0423, 0x0416, 0x0412,
-		0x042c, 0x042b, 0x0417, 0x0428, 0x042d, 0x0429, 0x0427, 0x042a,
-	};
 	int c;
 
 	c = getc (fin);
@@ -520,6 +522,41 @@ koi8_putc (unsigned short ch, FILE *fout)
 	putc (ch, fout);
 }
 
+static const unsigned short cp1251_to_unicode [256] = {
+	0x00,   0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,
+	0x08,   0x09,   0x0a,   0x0b,   0x0c,   0x0d,   0x0e,   0x0f,
+	0x10,   0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,
+	0x18,   0x19,   0x1a,   0x1b,   0x1c,   0x1d,   0x1e,   0x1f,
+	0x20,   0x21,   0x22,   0x23,   0x24,   0x25,   0x26,   0x27,
+	0x28,   0x29,   0x2a,   0x2b,   0x2c,   0x2d,   0x2e,   0x2f,
+	0x30,   0x31,   0x32,   0x33,   0x34,   0x35,   0x36,   0x37,
+	0x38,   0x39,   0x3a,   0x3b,   0x3c,   0x3d,   0x3e,   0x3f,
+	0x40,   0x41,   0x42,   0x43,   0x44,   0x45,   0x46,   0x47,
+	0x48,   0x49,   0x4a,   0x4b,   0x4c,   0x4d,   0x4e,   0x4f,
+	0x50,   0x51,   0x52,   0x53,   0x54,   0x55,   0x56,   0x57,
+	0x58,   0x59,   0x5a,   0x5b,   0x5c,   0x5d,   0x5e,   0x5f,
+	0x60,   0x61,   0x62,   0x63,   0x64,   0x65,   0x66,   0x67,
+	0x68,   0x69,   0x6a,   0x6b,   0x6c,   0x6d,   0x6e,   0x6f,
+	0x70,   0x71,   0x72,   0x73,   0x74,   0x75,   0x76,   0x77,
+	0x78,   0x79,   0x7a,   0x7b,   0x7c,   0x7d,   0x7e,   0x7f,
+	0x0402, 0x0403, 0x201a, 0x0453, 0x201e, 0x2026, 0x2020, 0x2021,
+	0x20ac, 0x2030, 0x0409, 0x2039, 0x040a, 0x040c, 0x040b, 0x040f,
+	0x0452, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+	0x98,   0x2122, 0x0459, 0x203a, 0x045a, 0x045c, 0x045b, 0x045f,
+	0xa0,   0x040e, 0x045e, 0x0408, 0xa4,   0x0490, 0xa6,   0xa7,
+	0x0401, 0xa9,   0x0404, 0xab,   0xac,   0xad,   0xae,   0x0407,
+	0xb0,   0xb1,   0x0406, 0x0456, 0x0491, 0xb5,   0xb6,   0xb7,
+	0x0451, 0x2116, 0x0454, 0xbb,   0x0458, 0x0405, 0x0455, 0x0457,
+	0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+	0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e, 0x041f,
+	0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+	0x0428, 0x0429, 0x042a, 0x042b, 0x042c, 0x042d, 0x042e, 0x042f,
+	0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+	0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
+	0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+	0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,
+};
+
 /*
  * Read Unicode symbol from file.
  * Convert from Windows code page 1251 encoding.
@@ -527,40 +564,6 @@ koi8_putc (unsigned short ch, FILE *fout)
 static int
 cp1251_getc (FILE *fin)
 {
-	static const unsigned short cp1251_to_unicode [256] = {
-		0x00,   0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,
-		0x08,   0x09,   0x0a,   0x0b,   0x0c,   0x0d,   0x0e,   0x0f,
-		0x10,   0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,
-		0x18,   0x19,   0x1a,   0x1b,   0x1c,   0x1d,   0x1e,   0x1f,
-		0x20,   0x21,   0x22,   0x23,   0x24,   0x25,   0x26,   0x27,
-		0x28,   0x29,   0x2a,   0x2b,   0x2c,   0x2d,   0x2e,   0x2f,
-		0x30,   0x31,   0x32,   0x33,   0x34,   0x35,   0x36,   0x37,
-		0x38,   0x39,   0x3a,   0x3b,   0x3c,   0x3d,   0x3e,   0x3f,
-		0x40,   0x41,   0x42,   0x43,   0x44,   0x45,   0x46,   0x47,
-		0x48,   0x49,   0x4a,   0x4b,   0x4c,   0x4d,   0x4e,   0x4f,
-		0x50,   0x51,   0x52,   0x53,   0x54,   0x55,   0x56,   0x57,
-		0x58,   0x59,   0x5a,   0x5b,   0x5c,   0x5d,   0x5e,   0x5f,
-		0x60,   0x61,   0x62,   0x63,   0x64,   0x65,   0x66,   0x67,
-		0x68,   0x69,   0x6a,   0x6b,   0x6c,   0x6d,   0x6e,   0x6f,
-		0x70,   0x71,   0x72,   0x73,   0x74,   0x75,   0x76,   0x77,
-		0x78,   0x79,   0x7a,   0x7b,   0x7c,   0x7d,   0x7e,   0x7f,
-		0x0402, 0x0403, 0x201a, 0x0453, 0x201e, 0x2026, 0x2020, 0x2021,
-		0x20ac, 0x2030, 0x0409, 0x2039, 0x040a, 0x040c, 0x040b, 0x040f,
-		0x0452, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
-		0x98,   0x2122, 0x0459, 0x203a, 0x045a, 0x045c, 0x045b, 0x045f,
-		0xa0,   0x040e, 0x045e, 0x0408, 0xa4,   0x0490, 0xa6,   0xa7,
-		0x0401, 0xa9,   0x0404, 0xab,   0xac,   0xad,   0xae,   0x0407,
-		0xb0,   0xb1,   0x0406, 0x0456, 0x0491, 0xb5,   0xb6,   0xb7,
-		0x0451, 0x2116, 0x0454, 0xbb,   0x0458, 0x0405, 0x0455, 0x0457,
-		0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
-		0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e, 0x041f,
-		0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
-		0x0428, 0x0429, 0x042a, 0x042b, 0x042c, 0x042d, 0x042e, 0x042f,
-		0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
-		0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
-		0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
-		0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,
-	};
 	int c;
 
 	c = getc (fin);
@@ -767,6 +770,41 @@ cp1251_putc (unsigned short ch, FILE *fout)
 	putc (ch, fout);
 }
 
+static const unsigned short cp866_to_unicode [256] = {
+	0x00,   0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,
+	0x08,   0x09,   0x0a,   0x0b,   0x0c,   0x0d,   0x0e,   0x0f,
+	0x10,   0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,
+	0x18,   0x19,   0x1a,   0x1b,   0x1c,   0x1d,   0x1e,   0x1f,
+	0x20,   0x21,   0x22,   0x23,   0x24,   0x25,   0x26,   0x27,
+	0x28,   0x29,   0x2a,   0x2b,   0x2c,   0x2d,   0x2e,   0x2f,
+	0x30,   0x31,   0x32,   0x33,   0x34,   0x35,   0x36,   0x37,
+	0x38,   0x39,   0x3a,   0x3b,   0x3c,   0x3d,   0x3e,   0x3f,
+	0x40,   0x41,   0x42,   0x43,   0x44,   0x45,   0x46,   0x47,
+	0x48,   0x49,   0x4a,   0x4b,   0x4c,   0x4d,   0x4e,   0x4f,
+	0x50,   0x51,   0x52,   0x53,   0x54,   0x55,   0x56,   0x57,
+	0x58,   0x59,   0x5a,   0x5b,   0x5c,   0x5d,   0x5e,   0x5f,
+	0x60,   0x61,   0x62,   0x63,   0x64,   0x65,   0x66,   0x67,
+	0x68,   0x69,   0x6a,   0x6b,   0x6c,   0x6d,   0x6e,   0x6f,
+	0x70,   0x71,   0x72,   0x73,   0x74,   0x75,   0x76,   0x77,
+	0x78,   0x79,   0x7a,   0x7b,   0x7c,   0x7d,   0x7e,   0x7f,
+	0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+	0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e, 0x041f,
+	0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+	0x0428, 0x0429, 0x042a, 0x042b, 0x042c, 0x042d, 0x042e, 0x042f,
+	0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+	0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
+	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+	0x2555, 0x2563, 0x2551, 0x2557, 0x255d, 0x255c, 0x255b, 0x2510,
+	0x2514, 0x2534, 0x252c, 0x251c, 0x2500, 0x253c, 0x255e, 0x255f,
+	0x255a, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256c, 0x2567,
+	0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256b,
+	0x256a, 0x2518, 0x250c, 0x2588, 0x2584, 0x258c, 0x2590, 0x2580,
+	0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+	0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,
+	0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040e, 0x045e,
+	0xb0,   0x2219, 0xb7,   0x221a, 0x2116, 0xa4,   0x25a0, 0xa0,
+};
+
 /*
  * Read Unicode symbol from file.
  * Convert from Windows code page 866 encoding.
@@ -774,40 +812,6 @@ cp1251_putc (unsigned short ch, FILE *fout)
 static int
 cp866_getc (FILE *fin)
 {
-	static const unsigned short cp866_to_unicode [256] = {
-		0x00,   0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,
-		0x08,   0x09,   0x0a,   0x0b,   0x0c,   0x0d,   0x0e,   0x0f,
-		0x10,   0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,
-		0x18,   0x19,   0x1a,   0x1b,   0x1c,   0x1d,   0x1e,   0x1f,
-		0x20,   0x21,   0x22,   0x23,   0x24,   0x25,   0x26,   0x27,
-		0x28,   0x29,   0x2a,   0x2b,   0x2c,   0x2d,   0x2e,   0x2f,
-		0x30,   0x31,   0x32,   0x33,   0x34,   0x35,   0x36,   0x37,
-		0x38,   0x39,   0x3a,   0x3b,   0x3c,   0x3d,   0x3e,   0x3f,
-		0x40,   0x41,   0x42,   0x43,   0x44,   0x45,   0x46,   0x47,
-		0x48,   0x49,   0x4a,   0x4b,   0x4c,   0x4d,   0x4e,   0x4f,
-		0x50,   0x51,   0x52,   0x53,   0x54,   0x55,   0x56,   0x57,
-		0x58,   0x59,   0x5a,   0x5b,   0x5c,   0x5d,   0x5e,   0x5f,
-		0x60,   0x61,   0x62,   0x63,   0x64,   0x65,   0x66,   0x67,
-		0x68,   0x69,   0x6a,   0x6b,   0x6c,   0x6d,   0x6e,   0x6f,
-		0x70,   0x71,   0x72,   0x73,   0x74,   0x75,   0x76,   0x77,
-		0x78,   0x79,   0x7a,   0x7b,   0x7c,   0x7d,   0x7e,   0x7f,
-		0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
-		0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e, 0x041f,
-		0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
-		0x0428, 0x0429, 0x042a, 0x042b, 0x042c, 0x042d, 0x042e, 0x042f,
-		0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
-		0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
-		0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
-		0x2555, 0x2563, 0x2551, 0x2557, 0x255d, 0x255c, 0x255b, 0x2510,
-		0x2514, 0x2534, 0x252c, 0x251c, 0x2500, 0x253c, 0x255e, 0x255f,
-		0x255a, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256c, 0x2567,
-		0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256b,
-		0x256a, 0x2518, 0x250c, 0x2588, 0x2584, 0x258c, 0x2590, 0x2580,
-		0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
-		0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,
-		0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040e, 0x045e,
-		0xb0,   0x2219, 0xb7,   0x221a, 0x2116, 0xa4,   0x25a0, 0xa0,
-	};
 	int c;
 
 	c = getc (fin);
@@ -1062,32 +1066,40 @@ init_local_encoding ()
 	if (strncasecmp (lang, "koi8", 4) == 0) {
 		/* KOI8-R, KOI8-U and others. */
 		local_putc = koi8_putc;
-		if (! local_getc)
+		if (! local_getc) {
 			local_getc = koi8_getc;
+			local_table = koi8_to_unicode;
+		}
 		return;
 	}
 	if (strcasecmp (lang, "cp1251") == 0 ||
 	    strcasecmp (lang, "cp-1251") == 0) {
 		/* Windows code page 1251. */
 		local_putc = cp1251_putc;
-		if (! local_getc)
+		if (! local_getc) {
 			local_getc = cp1251_getc;
+			local_table = cp1251_to_unicode;
+		}
 		return;
 	}
 	if (strcasecmp (lang, "cp866") == 0 ||
 	    strcasecmp (lang, "cp-866") == 0) {
 		/* Windows code page 866. */
 		local_putc = cp866_putc;
-		if (! local_getc)
+		if (! local_getc) {
 			local_getc = cp866_getc;
+			local_table = cp866_to_unicode;
+		}
 		return;
 	}
 	if (strcasecmp (lang, "utf8") == 0 ||
 	    strcasecmp (lang, "utf-8") == 0) {
 		/* UTF-8. */
 		local_putc = utf8_putc;
-		if (! local_getc)
+		if (! local_getc) {
 			local_getc = utf8_getc;
+			local_table = 0;
+		}
 		return;
 	}
 	fatal_encoding (lang);
@@ -1101,24 +1113,28 @@ set_input_encoding (char *lang)
 	if (strncasecmp (lang, "koi8", 4) == 0) {
 		/* KOI8-R, KOI8-U and others. */
 		local_getc = koi8_getc;
+		local_table = koi8_to_unicode;
 		return;
 	}
 	if (strcasecmp (lang, "cp1251") == 0 ||
 	    strcasecmp (lang, "cp-1251") == 0) {
 		/* Windows code page 1251. */
 		local_getc = cp1251_getc;
+		local_table = cp1251_to_unicode;
 		return;
 	}
 	if (strcasecmp (lang, "cp866") == 0 ||
 	    strcasecmp (lang, "cp-866") == 0) {
 		/* Windows code page 866. */
 		local_getc = cp866_getc;
+		local_table = cp866_to_unicode;
 		return;
 	}
 	if (strcasecmp (lang, "utf8") == 0 ||
 	    strcasecmp (lang, "utf-8") == 0) {
 		/* UTF-8. */
 		local_getc = utf8_getc;
+		local_table = 0;
 		return;
 	}
 	fatal_encoding (lang);
@@ -1151,6 +1167,62 @@ unicode_getc (FILE *fin)
 	return local_getc (fin);
 }
 
+/*
+ * Decode the whole buffer from local encoding (UTF-8, KOI8-R,
+ * CP-1251, CP-866) into wide characters, one table lookup per byte.
+ * The output array must have room for len characters.
+ * Return the number of characters.
+ */
+size_t
+unicode_decode (const unsigned char *in, size_t len, wchar_t *out)
+{
+	/* Length of UTF-8 sequence by the high half of the first byte,
+	 * same as utf8_getc() accepts. */
+	static const unsigned char utf8_len [16] = {
+		1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 3, 3, 2, 2, 3, 3,
+	};
+	const unsigned char *end = in + len;
+	wchar_t *p = out;
+	int c1;
+
+	if (! local_getc)
+		init_local_encoding();
+	if (local_table) {
+		while (in < end)
+			*p++ = local_table [*in++];
+		return len;
+	}
+	while (in < end) {
+		c1 = *in++;
+		switch (utf8_len [c1 >> 4]) {
+		case 1:
+			*p++ = c1;
+			continue;
+		case 2:
+			if (in >= end)
+				break;
+			*p++ = (c1 & 0x1f) << 6 | (in[0] & 0x3f);
+			in += 1;
+			continue;
+		case 3:
+			if (in + 1 >= end)
+				break;
+			if (c1 == 0xEF && in[0] == 0xBB && in[1] == 0xBF) {
+				/* Skip zero width no-break space. */
+				in += 2;
+				continue;
+			}
+			*p++ = (c1 & 0x0f) << 12 | (in[0] & 0x3f) << 6 |
+				(in[1] & 0x3f);
+			in += 2;
+			continue;
+		}
+		/* Truncated sequence at end of buffer. */
+		break;
+	}
+	return p - out;
+}
+
 /*
  * Write Unicode symbol to file.
  * Convert to local encoding (UTF-8, KOI8-R, CP-1251, CP-866).
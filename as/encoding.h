@@ -11,4 +11,5 @@ void utf8_puts (char*, FILE*);
 void wchar_puts (wchar_t*, FILE*);
 int unicode_getc (FILE*);
 void unicode_ungetc (int);
+size_t unicode_decode (const unsigned char*, size_t, wchar_t*);
 void set_input_encoding (char*);
@@ -0,0 +1,965 @@
+/*
+ * Linker for M-20 computer.
+ * Copyright (GPL) 2008 Сергей Вакуленко <serge.vakulenko@gmail.com>
+ *
+ * Собирает программу из перемещаемых модулей as20 -c (файлы .o20)
+ * и модулей из библиотек lib20 (файлы .a20). Модули размещаются
+ * в памяти подряд, начиная с адреса 1, в порядке командной строки;
+ * модули из библиотек - за ними, по мере появления неопределённых
+ * имён. Результат - программа в том же формате, что у as20.
+ * Литералы всех модулей собираются в общий пул без повторов
+ * и размещаются за последним модулем.
+ *
+ * Модули с директивой .оверлей собираются в оверлеи по имени.
+ * Оверлеи хранятся на барабане и по очереди загружаются в общую
+ * область памяти за резидентной частью. Переходы и вызовы между
+ * оверлеями идут через заглушки резидентного диспетчера: он
+ * помнит текущий оверлей и читает с барабана только другой.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <wchar.h>
+#include "config.h"
+#include "encoding.h"
+#include "ieee.h"
+#include "obj.h"
+
+#define DATSIZE         4096    /* размер памяти в словах */
+#define MAXLIBS         10      /* макс. библиотек */
+#define MAXOVL          31      /* макс. оверлеев */
+#define DRUMSIZE        040000  /* размер барабана в словах */
+#define LOADSIZE        7       /* длина загрузчика оверлея */
+
+#define BIT46		01000000000000000LL	/* 46-й бит */
+#define BIT37		00001000000000000LL	/* 37-й бит */
+#define MANTISSA	00000777777777777LL	/* биты 36..1 */
+#define EXT_DRUM	00010   /* 28 - Б - барабан */
+
+struct stab {
+	wchar_t *name;
+	int type;
+	int value;
+	int ovl;		/* номер оверлея, 0 - резидентный */
+} *stab;
+
+/*
+ * Хэш-таблица имён: номер символа в stab плюс 1, 0 - пусто.
+ */
+int *hashtab;
+unsigned hashsize;
+
+struct reltab {
+	int addr;
+	int sym;
+	int flags;
+} *reltab;
+
+/*
+ * Пул литералов, хэш-таблица по значению: номер плюс 1, 0 - пусто.
+ */
+struct littab {
+	uint64_t val;
+	int addr;
+} *littab;
+int nlit, litsize;
+int *lithash;
+unsigned lithashsize;
+
+#define LITHASH(v)	((unsigned) ((v) * 0x9e3779b97f4a7c15ULL >> 40))
+
+OBJLIB *libtab [MAXLIBS];
+
+/*
+ * Оверлеи, с номера 1. Слова оверлея k собираются в ram[]
+ * с адреса k*DATSIZE, а выполняются с адреса ovlbase.
+ */
+struct ovltab {
+	wchar_t *name;
+	int size;		/* длина в словах */
+	int sym;		/* символ начала оверлея */
+	int loader;		/* адрес загрузчика */
+	int drum;		/* адрес на барабане */
+	int calls;		/* вызовов за пределы оверлея */
+} ovltab [MAXOVL + 1];
+int novl;
+int ovlbase;			/* начало общей области */
+int ovlcur, ovlret;		/* ячейки диспетчера: текущий оверлей и возврат */
+int drumbase = 020000;		/* -b: адрес оверлеев на барабане */
+char *drumfile;
+
+/*
+ * Обращения между оверлеями: вызов (пв) или переход на метку
+ * другого оверлея. Каждому нужна заглушка в резидентной части.
+ * Переходы на одну и ту же метку с одним смещением
+ * пользуются общей заглушкой.
+ */
+struct xref {
+	int addr;		/* адрес слова, с номером оверлея */
+	int sym;		/* куда */
+	int off;		/* смещение от метки */
+	int call;		/* вызов пв */
+	int stub;		/* адрес заглушки */
+} *xref;
+int nxref, xrefsize;
+
+char *outfile, *title;
+int debug;
+int count = 1;
+int stabfree, stabsize;
+int nrel, relsize;
+int nlib;
+int nfiles;
+char **srcfile;
+
+uint64_t ram [DATSIZE * (MAXOVL + 1)];
+unsigned char ram_dirty [DATSIZE * (MAXOVL + 1)];
+int ram_line [DATSIZE * (MAXOVL + 1)];
+int ram_file [DATSIZE * (MAXOVL + 1)];
+
+void uerror (char *s, ...)
+{
+	va_list ap;
+
+	va_start (ap, s);
+	fprintf (stderr, "ld: ");
+	vfprintf (stderr, s, ap);
+	va_end (ap);
+	fprintf (stderr, "\n");
+	if (outfile)
+		unlink (outfile);
+	exit (1);
+}
+
+/*
+ * Error about the name: the name is printed in local encoding.
+ */
+void nerror (char *s, wchar_t *name)
+{
+	fprintf (stderr, "ld: %s: ", s);
+	wchar_puts (name, stderr);
+	fprintf (stderr, "\n");
+	if (outfile)
+		unlink (outfile);
+	exit (1);
+}
+
+void hashinsert (int n)
+{
+	unsigned h;
+
+	h = obj_hash (stab[n].name) & (hashsize - 1);
+	while (hashtab [h])
+		h = (h + 1) & (hashsize - 1);
+	hashtab [h] = n + 1;
+}
+
+/*
+ * Find the symbol, add it if not found.
+ */
+int lookname (wchar_t *name)
+{
+	unsigned h;
+	int i, n;
+
+	if (hashsize) {
+		h = obj_hash (name) & (hashsize - 1);
+		while ((n = hashtab [h]) != 0) {
+			if (! wcscmp (stab[n-1].name, name))
+				return n - 1;
+			h = (h + 1) & (hashsize - 1);
+		}
+	}
+	if (stabfree >= stabsize) {
+		stabsize = stabsize ? stabsize * 2 : 1024;
+		stab = realloc (stab, stabsize * sizeof (stab[0]));
+		if (! stab)
+			uerror ("мало памяти");
+	}
+	if (2 * (stabfree + 1) > hashsize) {
+		hashsize = hashsize ? hashsize * 2 : 2048;
+		free (hashtab);
+		hashtab = calloc (hashsize, sizeof (hashtab[0]));
+		if (! hashtab)
+			uerror ("мало памяти");
+		for (i=0; i<stabfree; ++i)
+			hashinsert (i);
+	}
+	stab[stabfree].name = wcsdup (name);
+	if (! stab[stabfree].name)
+		uerror ("мало памяти");
+	stab[stabfree].type = TUNDF;
+	stab[stabfree].value = 0;
+	stab[stabfree].ovl = 0;
+	hashinsert (stabfree);
+	return stabfree++;
+}
+
+/*
+ * Find the literal in the pool, add it if not found.
+ */
+int lookliteral (uint64_t val)
+{
+	unsigned h;
+	int i, n;
+
+	if (2 * (nlit + 1) > lithashsize) {
+		lithashsize = lithashsize ? lithashsize * 2 : 256;
+		free (lithash);
+		lithash = calloc (lithashsize, sizeof (lithash[0]));
+		if (! lithash)
+			uerror ("мало памяти");
+		for (i=0; i<nlit; ++i) {
+			h = LITHASH (littab[i].val) & (lithashsize - 1);
+			while (lithash [h])
+				h = (h + 1) & (lithashsize - 1);
+			lithash [h] = i + 1;
+		}
+	}
+	h = LITHASH (val) & (lithashsize - 1);
+	while ((n = lithash [h]) != 0) {
+		if (littab[n-1].val == val)
+			return n - 1;
+		h = (h + 1) & (lithashsize - 1);
+	}
+	if (nlit >= litsize) {
+		litsize = litsize ? litsize * 2 : 256;
+		littab = realloc (littab, litsize * sizeof (littab[0]));
+		if (! littab)
+			uerror ("мало памяти");
+	}
+	littab[nlit].val = val;
+	littab[nlit].addr = 0;
+	lithash [h] = nlit + 1;
+	return nlit++;
+}
+
+/*
+ * Add the value to the address fields of the word.
+ */
+void addfield (int addr, int flags, int v)
+{
+	int f;
+
+	for (f=RA1; f<=RA3; f<<=1) {
+		if (! (flags & f))
+			continue;
+		switch (f) {
+		case RA1:
+			v += ram [addr] >> 24 & 07777;
+			ram [addr] &= ~0777700000000LL;
+			ram [addr] |= (uint64_t) (v & 07777) << 24;
+			break;
+		case RA2:
+			v += ram [addr] >> 12 & 07777;
+			ram [addr] &= ~077770000LL;
+			ram [addr] |= (uint64_t) (v & 07777) << 12;
+			break;
+		case RA3:
+			v += ram [addr] & 07777;
+			ram [addr] &= ~07777LL;
+			ram [addr] |= v & 07777;
+			break;
+		}
+	}
+}
+
+void addreloc (int addr, int sym, int flags)
+{
+	if (nrel >= relsize) {
+		relsize = relsize ? relsize * 2 : 1024;
+		reltab = realloc (reltab, relsize * sizeof (reltab[0]));
+		if (! reltab)
+			uerror ("мало памяти");
+	}
+	reltab[nrel].addr = addr;
+	reltab[nrel].sym = sym;
+	reltab[nrel].flags = flags;
+	++nrel;
+}
+
+/*
+ * Find the overlay by name, add it if not found.
+ */
+int lookovl (wchar_t *name)
+{
+	wchar_t buf [256];
+	int k;
+
+	for (k=1; k<=novl; ++k)
+		if (! wcscmp (ovltab[k].name, name))
+			return k;
+	if (novl >= MAXOVL)
+		uerror ("слишком много оверлеев");
+	k = ++novl;
+	ovltab[k].name = wcsdup (name);
+	if (! ovltab[k].name)
+		uerror ("мало памяти");
+
+	/* Символ начала оверлея: к нему привязаны адреса
+	 * внутри оверлея, пока не известно место области. */
+	buf[0] = L'<';
+	wcsncpy (buf+1, name, 250);
+	buf[251] = 0;
+	wcscat (buf, L">");
+	ovltab[k].sym = lookname (buf);
+	stab[ovltab[k].sym].type = TTEXT;
+	stab[ovltab[k].sym].ovl = k;
+	return k;
+}
+
+/*
+ * Place the module at the current address.
+ * A module of an overlay is placed at the end of that overlay.
+ */
+void loadmodule (OBJMOD *m)
+{
+	int i, n, base, addr, ovl, vbase;
+
+	ovl = m->overlay ? lookovl (m->overlay) : 0;
+	base = ovl ? ovltab[ovl].size : count;
+	vbase = ovl * DATSIZE;
+	if (debug)
+		fprintf (stderr, "модуль %s: %04o-%04o\n", m->name,
+			base, base + m->size - 1);
+	if (base + m->size > DATSIZE)
+		uerror ("%s: недостаточно памяти, нужно %d слов",
+			m->name, base + m->size);
+	srcfile = realloc (srcfile, (nfiles + m->nfiles) * sizeof (char*));
+	if (! srcfile)
+		uerror ("мало памяти");
+	for (i=0; i<m->nfiles; ++i)
+		srcfile [nfiles + i] = strdup (m->file[i]);
+	if (! title && m->nfiles > 0)
+		title = srcfile [nfiles];
+
+	for (i=0; i<m->nwords; ++i) {
+		addr = vbase + base + m->word[i].addr;
+		ram [addr] = m->word[i].val;
+		ram_dirty [addr] = 1;
+		ram_line [addr] = m->word[i].line;
+		ram_file [addr] = nfiles + m->word[i].file;
+	}
+	for (i=0; i<m->nsym; ++i) {
+		n = lookname (m->sym[i].name);
+		if (stab[n].type != TUNDF)
+			nerror ("имя определено дважды", stab[n].name);
+		stab[n].type = m->sym[i].type;
+		stab[n].value = m->sym[i].value;
+		if (m->sym[i].type == TTEXT) {
+			stab[n].value += base;
+			stab[n].ovl = ovl;
+		}
+	}
+	for (i=0; i<m->nrel; ++i) {
+		addr = vbase + base + m->rel[i].addr;
+		if (m->rel[i].flags & RLIT)
+			addreloc (addr, lookliteral (m->rel[i].lit),
+				m->rel[i].flags);
+		else if (m->rel[i].name)
+			addreloc (addr, lookname (m->rel[i].name),
+				m->rel[i].flags);
+		else {
+			addfield (addr, m->rel[i].flags, base);
+			if (ovl)
+				addreloc (addr, ovltab[ovl].sym,
+					m->rel[i].flags);
+		}
+	}
+	if (ovl)
+		ovltab[ovl].size = base + m->size;
+	else
+		count = base + m->size;
+	nfiles += m->nfiles;
+}
+
+/*
+ * Take modules from libraries for undefined names.
+ * Names needed by these modules are appended to the table
+ * and resolved in the same pass.
+ */
+void libraries ()
+{
+	int i, n, m, undefined;
+	OBJMOD *mod;
+
+	undefined = 0;
+	for (i=0; i<stabfree; ++i) {
+		if (stab[i].type != TUNDF)
+			continue;
+		for (n=0; n<nlib; ++n) {
+			m = obj_libfind (libtab[n], stab[i].name);
+			if (m < 0 || libtab[n]->loaded [m])
+				continue;
+			mod = obj_libload (libtab[n], m);
+			if (mod->overlay)
+				uerror ("%s: оверлей в библиотеке", mod->name);
+			loadmodule (mod);
+			obj_free (mod);
+			break;
+		}
+		if (n >= nlib) {
+			fprintf (stderr, "ld: неопределено: ");
+			wchar_puts (stab[i].name, stderr);
+			fprintf (stderr, "\n");
+			++undefined;
+		}
+	}
+	if (undefined > 0) {
+		fprintf (stderr, "ld: останов\n");
+		unlink (outfile);
+		exit (1);
+	}
+}
+
+/*
+ * Place the literal pool after the modules.
+ */
+void literals ()
+{
+	int n;
+
+	for (n=0; n<nlit; ++n) {
+		if (count >= DATSIZE)
+			uerror ("недостаточно памяти для литералов");
+		littab[n].addr = count;
+		ram [count] = littab[n].val;
+		ram_dirty [count] = 1;
+		ram_line [count] = 0;
+		++count;
+	}
+}
+
+/*
+ * Resolve the references.
+ */
+void relocate ()
+{
+	struct reltab *r;
+
+	for (r=reltab; r<reltab+nrel; ++r) {
+		if (r->flags & RLIT)
+			addfield (r->addr, r->flags, littab[r->sym].addr);
+		else
+			addfield (r->addr, r->flags, stab[r->sym].value);
+	}
+}
+
+/*
+ * Instructions with a jump address in the second field.
+ */
+int isjump (int op)
+{
+	switch (op) {
+	case 016: case 036: case 056: case 076:
+	case 011: case 031: case 051: case 071:
+	case 012: case 032:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Reference of the given kind from the word at addr.
+ */
+struct xref *findxref (int addr, int call)
+{
+	struct xref *x;
+
+	for (x=xref; x<xref+nxref; ++x)
+		if (x->addr == addr && x->call == call)
+			return x;
+	return 0;
+}
+
+/*
+ * Earlier jump to the same label and offset, whose stub is shared.
+ */
+struct xref *findstub (struct xref *y)
+{
+	struct xref *x;
+
+	for (x=xref; x<y; ++x)
+		if (! x->call && x->sym == y->sym && x->off == y->off)
+			return x;
+	return 0;
+}
+
+/*
+ * Place the word in the resident part.
+ */
+void putword (int addr, int op, int a1, int a2, int a3)
+{
+	ram [addr] = (uint64_t) op << 36 | (uint64_t) a1 << 24 |
+		a2 << 12 | a3;
+	ram_dirty [addr] = 1;
+	ram_line [addr] = 0;
+}
+
+/*
+ * Find references between overlays and lay out memory:
+ * the dispatcher, the loaders and the stubs go after the
+ * resident modules, the overlay area - after them.
+ * Вызов из оверлея в резидентную часть тоже идёт через
+ * заглушку: вызванная подпрограмма может сменить оверлей,
+ * и при возврате его надо загрузить снова.
+ */
+void overlays ()
+{
+	struct reltab *r;
+	struct xref *x;
+	int i, j, k, op, size, ovlmax, drum;
+
+	for (r=reltab; r<reltab+nrel; ++r) {
+		if (r->flags & RLIT)
+			continue;
+		j = r->addr / DATSIZE;
+		k = stab[r->sym].ovl;
+		op = ram [r->addr] >> 36 & 077;
+		if (j == k || ! (r->flags & RA2) || ! isjump (op))
+			continue;
+		if (op != 016 && ! k)
+			continue;
+		if (ram [r->addr] >> 42)
+			nerror ("переход в оверлей с модификацией адреса",
+				stab[r->sym].name);
+		if (findxref (r->addr, op == 016))
+			continue;
+		if (nxref >= xrefsize) {
+			xrefsize = xrefsize ? xrefsize * 2 : 64;
+			xref = realloc (xref, xrefsize * sizeof (xref[0]));
+			if (! xref)
+				uerror ("мало памяти");
+		}
+		xref[nxref].addr = r->addr;
+		xref[nxref].sym = r->sym;
+		xref[nxref].off = ram [r->addr] >> 12 & 07777;
+		xref[nxref].call = (op == 016);
+		if (op == 016 && j)
+			ovltab[j].calls++;
+		++nxref;
+	}
+
+	/* Остальные обращения к чужому оверлею недопустимы.
+	 * Оверлей читается с барабана заново, и его ячейки
+	 * не сохраняются. Поэтому ячейка возврата пв должна быть
+	 * резидентной, или в вызываемом оверлее, если тот сам
+	 * не вызывает ничего за своими пределами. */
+	for (r=reltab; r<reltab+nrel; ++r) {
+		if (r->flags & RLIT)
+			continue;
+		j = r->addr / DATSIZE;
+		k = stab[r->sym].ovl;
+		x = findxref (r->addr, 1);
+		if (x && (r->flags & RA3) && k &&
+		    (k != stab[x->sym].ovl || ovltab[k].calls))
+			nerror ("ячейка возврата в оверлее",
+				stab[r->sym].name);
+		if (j == k || ! k)
+			continue;
+		if (x && (r->sym == x->sym || r->flags == RA3))
+			continue;
+		op = ram [r->addr] >> 36 & 077;
+		if (r->flags == RA2 && isjump (op) && findxref (r->addr, 0))
+			continue;
+		nerror ("обращение к оверлею не переходом",
+			stab[r->sym].name);
+	}
+
+	/* Диспетчер и загрузчики. */
+	ovlcur = count++;
+	ovlret = count++;
+	putword (ovlcur, 0, 0, 0, 0);
+	putword (ovlret, 0, 0, 0, 0);
+	i = lookname (L"<оверлеи>");
+	stab[i].type = TTEXT;
+	stab[i].value = ovlcur;
+	for (k=1; k<=novl; ++k) {
+		ovltab[k].loader = count;
+		count += LOADSIZE;
+	}
+
+	/* Заглушки: вызов из резидентной части - 2 слова,
+	 * из оверлея - 4 слова, из оверлея в резидентную часть -
+	 * 3 слова; переход - 2 слова на каждую метку со смещением. */
+	for (x=xref; x<xref+nxref; ++x) {
+		j = x->addr / DATSIZE;
+		if (! x->call && findstub (x)) {
+			x->stub = findstub (x)->stub;
+			continue;
+		}
+		x->stub = count;
+		if (! x->call)
+			size = 2;
+		else if (! stab[x->sym].ovl)
+			size = 3;
+		else
+			size = j ? 4 : 2;
+		count += size;
+	}
+	if (count > DATSIZE)
+		uerror ("недостаточно памяти для заглушек оверлеев");
+
+	literals ();
+	ovlbase = count;
+	ovlmax = 0;
+	drum = drumbase;
+	for (k=1; k<=novl; ++k) {
+		if (ovltab[k].size > ovlmax)
+			ovlmax = ovltab[k].size;
+		ovltab[k].drum = drum;
+		drum += ovltab[k].size + 1;
+	}
+	if (ovlbase + ovlmax > DATSIZE)
+		uerror ("оверлеи не помещаются в память, нужно %d слов",
+			ovlbase + ovlmax);
+	if (drum > DRUMSIZE)
+		uerror ("оверлеи не помещаются на барабан");
+	count = ovlbase + ovlmax;
+
+	for (i=0; i<stabfree; ++i)
+		if (stab[i].ovl && ! wcscmp (stab[i].name, L"начало"))
+			uerror ("начало программы в оверлее");
+
+	/* Метки оверлеев - в общей области. */
+	for (i=0; i<stabfree; ++i)
+		if (stab[i].ovl)
+			stab[i].value += ovlbase;
+}
+
+/*
+ * Generate the loaders and the stubs, redirect
+ * the references to the stubs.
+ * Загрузчик оверлея k: если он уже в памяти - сразу возврат,
+ * иначе чтение с барабана в общую область.
+ */
+void linkovl ()
+{
+	struct xref *x;
+	int j, k, a, ret, target, cell;
+	uint64_t w;
+
+	for (k=1; k<=novl; ++k) {
+		a = ovltab[k].loader;
+		putword (a,   015, ovlcur, a+6, 0);
+		putword (a+1, 036, 0, ovlret, 0);
+		putword (a+2, 050, EXT_DRUM | (ovltab[k].drum >> 12 & 3),
+			ovltab[k].drum & 07777, ovlbase + ovltab[k].size - 1);
+		putword (a+3, 070, ovlbase, 0, 0);
+		putword (a+4, 000, a+6, 0, ovlcur);
+		putword (a+5, 056, 0, ovlret, 0);
+		putword (a+6, 0, 0, 0, k);
+	}
+	for (x=xref; x<xref+nxref; ++x) {
+		a = x->stub;
+		j = x->addr / DATSIZE;
+		k = stab[x->sym].ovl;
+		w = ram [x->addr];
+		target = w >> 12 & 07777;
+		if (! x->call) {
+			/* Общая заглушка перезаписывается теми же словами. */
+			putword (a, 016, a+1, ovltab[k].loader, ovlret);
+			putword (a+1, 056, 0, target, 0);
+			ram [x->addr] = (w & ~077770000LL) | a << 12;
+			continue;
+		}
+		ret = w >> 24 & 07777;
+		cell = w & 07777;
+		if (k) {
+			putword (a, 016, a+1, ovltab[k].loader, ovlret);
+			++a;
+		}
+		if (j) {
+			putword (a, 016, a+1, target, cell);
+			putword (a+1, 016, a+2, ovltab[j].loader, ovlret);
+			putword (a+2, 056, 0, ret, 0);
+		} else
+			putword (a, 016, ret, target, cell);
+		ram [x->addr] = 056LL << 36 | (uint64_t) x->stub << 12;
+	}
+}
+/*
+ * Checksum of a drum array, as computed by the drum controller.
+ */
+uint64_t checksum (uint64_t x, uint64_t y)
+{
+	uint64_t sum;
+
+	sum = (x & ~MANTISSA) + (y & ~MANTISSA);
+	if (sum & BIT46)
+		sum += BIT37;
+	y = (x & MANTISSA) + (y & MANTISSA);
+	if (y & BIT37)
+		y += 1;
+	return (sum & ~MANTISSA) | (y & MANTISSA);
+}
+
+/*
+ * Write the overlays to the drum image: words of each overlay
+ * are followed by the checksum. A word takes 8 bytes, low byte first.
+ */
+void writedrum (char *path)
+{
+	FILE *fd;
+	uint64_t w, sum;
+	int k, i, n;
+
+	fd = fopen (path, "w");
+	if (! fd)
+		uerror ("не могу открыть %s", path);
+	for (k=1; k<=novl; ++k) {
+		fseek (fd, ovltab[k].drum * 8L, SEEK_SET);
+		sum = 0;
+		for (i=0; i<=ovltab[k].size; ++i) {
+			if (i < ovltab[k].size) {
+				w = ram [k*DATSIZE + i];
+				sum = checksum (sum, w);
+			} else
+				w = sum;
+			for (n=0; n<8; ++n)
+				putc ((int) (w >> (n*8) & 0xff), fd);
+		}
+	}
+	if (ferror (fd) || fclose (fd) != 0)
+		uerror ("ошибка записи %s", path);
+}
+
+/*
+ * Report the overlays and the drum traffic of each path
+ * between them: how many words are read from the drum,
+ * if the needed overlay is not in memory.
+ */
+void ovlreport ()
+{
+	struct xref *x;
+	int j, k, n;
+
+	fprintf (stderr, "Область оверлеев %04o-%04o\n",
+		ovlbase, count - 1);
+	for (k=1; k<=novl; ++k) {
+		fprintf (stderr, "Оверлей ");
+		obj_putname (ovltab[k].name, stderr);
+		fprintf (stderr, ": %d слов, барабан %05o, загрузчик %04o\n",
+			ovltab[k].size, ovltab[k].drum, ovltab[k].loader);
+	}
+	for (x=xref; x<xref+nxref; ++x) {
+		j = x->addr / DATSIZE;
+		k = stab[x->sym].ovl;
+		n = k ? ovltab[k].size : 0;
+		if (x->call && j)
+			n += ovltab[j].size;
+		fprintf (stderr, "%s %04o ", x->call ? "Вызов" : "Переход",
+			x->addr % DATSIZE + (j ? ovlbase : 0));
+		if (j) {
+			fprintf (stderr, "(");
+			obj_putname (ovltab[j].name, stderr);
+			fprintf (stderr, ") ");
+		}
+		fprintf (stderr, "-> ");
+		obj_putname (stab[x->sym].name, stderr);
+		if (! x->call && x->off)
+			fprintf (stderr, "+%o", x->off);
+		fprintf (stderr, ": до %d слов с барабана\n", n);
+	}
+}
+
+int compare_stab (const void *pa, const void *pb)
+{
+	const struct stab *a = pa, *b = pb;
+
+	if (a->value < b->value)
+		return -1;
+	return (a->value > b->value);
+}
+
+/*
+ * Write the program, in the same format as as20.
+ */
+void output ()
+{
+	int i, last_addr = -1;
+	int tsize;
+	uint64_t cmd;
+	struct stab *s;
+
+	utf8_puts ("; ", stdout);
+	printf ("%s\n", title ? title : outfile);
+	tsize = 0;
+	for (i=0; i<DATSIZE; ++i) {
+		if (! ram_dirty [i])
+			continue;
+		if (i != last_addr+1)
+			printf ("\n:%04o\n", i);
+		last_addr = i;
+		cmd = ram[i];
+		printf ("%o %02o %04o %04o %04o\n", (int) (cmd >> 42),
+			(int) (cmd >> 36 & 077), (int) (cmd >> 24 & 07777),
+			(int) (cmd >> 12 & 07777), (int) (cmd & 07777));
+		++tsize;
+	}
+
+	/*
+	 * Адрес начала.
+	 */
+	for (i=0; i<stabfree; ++i) {
+		if (! wcscmp (stab[i].name, L"начало")) {
+			printf ("\n@%04o\n", stab[i].value);
+			break;
+		}
+	}
+
+	/*
+	 * Таблица символов.
+	 */
+	printf ("\n; Таблица символов\n");
+	qsort (stab, stabfree, sizeof (stab[0]), compare_stab);
+	for (s=stab; s<stab+stabfree; ++s) {
+		printf ("; %04o  %c  ", s->value, s->type == TTEXT ? 'T' : 'A');
+		wchar_puts (s->name, stdout);
+		printf ("\n");
+	}
+	for (i=DATSIZE-1; i>0; --i)
+		if (ram_dirty [i])
+			break;
+	printf ("; %04o  T  <конец>\n", i);
+
+	/*
+	 * Таблица строк исходного текста.
+	 */
+	printf ("\n; Таблица строк\n");
+	for (i=0; i<nfiles; ++i)
+		printf ("; файл %d  %s\n", i, srcfile[i]);
+	for (i=0; i<DATSIZE; ++i)
+		if (ram_dirty [i] && ram_line [i])
+			printf ("; %04o  %d  %d\n", i, ram_file [i], ram_line [i]);
+
+	fprintf (stderr, "Занято %d слов памяти\n", tsize);
+	fprintf (stderr, "Свободно %d слов\n", DATSIZE - count);
+}
+
+void addlib (char *name)
+{
+	if (nlib >= MAXLIBS)
+		uerror ("слишком много библиотек");
+	libtab [nlib] = obj_libopen (name);
+	if (! libtab [nlib])
+		uerror ("%s: не библиотека", name);
+	++nlib;
+}
+
+void usage ()
+{
+	printf ("Редактор связей М-20\n");
+	printf ("Вызов:\n");
+	printf ("\tld20 [-d] [-o outfile.m20] [-b адрес] [-l lib.a20] file.o20 ...\n");
+	printf ("Ключи:\n");
+	printf ("\t-b адрес\t- начало оверлеев на барабане, восьмеричное\n");
+	printf ("\t\t\t  (по умолчанию 20000); образ барабана -\n");
+	printf ("\t\t\t  в файле outfile.drum\n\n");
+	exit (-1);
+}
+
+int main (int argc, char **argv)
+{
+	char **input, *cp;
+	int ninput, i;
+	FILE *fd;
+	OBJMOD *m;
+
+	input = malloc (argc * sizeof (char*));
+	if (! input)
+		uerror ("мало памяти");
+	ninput = 0;
+	for (i=1; i<argc; i++) {
+		if (argv[i][0] != '-') {
+			input [ninput++] = argv[i];
+			continue;
+		}
+		for (cp=argv[i]+1; *cp; cp++) switch (*cp) {
+		case 'd':
+			debug++;
+			break;
+		case 'o':
+			if (cp [1]) {
+				/* -ofile */
+				outfile = cp+1;
+				while (*++cp);
+				--cp;
+			} else if (i+1 < argc)
+				/* -o file */
+				outfile = argv[++i];
+			break;
+		case 'b':
+			if (cp [1]) {
+				/* -b20000 */
+				drumbase = strtol (cp+1, 0, 8);
+				while (*++cp);
+				--cp;
+			} else if (i+1 < argc)
+				/* -b 20000 */
+				drumbase = strtol (argv[++i], 0, 8);
+			if (drumbase < 0 || drumbase >= DRUMSIZE)
+				uerror ("неверный адрес на барабане");
+			break;
+		case 'l':
+			if (cp [1]) {
+				/* -llib.a20 */
+				addlib (cp+1);
+				while (*++cp);
+				--cp;
+			} else if (i+1 < argc)
+				/* -l lib.a20 */
+				addlib (argv[++i]);
+			break;
+		default:
+			usage ();
+		}
+	}
+	if (ninput == 0)
+		usage ();
+	if (! outfile) {
+		outfile = malloc (4 + strlen (input[0]));
+		if (! outfile)
+			uerror ("мало памяти");
+		strcpy (outfile, input[0]);
+		cp = strrchr (outfile, '.');
+		if (! cp)
+			cp = outfile + strlen (outfile);
+		strcpy (cp, ".m20");
+	}
+
+	for (i=0; i<ninput; ++i) {
+		fd = fopen (input[i], "r");
+		if (! fd)
+			uerror ("не могу открыть %s", input[i]);
+		m = obj_read (fd, input[i]);
+		fclose (fd);
+		loadmodule (m);
+		obj_free (m);
+	}
+	libraries ();
+	if (novl)
+		overlays ();
+	else
+		literals ();
+	relocate ();
+	if (novl) {
+		linkovl ();
+		drumfile = malloc (6 + strlen (outfile));
+		if (! drumfile)
+			uerror ("мало памяти");
+		strcpy (drumfile, outfile);
+		cp = strrchr (drumfile, '.');
+		if (! cp)
+			cp = drumfile + strlen (drumfile);
+		strcpy (cp, ".drum");
+		writedrum (drumfile);
+		ovlreport ();
+	}
+	if (! freopen (outfile, "w", stdout))
+		uerror ("не могу открыть %s", outfile);
+	output ();
+	return 0;
+}
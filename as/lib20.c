@@ -0,0 +1,91 @@
+/*
+ * Librarian for M-20 assembler: archives of relocatable modules.
+ * Copyright (GPL) 2008 Сергей Вакуленко <serge.vakulenko@gmail.com>
+ *
+ * Библиотека содержит модули, собранные as20 -c, и каталог
+ * глобальных имён: as20 и ld20 находят в нём модуль для
+ * неопределённого имени одним поиском в хэш-таблице.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include "config.h"
+#include "ieee.h"
+#include "obj.h"
+
+char *outfile;
+
+void uerror (char *s, ...)
+{
+	va_list ap;
+
+	va_start (ap, s);
+	fprintf (stderr, "lib20: ");
+	vfprintf (stderr, s, ap);
+	va_end (ap);
+	fprintf (stderr, "\n");
+	if (outfile)
+		unlink (outfile);
+	exit (1);
+}
+
+/*
+ * Список модулей и каталога имён.
+ */
+int list (char *path)
+{
+	OBJLIB *lib;
+	unsigned h;
+	int i;
+
+	lib = obj_libopen (path);
+	if (! lib)
+		uerror ("%s: не библиотека", path);
+	for (i=0; i<lib->nmod; ++i) {
+		printf ("%s:\n", lib->modname[i]);
+		for (h=0; h<lib->dirsize; ++h) {
+			if (! lib->dirname[h] || lib->dirmod[h] != i)
+				continue;
+			printf ("\t");
+			obj_putname (lib->dirname[h], stdout);
+			printf ("\n");
+		}
+	}
+	obj_libclose (lib);
+	return 0;
+}
+
+int main (int argc, char **argv)
+{
+	OBJMOD **mod;
+	FILE *fd;
+	int i;
+
+	if (argc == 3 && strcmp (argv[1], "-t") == 0)
+		return list (argv[2]);
+	if (argc < 2 || argv[1][0] == '-') {
+		printf ("Библиотекарь М-20\n");
+		printf ("Вызов:\n");
+		printf ("\tlib20 lib.a20 module.o20 ...\t- создать библиотеку\n");
+		printf ("\tlib20 -t lib.a20\t\t- список модулей и имён\n\n");
+		return -1;
+	}
+	mod = malloc (argc * sizeof (OBJMOD*));
+	if (! mod)
+		uerror ("мало памяти");
+	for (i=2; i<argc; ++i) {
+		fd = fopen (argv[i], "r");
+		if (! fd)
+			uerror ("не могу открыть %s", argv[i]);
+		mod [i-2] = obj_read (fd, argv[i]);
+		fclose (fd);
+	}
+	outfile = argv[1];
+	if (obj_libwrite (argv[1], mod, argc - 2) < 0) {
+		unlink (argv[1]);
+		return 1;
+	}
+	return 0;
+}
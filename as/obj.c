@@ -0,0 +1,460 @@
+/*
+ * Ассемблер М-20: чтение и запись перемещаемых модулей и библиотек.
+ * Copyright (GPL) 2008 Сергей Вакуленко <serge.vakulenko@gmail.com>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "config.h"
+#include "ieee.h"
+#include "obj.h"
+
+#define MAXLINE		1024	/* макс. длина строки модуля */
+
+extern void uerror (char *s, ...);
+
+/*
+ * Хэш имени (FNV-1a).
+ */
+unsigned obj_hash (const wchar_t *name)
+{
+	unsigned h = 2166136261u;
+
+	while (*name)
+		h = (h ^ *name++) * 16777619u;
+	return h;
+}
+
+/*
+ * Запись имени в кодировке UTF-8.
+ */
+void obj_putname (const wchar_t *name, FILE *fd)
+{
+	unsigned c;
+
+	for (; *name; ++name) {
+		c = *name;
+		if (c < 0x80) {
+			putc (c, fd);
+		} else if (c < 0x800) {
+			putc (c >> 6 | 0xc0, fd);
+			putc ((c & 0x3f) | 0x80, fd);
+		} else {
+			putc (c >> 12 | 0xe0, fd);
+			putc ((c >> 6 & 0x3f) | 0x80, fd);
+			putc ((c & 0x3f) | 0x80, fd);
+		}
+	}
+}
+
+/*
+ * Чтение имени в кодировке UTF-8 до пробела или конца строки.
+ */
+static wchar_t *getname (const char *p)
+{
+	wchar_t buf [256], *w, *name;
+	const unsigned char *s = (const unsigned char*) p;
+
+	while (*s == ' ')
+		++s;
+	for (w=buf; *s > ' ' && w < buf+255; ++w) {
+		if (! (*s & 0x80)) {
+			*w = *s++;
+		} else if (! (*s & 0x20)) {
+			*w = (s[0] & 0x1f) << 6 | (s[1] & 0x3f);
+			s += 2;
+		} else {
+			*w = (s[0] & 0x0f) << 12 | (s[1] & 0x3f) << 6 |
+				(s[2] & 0x3f);
+			s += 3;
+		}
+	}
+	*w = 0;
+	name = malloc ((w - buf + 1) * sizeof (wchar_t));
+	if (! name)
+		uerror ("мало памяти");
+	wcscpy (name, buf);
+	return name;
+}
+
+/*
+ * Поле после n-го пробела.
+ */
+static char *field (char *p, int n)
+{
+	while (n-- > 0) {
+		p = strchr (p, ' ');
+		if (! p)
+			return "";
+		while (*p == ' ')
+			++p;
+	}
+	return p;
+}
+
+static void *alloc (int n, int size)
+{
+	void *p = calloc (n ? n : 1, size);
+
+	if (! p)
+		uerror ("мало памяти");
+	return p;
+}
+
+/*
+ * Чтение модуля с текущей позиции файла.
+ */
+OBJMOD *obj_read (FILE *fd, const char *name)
+{
+	char line [MAXLINE], *p;
+	OBJMOD *m;
+	int nw = 0, nf = 0, nr = 0, ns = 0;
+	int addr, flags, f, op, a1, a2, a3, file, lnum, value;
+	char type;
+
+	m = alloc (1, sizeof (OBJMOD));
+	m->name = strdup (name);
+	if (! fgets (line, sizeof (line), fd) ||
+	    sscanf (line, "M20OBJ %d %d %d %d %d", &m->size, &m->nwords,
+	    &m->nfiles, &m->nrel, &m->nsym) != 5)
+		uerror ("%s: неверный формат модуля", name);
+	m->word = alloc (m->nwords, sizeof (OBJWORD));
+	m->file = alloc (m->nfiles, sizeof (char*));
+	m->rel = alloc (m->nrel, sizeof (OBJREL));
+	m->sym = alloc (m->nsym, sizeof (OBJSYM));
+
+	while (fgets (line, sizeof (line), fd)) {
+		p = strchr (line, '\n');
+		if (p)
+			*p = 0;
+		switch (line[0]) {
+		case 'F':
+			if (nf >= m->nfiles)
+				goto bad;
+			m->file [nf++] = strdup (field (line, 1));
+			continue;
+		case 'V':
+			m->overlay = getname (field (line, 1));
+			continue;
+		case 'W':
+			if (nw >= m->nwords || sscanf (line+1,
+			    "%o %o %o %o %o %o %d %d", &addr, &flags, &op,
+			    &a1, &a2, &a3, &file, &lnum) != 8)
+				goto bad;
+			m->word[nw].addr = addr;
+			m->word[nw].val = (uint64_t) flags << 42 |
+				(uint64_t) op << 36 | (uint64_t) a1 << 24 |
+				a2 << 12 | a3;
+			m->word[nw].file = file;
+			m->word[nw].line = lnum;
+			++nw;
+			continue;
+		case 'R':
+		case 'X':
+			if (nr >= m->nrel ||
+			    sscanf (line+1, "%o %d", &addr, &flags) != 2)
+				goto bad;
+			m->rel[nr].addr = addr;
+			m->rel[nr].flags = flags;
+			if (line[0] == 'X')
+				m->rel[nr].name = getname (field (line, 3));
+			++nr;
+			continue;
+		case 'L':
+			if (nr >= m->nrel || sscanf (line+1,
+			    "%o %d %o %o %o %o %o", &addr, &flags, &f,
+			    &op, &a1, &a2, &a3) != 7)
+				goto bad;
+			m->rel[nr].addr = addr;
+			m->rel[nr].flags = flags | RLIT;
+			m->rel[nr].lit = (uint64_t) f << 42 |
+				(uint64_t) op << 36 | (uint64_t) a1 << 24 |
+				a2 << 12 | a3;
+			++nr;
+			continue;
+		case 'G':
+			if (ns >= m->nsym ||
+			    sscanf (line+1, "%d %c", &value, &type) != 2)
+				goto bad;
+			m->sym[ns].value = value;
+			m->sym[ns].type = (type == 'T') ? TTEXT : TABS;
+			m->sym[ns].name = getname (field (line, 3));
+			++ns;
+			continue;
+		case 'E':
+			if (nw != m->nwords || nf != m->nfiles ||
+			    nr != m->nrel || ns != m->nsym)
+				goto bad;
+			return m;
+		default:
+			goto bad;
+		}
+	}
+bad:	uerror ("%s: неверный формат модуля", name);
+	return 0;
+}
+
+/*
+ * Запись модуля.
+ */
+void obj_write (OBJMOD *m, FILE *fd)
+{
+	int i;
+	uint64_t v;
+
+	fprintf (fd, "M20OBJ %d %d %d %d %d\n", m->size, m->nwords,
+		m->nfiles, m->nrel, m->nsym);
+	for (i=0; i<m->nfiles; ++i)
+		fprintf (fd, "F %s\n", m->file[i]);
+	if (m->overlay) {
+		fprintf (fd, "V ");
+		obj_putname (m->overlay, fd);
+		putc ('\n', fd);
+	}
+	for (i=0; i<m->nwords; ++i) {
+		v = m->word[i].val;
+		fprintf (fd, "W %04o %o %02o %04o %04o %04o %d %d\n",
+			m->word[i].addr, (int) (v >> 42), (int) (v >> 36 & 077),
+			(int) (v >> 24 & 07777), (int) (v >> 12 & 07777),
+			(int) (v & 07777), m->word[i].file, m->word[i].line);
+	}
+	for (i=0; i<m->nrel; ++i) {
+		if (m->rel[i].flags & RLIT) {
+			v = m->rel[i].lit;
+			fprintf (fd, "L %04o %d %o %02o %04o %04o %04o\n",
+				m->rel[i].addr, m->rel[i].flags & ~RLIT,
+				(int) (v >> 42), (int) (v >> 36 & 077),
+				(int) (v >> 24 & 07777),
+				(int) (v >> 12 & 07777), (int) (v & 07777));
+		} else if (m->rel[i].name) {
+			fprintf (fd, "X %04o %d ", m->rel[i].addr,
+				m->rel[i].flags);
+			obj_putname (m->rel[i].name, fd);
+			putc ('\n', fd);
+		} else
+			fprintf (fd, "R %04o %d\n", m->rel[i].addr,
+				m->rel[i].flags);
+	}
+	for (i=0; i<m->nsym; ++i) {
+		fprintf (fd, "G %d %c ", m->sym[i].value,
+			m->sym[i].type == TTEXT ? 'T' : 'A');
+		obj_putname (m->sym[i].name, fd);
+		putc ('\n', fd);
+	}
+	fprintf (fd, "E\n");
+}
+
+void obj_free (OBJMOD *m)
+{
+	int i;
+
+	for (i=0; i<m->nfiles; ++i)
+		free (m->file[i]);
+	for (i=0; i<m->nrel; ++i)
+		free (m->rel[i].name);
+	for (i=0; i<m->nsym; ++i)
+		free (m->sym[i].name);
+	free (m->word);
+	free (m->file);
+	free (m->rel);
+	free (m->sym);
+	free (m->name);
+	free (m->overlay);
+	free (m);
+}
+
+/*
+ * Создание библиотеки из модулей.
+ * Возвращает 0, или -1, если имя определено в двух модулях
+ * (сообщение уже выдано).
+ */
+int obj_libwrite (const char *path, OBJMOD **mod, int nmod)
+{
+	FILE *fd, *tmp;
+	long *offset;
+	int *dirmod, i, j, c, nsym;
+	OBJSYM **dirsym;
+	unsigned dirsize, h;
+	const char *base;
+
+	nsym = 0;
+	for (i=0; i<nmod; ++i)
+		nsym += mod[i]->nsym;
+	for (dirsize=16; dirsize < 2*nsym; dirsize *= 2)
+		continue;
+	dirsym = alloc (dirsize, sizeof (OBJSYM*));
+	dirmod = alloc (dirsize, sizeof (int));
+	offset = alloc (nmod, sizeof (long));
+
+	/* Каталог. */
+	for (i=0; i<nmod; ++i) {
+		for (j=0; j<mod[i]->nsym; ++j) {
+			h = obj_hash (mod[i]->sym[j].name) & (dirsize - 1);
+			while (dirsym [h]) {
+				if (wcscmp (dirsym[h]->name,
+				    mod[i]->sym[j].name) == 0) {
+					fprintf (stderr, "%s: имя ", path);
+					obj_putname (dirsym[h]->name, stderr);
+					fprintf (stderr, " определено в %s и %s\n",
+						mod[dirmod[h]]->name, mod[i]->name);
+					return -1;
+				}
+				h = (h + 1) & (dirsize - 1);
+			}
+			dirsym [h] = &mod[i]->sym[j];
+			dirmod [h] = i;
+		}
+	}
+
+	/* Модули - во временный файл, чтобы узнать смещения. */
+	tmp = tmpfile ();
+	if (! tmp)
+		uerror ("не могу создать временный файл");
+	for (i=0; i<nmod; ++i) {
+		offset [i] = ftell (tmp);
+		obj_write (mod[i], tmp);
+	}
+
+	fd = fopen (path, "w");
+	if (! fd)
+		uerror ("не могу открыть %s", path);
+	fprintf (fd, "M20LIB %d %u\n", nmod, dirsize);
+	for (i=0; i<nmod; ++i) {
+		base = strrchr (mod[i]->name, '/');
+		base = base ? base+1 : mod[i]->name;
+		fprintf (fd, "O %ld %s\n", offset[i], base);
+	}
+	for (h=0; h<dirsize; ++h) {
+		if (! dirsym [h])
+			continue;
+		fprintf (fd, "D %u %d ", h, dirmod[h]);
+		obj_putname (dirsym[h]->name, fd);
+		putc ('\n', fd);
+	}
+	fprintf (fd, ".\n");
+	rewind (tmp);
+	while ((c = getc (tmp)) != EOF)
+		putc (c, fd);
+	fclose (tmp);
+	free (dirsym);
+	free (dirmod);
+	free (offset);
+	if (fclose (fd) != 0)
+		uerror ("ошибка записи %s", path);
+	return 0;
+}
+
+/*
+ * Открытие библиотеки и чтение каталога.
+ * Возвращает 0, если файл не библиотека.
+ */
+OBJLIB *obj_libopen (const char *path)
+{
+	char line [MAXLINE], *p;
+	OBJLIB *lib;
+	FILE *fd;
+	int nmod, n, i;
+	unsigned dirsize, h;
+	long offset;
+
+	fd = fopen (path, "r");
+	if (! fd)
+		return 0;
+	if (! fgets (line, sizeof (line), fd) ||
+	    sscanf (line, "M20LIB %d %u", &nmod, &dirsize) != 2 ||
+	    (dirsize & (dirsize - 1)) != 0) {
+		fclose (fd);
+		return 0;
+	}
+	lib = alloc (1, sizeof (OBJLIB));
+	lib->path = strdup (path);
+	lib->fd = fd;
+	lib->nmod = nmod;
+	lib->offset = alloc (nmod, sizeof (long));
+	lib->modname = alloc (nmod, sizeof (char*));
+	lib->loaded = alloc (nmod, 1);
+	lib->dirsize = dirsize;
+	lib->dirname = alloc (dirsize, sizeof (wchar_t*));
+	lib->dirmod = alloc (dirsize, sizeof (int));
+
+	i = 0;
+	while (fgets (line, sizeof (line), fd)) {
+		p = strchr (line, '\n');
+		if (p)
+			*p = 0;
+		switch (line[0]) {
+		case 'O':
+			if (i >= nmod || sscanf (line+1, "%ld", &offset) != 1)
+				goto bad;
+			lib->offset [i] = offset;
+			lib->modname [i] = strdup (field (line, 2));
+			++i;
+			continue;
+		case 'D':
+			if (sscanf (line+1, "%u %d", &h, &n) != 2 ||
+			    h >= dirsize || n < 0 || n >= nmod)
+				goto bad;
+			lib->dirname [h] = getname (field (line, 3));
+			lib->dirmod [h] = n;
+			continue;
+		case '.':
+			if (i != nmod)
+				goto bad;
+			lib->start = ftell (fd);
+			return lib;
+		default:
+			goto bad;
+		}
+	}
+bad:	uerror ("%s: неверный формат библиотеки", path);
+	return 0;
+}
+
+/*
+ * Номер модуля, определяющего имя, или -1.
+ */
+int obj_libfind (OBJLIB *lib, const wchar_t *name)
+{
+	unsigned h;
+
+	h = obj_hash (name) & (lib->dirsize - 1);
+	while (lib->dirname [h]) {
+		if (wcscmp (lib->dirname [h], name) == 0)
+			return lib->dirmod [h];
+		h = (h + 1) & (lib->dirsize - 1);
+	}
+	return -1;
+}
+
+/*
+ * Чтение n-го модуля библиотеки.
+ */
+OBJMOD *obj_libload (OBJLIB *lib, int n)
+{
+	char name [MAXLINE];
+
+	snprintf (name, sizeof (name), "%s(%s)", lib->path, lib->modname[n]);
+	if (fseek (lib->fd, lib->start + lib->offset[n], SEEK_SET) != 0)
+		uerror ("%s: ошибка чтения", name);
+	lib->loaded [n] = 1;
+	return obj_read (lib->fd, name);
+}
+
+void obj_libclose (OBJLIB *lib)
+{
+	int i;
+	unsigned h;
+
+	fclose (lib->fd);
+	for (i=0; i<lib->nmod; ++i)
+		free (lib->modname[i]);
+	for (h=0; h<lib->dirsize; ++h)
+		free (lib->dirname[h]);
+	free (lib->offset);
+	free (lib->modname);
+	free (lib->loaded);
+	free (lib->dirname);
+	free (lib->dirmod);
+	free (lib->path);
+	free (lib);
+}
@@ -0,0 +1,105 @@
+/*
+ * Ассемблер М-20: перемещаемые модули и библиотеки.
+ * Copyright (GPL) 2008 Сергей Вакуленко <serge.vakulenko@gmail.com>
+ *
+ * Модуль (файл .o20) - текстовый файл:
+ *	M20OBJ размер слов файлов перемещений символов
+ *	F имя				- исходный файл
+ *	V имя				- модуль входит в оверлей
+ *	W адрес п оп а1 а2 а3 файл строка - слово (восьмеричные поля)
+ *	R адрес поля			- прибавить к полям адрес модуля
+ *	X адрес поля имя		- прибавить к полям значение имени
+ *	L адрес поля п оп а1 а2 а3	- прибавить к полям адрес литерала,
+ *					  значение как у W
+ *	G значение тип имя		- глобальное имя, тип T или A,
+ *					  значение десятичное
+ *	E
+ * Адреса слов отсчитываются от начала модуля. Поля - сумма
+ * RA1, RA2, RA3, как в таблице перемещений as20.
+ *
+ * Библиотека (файл .a20):
+ *	M20LIB модулей размер_каталога
+ *	O смещение имя			- модуль, смещение от конца заголовка
+ *	D ячейка модуль имя		- каталог: хэш-таблица имён
+ *	.
+ *	модули подряд
+ * Имя лежит в ячейке каталога, куда его помещает открытая
+ * адресация по obj_hash(), так что поиск не требует перестройки
+ * каталога при чтении.
+ */
+#include <wchar.h>
+
+/*
+ * Relocation flags.
+ */
+#define RA1	1	/* адрес 1 */
+#define RA2	2	/* адрес 2 */
+#define RA3	4	/* адрес 3 */
+#define RRA	8	/* регистр адреса */
+#define RLAB	16	/* относительная метка */
+#define RBASE	32	/* относительно начала модуля */
+#define RLIT	64	/* адрес литерала из пула констант */
+
+/*
+ * Symbol/expression types.
+ */
+#define TUNDF	0	/* неизвестный символ */
+#define TABS	1	/* константа */
+#define TTEXT	2	/* метка или функция */
+
+typedef struct {
+	int addr;		/* адрес от начала модуля */
+	uint64_t val;
+	int file;		/* номер исходного файла в модуле */
+	int line;		/* номер строки */
+} OBJWORD;
+
+typedef struct {
+	int addr;
+	int flags;		/* RA1, RA2, RA3, RLIT */
+	wchar_t *name;		/* внешнее имя, 0 - начало модуля */
+	uint64_t lit;		/* значение литерала для RLIT */
+} OBJREL;
+
+typedef struct {
+	wchar_t *name;
+	int type;		/* TTEXT или TABS */
+	int value;
+} OBJSYM;
+
+typedef struct {
+	char *name;		/* имя файла модуля */
+	wchar_t *overlay;	/* имя оверлея, 0 - резидентный */
+	int size;		/* длина модуля в словах */
+	int nwords, nfiles, nrel, nsym;
+	OBJWORD *word;
+	char **file;
+	OBJREL *rel;
+	OBJSYM *sym;
+} OBJMOD;
+
+typedef struct {
+	char *path;
+	FILE *fd;
+	long start;		/* начало модулей в файле */
+	int nmod;
+	long *offset;		/* смещения модулей */
+	char **modname;
+	char *loaded;		/* модуль уже взят */
+	unsigned dirsize;	/* размер каталога, степень двойки */
+	wchar_t **dirname;	/* имена по ячейкам каталога */
+	int *dirmod;		/* номер модуля по ячейкам */
+} OBJLIB;
+
+unsigned obj_hash (const wchar_t *name);
+void obj_putname (const wchar_t *name, FILE *fd);
+
+OBJMOD *obj_read (FILE *fd, const char *name);
+void obj_write (OBJMOD *m, FILE *fd);
+void obj_free (OBJMOD *m);
+
+int obj_libwrite (const char *path, OBJMOD **mod, int nmod);
+OBJLIB *obj_libopen (const char *path);
+int obj_libfind (OBJLIB *lib, const wchar_t *name);
+OBJMOD *obj_libload (OBJLIB *lib, int n);
+void obj_libclose (OBJLIB *lib);
@@ -10,45 +10,18 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <math.h>
+#include <sys/time.h>
 #include "config.h"
 #include "encoding.h"
 #include "ieee.h"
-
-#define DATSIZE         4096    /* размер памяти в словах */
-
-#define LINE_WORD	1	/* виды строк входного файла */
-#define LINE_ADDR	2
-#define LINE_START	3
-
-/*
- * Разряды машинного слова.
- */
-#define BIT46		01000000000000000LL	/* 46-й бит */
-#define TAG		00400000000000000LL	/* 45-й бит-признак */
-#define SIGN		00200000000000000LL	/* 44-й бит-знак */
-#define BIT37		00001000000000000LL	/* 37-й бит */
-#define BIT19		00000000001000000LL	/* 19-й бит */
-#define WORD		00777777777777777LL	/* биты 45..1 */
-#define MANTISSA	00000777777777777LL	/* биты 36..1 */
-
-/*
- * Разряды условного числа для обращения к внешнему устройству.
- */
-#define EXT_DIS_RAM	04000	/* 36 - БМ - блокировка памяти */
-#define EXT_DIS_CHECK	02000   /* 35 - БК - блокировка контроля */
-#define EXT_TAPE_REV	01000   /* 34 - ОН - обратное движение ленты */
-#define EXT_DIS_STOP	00400   /* 33 - БО - блокировка останова */
-#define EXT_PUNCH	00200   /* 32 - Пф - перфорация */
-#define EXT_PRINT	00100   /* 31 - Пч - печать */
-#define EXT_TAPE_FORMAT	00040   /* 30 - РЛ - разметка ленты */
-#define EXT_TAPE	00020   /* 29 - Л - лента */
-#define EXT_DRUM	00010   /* 28 - Б - барабан */
-#define EXT_WRITE	00004   /* 27 - Зп - запись */
-#define EXT_UNIT	00003   /* 26,25 - номер барабана или ленты */
+#include "sim.h"
 
 int trace;
+int stats;			/* печать статистики выполнения */
+int repeat = 1;			/* количество прогонов программы */
 char *infile;
-double clock;			/* время выполнения, микросекунды */
+double clock;			/* время выполнения, секунды */
+unsigned long long icount;	/* количество выполненных команд */
 int drum;			/* файл с образом барабана */
 
 int start_address;
@@ -72,6 +45,10 @@ int ext_ram_finish;		/* ω_МОЗУ - конечный адрес памяти *
 uint64_t ram [DATSIZE];
 unsigned char ram_dirty [DATSIZE];
 
+jmp_buf *uerror_jmp;		/* пакетный режим: возврат по ошибке */
+char uerror_msg [256];		/* сообщение об ошибке экземпляра */
+jmp_buf *stop_jmp;		/* повтор программы: возврат по останову */
+
 void print_cmd (uint64_t cmd);
 
 void quit ()
@@ -83,6 +60,12 @@ void uerror (char *s, ...)
 {
 	va_list ap;
 
+	if (uerror_jmp) {
+		va_start (ap, s);
+		vsnprintf (uerror_msg, sizeof (uerror_msg), s, ap);
+		va_end (ap);
+		longjmp (*uerror_jmp, 1);
+	}
 	fflush (stdout);
 	va_start (ap, s);
 	fprintf (stderr, "%04o: ", RVK);
@@ -839,6 +822,7 @@ void run ()
 		if (! ram_dirty [RVK])
 			uerror ("выполнение неинициализированного слова памяти");
 		RK = ram [RVK];
+		++icount;
 		if (trace) {
 			/*printf ("%8.6f) ", clock);*/
 			printf ("%04o: ", RVK);
@@ -1024,6 +1008,8 @@ csum:			if (RR & BIT46)
 			 * "хорошая" остановка.*/
 			if (a1 || a2)
 				uerror ("останов: A1=%04o, A2=%04o", a1, a2);
+			if (stop_jmp)
+				longjmp (*stop_jmp, 1);
 			exit (0);
 			break;
 		case 011: /* переход по < и Ω=1 */
@@ -1261,11 +1247,62 @@ void print_cmd (uint64_t cmd)
 	print_addr (a3, flags & 1);
 }
 
-int main (int argc, char **argv)
+/*
+ * Время хоста в микросекундах.
+ */
+double host_usec ()
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, 0);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/*
+ * Номер экземпляра добавляется к мантиссе ячейки addr.
+ */
+uint64_t vary_word (uint64_t w, int k)
+{
+	return (w & ~MANTISSA) | ((w + k) & MANTISSA);
+}
+
+/*
+ * Печать результата экземпляра k: ячейки out[] или сообщение об ошибке.
+ */
+void print_instance (int k, uint64_t *val, int nout, char *err)
 {
 	int i;
-	char *cp;
+
+	printf ("%d:", k);
+	if (err)
+		printf (" ошибка: %s", err);
+	else for (i=0; i<nout; ++i)
+		printf (" %015llo", (unsigned long long) val[i]);
+	printf ("\n");
+}
+
+/*
+ * Разбор адреса в аргументе флага.
+ */
+static int parse_addr (char *arg)
+{
+	char *end;
+	long addr;
+
+	addr = strtol (arg, &end, 8);
+	if (*end || addr <= 0 || addr >= DATSIZE)
+		return -1;
+	return addr;
+}
+
+int main (int argc, char **argv)
+{
+	int i, batch = 0, vary = -1, out [MAXOUT], nout = 0;
+	char *cp, *arg;
 	FILE *input = stdin;
+	double host, start;
+	jmp_buf stop;
+	uint64_t val [MAXOUT];
 
 	for (i=1; i<argc; i++)
 		switch (argv[i][0]) {
@@ -1274,8 +1311,46 @@ int main (int argc, char **argv)
 			case 't':
 				trace++;
 				break;
+			case 's':
+				stats++;
+				break;
+			case 'r':
+			case 'b':
+			case 'v':
+			case 'o':
+				if (cp[1])
+					arg = cp+1;
+				else if (i+1 < argc)
+					arg = argv[++i];
+				else
+					goto usage;
+				switch (*cp) {
+				case 'r':
+					repeat = strtol (arg, 0, 10);
+					if (repeat < 1)
+						goto usage;
+					break;
+				case 'b':
+					batch = strtol (arg, 0, 10);
+					if (batch < 1)
+						goto usage;
+					break;
+				case 'v':
+					vary = parse_addr (arg);
+					if (vary < 0)
+						goto usage;
+					break;
+				case 'o':
+					if (nout >= MAXOUT)
+						goto usage;
+					out [nout] = parse_addr (arg);
+					if (out [nout++] < 0)
+						goto usage;
+					break;
+				}
+				goto next;
 			}
-			break;
+next:			break;
 		default:
 			if (infile)
 				goto usage;
@@ -1292,16 +1367,55 @@ usage:		printf ("Симулятор M-20\n");
 		printf ("    sim [флаги...] infile.m20\n");
 		printf ("Флаги:\n");
 		printf ("    -t      трассировка выполнения инструкций\n");
+		printf ("    -s      статистика: команды, модельное время, время хоста\n");
+		printf ("    -r N    выполнить программу N раз\n");
+		printf ("    -b N    выполнить N экземпляров программы в пакете\n");
+		printf ("    -v адр  добавить номер экземпляра к ячейке памяти\n");
+		printf ("    -o адр  напечатать ячейку памяти по окончании (до %d раз)\n", MAXOUT);
 		return -1;
 	}
 
 	readimage (input);
 	if (trace)
 		printf ("Прочитан файл %s\n", infile);
+	if (batch) {
+		batch_run (batch, vary, out, nout);
+		return 0;
+	}
 	drum = drum_open ();
-	if (trace)
-		printf ("Пуск...\n");
-	run ();
-
+	host = 0;
+
+	/* Останов возвращает сюда, только если после прогона
+	 * есть что делать: следующий прогон или печать. */
+	if (repeat > 1 || nout || stats)
+		stop_jmp = &stop;
+	for (i=0; i<repeat; ++i) {
+		if (i > 0) {
+			/* Каждый прогон начинается с исходного образа. */
+			rewind (input);
+			readimage (input);
+		}
+		/* Номер прогона - номер экземпляра программы. */
+		RPU1 = i;
+		if (vary > 0)
+			ram [vary] = vary_word (ram [vary], i);
+		if (trace)
+			printf ("Пуск...\n");
+		start = host_usec ();
+		if (setjmp (stop) == 0)
+			run ();
+		host += host_usec () - start;
+		if (nout) {
+			int k;
+
+			for (k=0; k<nout; ++k)
+				val [k] = ram [out [k]];
+			print_instance (i, val, nout, 0);
+		}
+	}
+	fflush (stdout);
+	if (stats)
+		fprintf (stderr, "Статистика: команд %llu, модельное время %.1f мкс, время хоста %.1f мкс\n",
+			icount, clock * 1e6, host);
 	return 0;
 }
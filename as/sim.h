@@ -0,0 +1,69 @@
+/*
+ * Симулятор для ЭВМ М-20: общие определения.
+ * Copyright (GPL) 2008 Сергей Вакуленко <serge.vakulenko@gmail.com>
+ */
+#include <setjmp.h>
+
+#define DATSIZE         4096    /* размер памяти в словах */
+
+#define MAXOUT		8	/* макс. ячеек для печати по окончании */
+
+#define LINE_WORD	1	/* виды строк входного файла */
+#define LINE_ADDR	2
+#define LINE_START	3
+
+/*
+ * Разряды машинного слова.
+ */
+#define BIT46		01000000000000000LL	/* 46-й бит */
+#define TAG		00400000000000000LL	/* 45-й бит-признак */
+#define SIGN		00200000000000000LL	/* 44-й бит-знак */
+#define BIT37		00001000000000000LL	/* 37-й бит */
+#define BIT19		00000000001000000LL	/* 19-й бит */
+#define WORD		00777777777777777LL	/* биты 45..1 */
+#define MANTISSA	00000777777777777LL	/* биты 36..1 */
+
+/*
+ * Разряды условного числа для обращения к внешнему устройству.
+ */
+#define EXT_DIS_RAM	04000	/* 36 - БМ - блокировка памяти */
+#define EXT_DIS_CHECK	02000   /* 35 - БК - блокировка контроля */
+#define EXT_TAPE_REV	01000   /* 34 - ОН - обратное движение ленты */
+#define EXT_DIS_STOP	00400   /* 33 - БО - блокировка останова */
+#define EXT_PUNCH	00200   /* 32 - Пф - перфорация */
+#define EXT_PRINT	00100   /* 31 - Пч - печать */
+#define EXT_TAPE_FORMAT	00040   /* 30 - РЛ - разметка ленты */
+#define EXT_TAPE	00020   /* 29 - Л - лента */
+#define EXT_DRUM	00010   /* 28 - Б - барабан */
+#define EXT_WRITE	00004   /* 27 - Зп - запись */
+#define EXT_UNIT	00003   /* 26,25 - номер барабана или ленты */
+
+extern int trace;
+extern int stats;
+extern int start_address;
+extern int RVK;
+extern uint64_t RMR, RPU1, RPU2, RPU3, RPU4;
+extern uint64_t ram [DATSIZE];
+extern unsigned char ram_dirty [DATSIZE];
+
+/*
+ * В пакетном режиме ошибка останавливает один экземпляр программы:
+ * uerror() кладёт сообщение в uerror_msg и делает longjmp.
+ */
+extern jmp_buf *uerror_jmp;
+extern char uerror_msg [256];
+
+void uerror (char *s, ...);
+uint64_t addition (uint64_t x, uint64_t y, int no_round, int no_norm);
+uint64_t add_exponent (uint64_t x, int n);
+uint64_t multiplication (uint64_t x, uint64_t y, int no_round, int no_norm);
+uint64_t division (uint64_t x, uint64_t y, int no_round);
+uint64_t square_root (uint64_t x, int no_round);
+double host_usec (void);
+uint64_t vary_word (uint64_t w, int k);
+void print_instance (int k, uint64_t *val, int nout, char *err);
+
+/*
+ * Пакетное выполнение экземпляров программы (batch.c).
+ */
+void batch_run (int n, int vary, int *out, int nout);
@@ -0,0 +1,98 @@
+#!/bin/sh
+#
+# Замер скорости ассемблера as20 на большой синтетической программе.
+#
+# Программа из двух файлов содержит заданное количество символов:
+# глобальные константы .это, локальные имена (с точкой, одни и те же
+# в обоих файлах), метки и команды со ссылками на уже определённые
+# имена и на цифровые метки. Команд столько, чтобы программа
+# помещалась в память. Каждый замер повторяется несколько раз
+# и берётся лучший результат. Скорость выдаётся в символах,
+# строках и мегабайтах исходного текста в секунду.
+#
+# Вызов:
+#	asbench.sh [-n символов] [-k замеров] [-a as20]
+# Флаги:
+#	-n	количество символов (по умолчанию 50000)
+#	-k	количество замеров (по умолчанию 3)
+#	-a	путь к as20
+#
+top=`dirname $0`/..
+as20=
+nsym=50000
+tries=3
+
+while getopts "n:k:a:" opt; do
+	case $opt in
+	n) nsym=$OPTARG ;;
+	k) tries=$OPTARG ;;
+	a) as20=$OPTARG ;;
+	*) echo "Вызов: $0 [-n символов] [-k замеров] [-a as20]" >&2
+	   exit 2 ;;
+	esac
+done
+top=`cd $top && pwd`
+[ -z "$as20" ] && as20=$top/as/as20
+if [ ! -x $as20 ]; then
+	echo "Нет $as20" >&2
+	exit 2
+fi
+
+tmp=`mktemp -d /tmp/asbench.XXXXXX` || exit 2
+trap 'rm -rf $tmp' 0
+
+#
+# Файл программы: номер файла, первый номер глобального имени,
+# количество глобальных и локальных имён, количество команд.
+#
+gen () {
+	awk -v f=$1 -v first=$2 -v nglob=$3 -v nloc=$4 -v ncmd=$5 'BEGIN {
+		srand (f + 1)
+		printf "; Синтетическая программа для замера as20, файл %d\n", f
+		for (i=0; i<nglob; ++i)
+			printf "с%d\t.это\t%d\n", first + i, (first + i) % 4096
+		for (i=0; i<nloc; ++i)
+			printf ".л%d\t.это\t%d\n", i, i % 4096
+		if (f == 0)
+			print "начало:"
+		for (i=0; i<ncmd; ++i) {
+			a = first + int (rand () * nglob)
+			b = first + int (rand () * nglob)
+			c = int (rand () * nloc)
+			if (i % 8 == 0)
+				printf "%d:", i % 9 + 1
+			if (i % 8 == 4 && i >= 8)
+				printf "\tпб\t%dн, , .л%d\n", (i - 4) % 9 + 1, c
+			else
+				printf "\tс\tс%d, с%d, .л%d\n", a, b, c
+		}
+		if (f == 1)
+			print "\tстоп"
+	}' > $tmp/prog$1.s20
+}
+
+nloc=`expr $nsym / 20`
+nglob=`expr \( $nsym - 2 \* $nloc \) / 2`
+gen 0 0 $nglob $nloc 1800
+gen 1 $nglob `expr $nsym - 2 \* $nloc - $nglob` $nloc 1800
+lines=`cat $tmp/prog0.s20 $tmp/prog1.s20 | wc -l`
+bytes=`cat $tmp/prog0.s20 $tmp/prog1.s20 | wc -c`
+
+best=
+for k in `seq $tries`; do
+	start=`date +%s%N`
+	if ! $as20 -o $tmp/prog.m20 $tmp/prog0.s20 $tmp/prog1.s20 2> $tmp/err; then
+		cat $tmp/err >&2
+		echo "Ошибка ассемблирования" >&2
+		exit 1
+	fi
+	t=`expr \( \`date +%s%N\` - $start \) / 1000`
+	[ -z "$best" ] || [ $t -lt $best ] && best=$t
+done
+
+awk -v nsym=$nsym -v lines=$lines -v bytes=$bytes -v usec=$best 'BEGIN {
+	printf "символов %d, строк %d, байт %d\n", nsym, lines, bytes
+	printf "время %.3f с, %.0f символов/с, %.0f строк/с, %.2f Мб/с\n",
+		usec / 1e6, nsym * 1e6 / usec, lines * 1e6 / usec,
+		bytes / usec
+}'
@@ -0,0 +1,268 @@
+#!/bin/sh
+#
+# Замер скорости симуляторов М-20: sim20 и SIMH m20.
+#
+# Скорость замеряется на программах bench/*.s20, каждая из которых
+# выполняет больше 10 миллионов команд: на коротких программах
+# замер тонет в шуме таймера и в накладных расходах запуска.
+# Программы ассемблируются as20 и выполняются в обоих симуляторах
+# с фиксированными настройками пульта (регистры РПУ нулевые, модель
+# M20, без PACE и профилирования). Печатается количество команд,
+# команд в секунду, наносекунд хоста на команду и отношение модельного
+# времени ко времени хоста. Каждый замер повторяется несколько раз
+# и берётся лучший результат.
+#
+# Программы из дистрибутива выполняют меньше 700 команд, их время
+# не замеряется: по ним проверяется только количество команд.
+# kaissa/kaissa.m20 сюда не входит: ей нужны команды М-220
+# 017, 037, 040 и 057, которые симуляторы не выполняют.
+#
+# Абсолютные времена зависят от машины, поэтому в базе bench/baseline
+# хранится только то, что от неё не зависит: количество команд каждой
+# программы и отношение времени m20 ко времени sim20 на ней. Замер
+# неудачен, если количество команд изменилось или разошлось между
+# симуляторами, либо если отношение времён изменилось больше чем
+# на порог - в любую сторону, так как замедлиться мог любой из двух.
+#
+# Вызов:
+#	bench.sh [-u] [-t порог%] [-k замеров] [-a as20] [-s sim20] [-m m20] [-d каталог]
+# Флаги:
+#	-u	записать результаты как новую базу
+#	-t	допустимое изменение отношения времён в процентах (по умолчанию 25)
+#	-k	количество замеров каждой программы (по умолчанию 3)
+#	-a	путь к as20
+#	-s	путь к sim20
+#	-m	путь к SIMH m20, "-" - не замерять
+#	-d	корень исходных текстов
+#
+top=`dirname $0`/..
+as20=
+sim20=
+m20=
+update=
+threshold=25
+tries=3
+
+while getopts "ut:k:a:s:m:d:" opt; do
+	case $opt in
+	u) update=1 ;;
+	t) threshold=$OPTARG ;;
+	k) tries=$OPTARG ;;
+	a) as20=$OPTARG ;;
+	s) sim20=$OPTARG ;;
+	m) m20=$OPTARG ;;
+	d) top=$OPTARG ;;
+	*) echo "Вызов: $0 [-u] [-t порог%] [-k замеров] [-a as20] [-s sim20] [-m m20] [-d каталог]" >&2
+	   exit 2 ;;
+	esac
+done
+top=`cd $top && pwd`
+[ -z "$as20" ] && as20=$top/as/as20
+[ -z "$sim20" ] && sim20=$top/as/sim20
+[ -z "$m20" ] && m20=$top/simh/m20
+baseline=$top/bench/baseline
+if [ ! -x $as20 ]; then
+	echo "Нет $as20" >&2
+	exit 2
+fi
+if [ "$m20" = - ]; then
+	m20=
+elif [ ! -x $m20 ]; then
+	echo "Нет $m20, замер SIMH пропущен"
+	m20=
+fi
+if [ ! -x $sim20 ]; then
+	echo "Нет $sim20, замер sim20 пропущен"
+	sim20=
+fi
+
+tmp=`mktemp -d /tmp/bench20.XXXXXX` || exit 2
+trap 'rm -rf $tmp' 0
+result=$tmp/result
+: > $result
+
+#
+# Программы: имя, количество замеров, подготовка барабана
+# (через запятую, выполняется один раз), файл программы.
+# Замеряемые программы ассемблируются во временный каталог.
+#
+workloads=
+for f in $top/bench/*.s20; do
+	name=`basename $f .s20`
+	if ! $as20 -o $tmp/$name.m20 $f > $tmp/as.log 2>&1; then
+		cat $tmp/as.log >&2
+		exit 2
+	fi
+	workloads="$workloads
+$name	$tries	-	$tmp/$name.m20"
+done
+workloads="$workloads
+is2		1	-			$top/as/is2.m20
+is2m		1	-			$top/as/is2m.m20
+random5		1	-			$top/as/random5.m20
+example1	1	-			$top/as/example1.m20
+example2	1	-			$top/as/example2.m20
+example3	1	-			$top/as/example3.m20
+example4	1	$top/as/is2.m20,$top/as/stdprog.m20	$top/as/example4.m20
+task1		1	-			$top/todo/task1.m20
+"
+
+#
+# Прогон в sim20. Барабан создаётся самим sim20 (все слова
+# помечены как неинициализированные).
+#
+run_sim20 () {
+	M20_DRUM=$tmp/drum20.bin
+	export M20_DRUM
+	rm -f $M20_DRUM
+	for f in `echo $2 | tr , ' '`; do
+		[ $f = - ] && continue
+		$sim20 $f > /dev/null || return 1
+	done
+	$sim20 -s $3 > /dev/null 2> $tmp/stats || return 1
+	# Статистика: команд N, модельное время U мкс, время хоста H мкс
+	awk -v name=$1 '/^Статистика:/ {
+		gsub (",", "")
+		print "sim20", name, $3, $6, $10 * 1000
+	}' $tmp/stats >> $result
+}
+
+#
+# Прогон в SIMH m20: SHOW CPU SPEED после пуска программы.
+#
+run_m20 () {
+	ini=$tmp/bench.ini
+	rm -f $tmp/drum.bin
+	{
+		echo "set cpu m20"
+		echo "set cpu nopace"
+		echo "set cpu noprofile"
+		echo "attach drum $tmp/drum.bin"
+		for f in `echo $2 | tr , ' '`; do
+			[ $f = - ] && continue
+			echo "load $f"
+			echo "run"
+		done
+		echo "load $3"
+		echo "run"
+		echo "show cpu speed"
+		echo "quit"
+	} > $ini
+	$m20 $ini < /dev/null > $tmp/out 2>&1
+	if [ "`grep -c '^Останов,' $tmp/out`" != \
+	    `echo $2 | tr , ' ' | grep -v '^-$' | wc -w | awk '{ print $1 + 1 }'` ]; then
+		grep -a "РВК:" $tmp/out | grep -v "^Останов," | head -1 >&2
+		return 1
+	fi
+	# модельное время U с, время хоста H с, команд N, ...
+	awk -v name=$1 '/^модельное время/ {
+		gsub (",", "")
+		print "m20", name, $10, $3 * 1e6, $7 * 1e9
+	}' $tmp/out >> $result
+}
+
+echo "$workloads" | while read name count setup file; do
+	[ -z "$name" ] && continue
+	for k in `seq $count`; do
+		if [ -n "$sim20" ]; then
+			run_sim20 $name $setup $file ||
+				echo "sim20 $name ошибка" >> $result
+		fi
+		if [ -n "$m20" ]; then
+			run_m20 $name $setup $file ||
+				echo "m20 $name ошибка" >> $result
+		fi
+	done
+done
+
+#
+# Отчёт и сравнение с базой.
+# Строка результата: симулятор, программа, команд, модельное время
+# в мкс, время хоста в нс. Из повторных замеров остаётся самый
+# быстрый; ошибка в любом из них - ошибка программы.
+#
+awk '{
+	key = $1 " " $2
+	if (! (key in row))
+		order [n++] = key
+	if ($3 == "ошибка")
+		row [key] = $0
+	else if (row [key] !~ /ошибка/ &&
+	    (! (key in best) || $5 < best [key])) {
+		best [key] = $5
+		row [key] = $0
+	}
+} END {
+	for (i=0; i<n; ++i)
+		print row [order [i]]
+}' $result > $result.best
+awk -v update="$update" -v threshold=$threshold -v baseline=$baseline '
+BEGIN {
+	while ((getline line < baseline) > 0) {
+		if (line ~ /^#/)
+			continue
+		split (line, f, " ")
+		basecmd [f[1]] = f[2]
+		baseratio [f[1]] = f[3]
+	}
+	close (baseline)
+	printf "%-6s %-9s %9s %12s %11s %10s\n", "сим.", "программа",
+		"команд", "команд/с", "нс/команду", "М-20/хост"
+}
+$3 == "ошибка" {
+	printf "%-6s %-9s ошибка выполнения\n", $1, $2
+	fail = 1
+	next
+}
+{
+	if (! ($2 in cmd))
+		order [n++] = $2
+	if (($2 in cmd) && cmd [$2] != $3) {
+		printf "%s: количество команд в симуляторах разное\n", $2
+		fail = 1
+	}
+	cmd [$2] = $3
+	if ($3 < 1e7) {
+		printf "%-6s %-9s %9d\n", $1, $2, $3
+		next
+	}
+	ns [$1 " " $2] = $5 / $3
+	printf "%-6s %-9s %9d %12.0f %11.1f %10.2f\n", $1, $2, $3,
+		$3 * 1e9 / $5, $5 / $3, $4 * 1e3 / $5
+}
+END {
+	if (update)
+		print "# программа команд время_m20/время_sim20" > baseline
+	for (i=0; i<n; ++i) {
+		p = order [i]
+		ratio = "-"
+		if (("m20 " p) in ns && ("sim20 " p) in ns)
+			ratio = sprintf ("%.3f", ns ["m20 " p] / ns ["sim20 " p])
+		if (update) {
+			printf "%s %d %s\n", p, cmd [p], ratio > baseline
+			continue
+		}
+		if (! (p in basecmd))
+			continue
+		if (basecmd [p] != cmd [p]) {
+			printf "%s: число команд изменилось: %d, было %d\n",
+				p, cmd [p], basecmd [p]
+			fail = 1
+		}
+		if (ratio == "-" || baseratio [p] == "-")
+			continue
+		change = (ratio / baseratio [p] - 1) * 100
+		printf "%s: m20/sim20 %.2f, в базе %.2f, %+.0f%%", p,
+			ratio, baseratio [p], change
+		if (change > threshold || change < -threshold) {
+			printf " - ИЗМЕНЕНИЕ больше %d%%", threshold
+			fail = 1
+		}
+		printf "\n"
+	}
+	if (update)
+		printf "База записана в %s\n", baseline
+	else if (fail)
+		printf "Замер неудачен\n"
+	exit fail
+}' $result.best
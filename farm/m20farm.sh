@@ -0,0 +1,163 @@
+#!/bin/sh
+#
+# Пакетный запуск заданий на симуляторе SIMH m20.
+#
+# Задания перечислены в файле-манифесте, по одному в строке:
+#
+#	имя  программа.m20  барабан  РПУ1  РПУ2  РПУ3  РПУ4  предел
+#
+# Барабан - образ барабана, с которого начинается задание, или "-"
+# для чистого барабана. РПУ1...РПУ4 - восьмеричные значения регистров
+# пульта, "-" - ноль. Предел - наибольшее количество команд,
+# "-" - без ограничения. Пути отсчитываются от каталога манифеста.
+# Пустые строки и строки, начинающиеся с '#', пропускаются.
+#
+# Задания выполняются параллельно, по одному на ядро процессора.
+# Каждое работает в своём временном каталоге, с собственной копией
+# барабана, так что исходный образ не меняется. Результат задания
+# помещается в каталог вывода/имя:
+#	output	- печать программы
+#	stop	- сообщение об останове
+#	stats	- команды, модельное время и время хоста
+#	drum	- барабан после выполнения
+#
+# Результаты хранятся в кэше под хэшем входных данных: содержимого
+# программы и барабана, регистров пульта, предела и самого симулятора.
+# Задание, для которого результат уже есть, не выполняется заново.
+#
+# Вызов:
+#	m20farm.sh [-j заданий] [-c кэш] [-o вывод] [-m m20] манифест
+# Флаги:
+#	-j	количество одновременных заданий (по умолчанию - по числу ядер)
+#	-c	каталог кэша (по умолчанию $HOME/.cache/m20farm)
+#	-o	каталог вывода (по умолчанию out рядом с манифестом)
+#	-m	путь к SIMH m20
+#
+top=`dirname $0`/..
+jobs=
+cache=${M20FARM_CACHE:-$HOME/.cache/m20farm}
+outdir=
+m20=
+
+#
+# Выполнение одного задания, в отдельном процессе (флаг -x).
+# Параметры: поля строки манифеста.
+# Окружение: FARM_DIR, FARM_CACHE, FARM_OUT, FARM_M20, FARM_SIMHASH.
+#
+if [ "$1" = -x ]; then
+	shift
+	[ $# = 8 ] || { echo "$1: неверная строка манифеста" >&2; exit 1; }
+	name=$1 image=$2 drum=$3 limit=$8
+	case $image in /*) ;; *) image=$FARM_DIR/$image ;; esac
+	case $drum in -|/*) ;; *) drum=$FARM_DIR/$drum ;; esac
+	if [ ! -f $image ] || { [ $drum != - ] && [ ! -f $drum ]; }; then
+		echo "$name: нет файла $image или $drum" >&2
+		exit 1
+	fi
+
+	# Ключ кэша: хэш всех входных данных.
+	key=`{
+		echo "$FARM_SIMHASH $4 $5 $6 $7 $limit"
+		$FARM_HASH < $image
+		[ $drum = - ] && echo - || $FARM_HASH < $drum
+	} | $FARM_HASH | cut -d' ' -f1`
+	dest=$FARM_OUT/$name
+	rm -rf $dest
+	mkdir -p $dest || exit 1
+	if [ -f $FARM_CACHE/$key/stop ]; then
+		cp $FARM_CACHE/$key/* $dest/
+		echo "$name кэш `cat $dest/stop`"
+		exit 0
+	fi
+
+	tmp=`mktemp -d /tmp/m20farm.XXXXXX` || exit 1
+	trap 'rm -rf $tmp' 0
+	[ $drum != - ] && cp $drum $tmp/drum
+	{
+		echo "set cpu m20"
+		echo "set cpu nopace"
+		echo "attach drum $tmp/drum"
+		echo "load $image"
+		n=1
+		for r in $4 $5 $6 $7; do
+			[ $r != - ] && echo "deposit РПУ$n $r"
+			n=`expr $n + 1`
+		done
+		echo "echo @@@"
+		[ $limit = - ] && echo "run" || echo "step $limit"
+		echo "echo @@@"
+		echo "show cpu speed"
+		echo "quit"
+	} > $tmp/job.ini
+	(cd $tmp && $FARM_M20 job.ini < /dev/null > console 2>&1)
+
+	# Между метками: печать программы, пустая строка и сообщение
+	# об останове.
+	awk -v dir=$tmp '
+		/^@@@$/ { ++mark; next }
+		mark == 1 { line [n++] = $0 }
+		mark == 2 && /^модельное время/ { print > (dir "/stats") }
+		END {
+			if (n > 0)
+				print line [--n] > (dir "/stop")
+			if (n > 0 && line [n-1] == "")
+				--n
+			for (i=0; i<n; ++i)
+				print line [i] > (dir "/output")
+		}' $tmp/console
+	if [ ! -s $tmp/stop ]; then
+		echo "$name: симулятор не запустился" >&2
+		cat $tmp/console >&2
+		exit 1
+	fi
+	touch $tmp/output $tmp/stats
+	mv $tmp/drum $tmp/drum.bin 2>/dev/null
+	mkdir -p $FARM_CACHE
+	c=`mktemp -d $FARM_CACHE/new.XXXXXX` || exit 1
+	for f in output stop stats drum.bin; do
+		[ -f $tmp/$f ] && cp $tmp/$f $c/ && cp $tmp/$f $dest/
+	done
+
+	# Каталог появляется в кэше целиком или не появляется вовсе.
+	mv $c $FARM_CACHE/$key 2>/dev/null || rm -rf $c
+	echo "$name выполнено `cat $dest/stop`"
+	exit 0
+fi
+
+while getopts "j:c:o:m:" opt; do
+	case $opt in
+	j) jobs=$OPTARG ;;
+	c) cache=$OPTARG ;;
+	o) outdir=$OPTARG ;;
+	m) m20=$OPTARG ;;
+	*) echo "Вызов: $0 [-j заданий] [-c кэш] [-o вывод] [-m m20] манифест" >&2
+	   exit 2 ;;
+	esac
+done
+shift `expr $OPTIND - 1`
+if [ $# != 1 ] || [ ! -f "$1" ]; then
+	echo "Вызов: $0 [-j заданий] [-c кэш] [-o вывод] [-m m20] манифест" >&2
+	exit 2
+fi
+manifest=$1
+FARM_DIR=`cd \`dirname $manifest\` && pwd`
+[ -z "$m20" ] && m20=$top/simh/m20
+[ -z "$outdir" ] && outdir=$FARM_DIR/out
+[ -z "$jobs" ] && jobs=`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1`
+if [ ! -x $m20 ]; then
+	echo "Нет $m20" >&2
+	exit 2
+fi
+mkdir -p $outdir $cache || exit 2
+
+FARM_HASH=sha256sum
+command -v sha256sum > /dev/null || FARM_HASH=md5sum
+FARM_M20=`cd \`dirname $m20\` && pwd`/`basename $m20`
+FARM_OUT=`cd $outdir && pwd`
+FARM_CACHE=`cd $cache && pwd`
+FARM_SIMHASH=`$FARM_HASH < $FARM_M20 | cut -d' ' -f1`
+export FARM_DIR FARM_HASH FARM_M20 FARM_OUT FARM_CACHE FARM_SIMHASH
+
+# Каждая строка манифеста - отдельный процесс, не больше jobs сразу.
+grep -v '^[ 	]*#' $manifest | grep -v '^[ 	]*$' |
+	xargs -L 1 -P $jobs sh $0 -x
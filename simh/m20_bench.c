@@ -0,0 +1,356 @@
+/*
+ * m20_bench.c: M-20 per-opcode microbenchmark
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * Command OPBENCH [file] measures the host cost of every instruction.
+ * For each opcode, each combination of address modification flags
+ * and several kinds of operands (normalized and unnormalized numbers,
+ * zero, numbers with the largest exponent; for shifts - several shift
+ * counts) a block of identical instructions is placed into memory,
+ * terminated by a stop, and executed through sim_instr. The table
+ * shows host nanoseconds per instruction for flags 000...111 and
+ * simulated microseconds of the selected machine model.
+ *
+ * Jumps are directed to the next instruction, and instructions which
+ * load RA keep its value, so every instruction of a block is executed.
+ * Input/output instructions are not measured. Memory, registers and
+ * counters of the machine are restored after the benchmark.
+ */
+#include "m20_defs.h"
+
+#define OPB_BODY	03700		/* команд в блоке */
+#define OPB_RUNS	10		/* прогонов, берётся лучший */
+#define OPB_RA		0100		/* значение регистра адреса */
+#define OPB_X		07701		/* первый операнд */
+#define OPB_Y		07702		/* второй операнд */
+#define OPB_Z		07703		/* результат */
+
+extern const char *sim_stop_messages [];
+
+/*
+ * Виды команд по использованию адресов.
+ */
+enum {
+	OPB_NONE,			/* не замеряется */
+	OPB_ARITH,			/* a1, a2 - числа, a3 - результат */
+	OPB_UNARY,			/* a1 - число, a3 - результат */
+	OPB_SHIFT,			/* a1 - величина сдвига, a2 - число */
+	OPB_SHIFTX,			/* a1 - число с величиной сдвига */
+	OPB_JUMP,			/* a2 - адрес перехода */
+	OPB_LOOP,			/* сравнение РА с a1, переход, РА=a3 */
+	OPB_SETRA,			/* установка РА */
+};
+
+/*
+ * Операнды.
+ */
+typedef struct {
+	const char *name;
+	t_value x, y;
+	int shift;			/* величина сдвига */
+	int omega;			/* начальное значение Ω */
+} OPERANDS;
+
+static const OPERANDS opb_num [] = {
+	{ "норм",   0100600000000000LL, 0077463146314632LL, 0, 0 },
+	{ "ненорм", 0100000000000001LL, 0076000000000003LL, 0, 0 },
+	{ "ноль",   0,                  0,                  0, 0 },
+	{ "предел", 0177600000000000LL, 0177400000000000LL, 0, 0 },
+	{ 0 }
+};
+
+static const OPERANDS opb_shift [] = {
+	{ "сдвиг 0",   0, 00777777777777777LL, 0,   0 },
+	{ "сдвиг 8",   0, 00777777777777777LL, 8,   0 },
+	{ "сдвиг -35", 0, 00777777777777777LL, -35, 0 },
+	{ 0 }
+};
+
+static const OPERANDS opb_cond [] = {
+	{ "Ω=0",    0100600000000000LL, 0, 0, 0 },
+	{ "Ω=1",    0100600000000000LL, 0, 0, 1 },
+	{ 0 }
+};
+
+static const OPERANDS opb_loop [] = {
+	{ "РА<a1",  0, 0, 1, 0 },
+	{ "РА>=a1", 0, 0, 0, 0 },
+	{ 0 }
+};
+
+static const OPERANDS opb_one [] = {
+	{ "",       0100600000000000LL, (t_value) OPB_RA << 12, 0, 0 },
+	{ 0 }
+};
+
+/*
+ * Вид команды по коду операции.
+ */
+static int opb_kind (int op)
+{
+	switch (op) {
+	case 010: case 030: case 050: case 070: case 077:
+		return OPB_NONE;
+	case 014: case 054:
+		return OPB_SHIFT;
+	case 034: case 074:
+		return OPB_SHIFTX;
+	case 016: case 036: case 056: case 076:
+		return OPB_JUMP;
+	case 011: case 031: case 051: case 071: case 012: case 032:
+		return OPB_LOOP;
+	case 052: case 072:
+		return OPB_SETRA;
+	case 044: case 064: case 047: case 067: case 000: case 020:
+		return OPB_UNARY;
+	}
+	return OPB_ARITH;
+}
+
+static const OPERANDS *opb_operands (int op)
+{
+	switch (opb_kind (op)) {
+	case OPB_SHIFT:
+	case OPB_SHIFTX:
+		return opb_shift;
+	case OPB_JUMP:
+		return (op == 036 || op == 076) ? opb_cond : opb_one;
+	case OPB_LOOP:
+		return opb_loop;
+	case OPB_SETRA:
+		return opb_one;
+	case OPB_UNARY:
+		if (op == 047 || op == 020)
+			return opb_one;
+	}
+	return opb_num;
+}
+
+/*
+ * Адресное поле команды: с признаком модификации из него
+ * вычитается РА, чтобы исполнительный адрес остался прежним.
+ */
+static t_value opb_field (int addr, int flags, int bit)
+{
+	if (flags & bit)
+		addr -= OPB_RA;
+	return addr & 07777;
+}
+
+/*
+ * Команда блока по адресу addr.
+ */
+static t_value opb_inst (int op, int flags, const OPERANDS *p, int addr)
+{
+	int a1 = OPB_X, a2 = OPB_Y, a3 = OPB_Z;
+
+	switch (opb_kind (op)) {
+	case OPB_SHIFT:
+		a1 = 0100 + p->shift;
+		break;
+	case OPB_JUMP:
+		a2 = addr + 1;
+		break;
+	case OPB_LOOP:
+		a1 = p->shift ? OPB_RA + 1 : 0;
+		a2 = addr + 1;
+		a3 = OPB_RA;
+		break;
+	case OPB_SETRA:
+		if (op == 052)
+			a2 = OPB_RA;
+		break;
+	case OPB_UNARY:
+		if (op == 020)
+			a1 = 1;
+		a2 = 0;
+		break;
+	case OPB_ARITH:
+		if (op == 035)
+			a2 = OPB_X;		/* сравнение без останова */
+		break;
+	}
+	return (t_value) flags << 42 | (t_value) op << 36 |
+		opb_field (a1, flags, 4) << 24 |
+		opb_field (a2, flags, 2) << 12 |
+		opb_field (a3, flags, 1);
+}
+
+/*
+ * Замер одного блока. Возвращает нс на команду, в *usec - модельное
+ * время команды, в *stop - код останова, если блок не дошёл до конца.
+ */
+static double opb_run (int op, int flags, const OPERANDS *p,
+	double *usec, t_stat *stop)
+{
+	t_uint64 t0, icount, time, best = ~0ULL;
+	int addr, i;
+	t_stat r;
+
+	for (addr=1; addr<=OPB_BODY; ++addr)
+		M [addr] = opb_inst (op, flags, p, addr);
+	M [OPB_BODY + 1] = 077LL << 36;		/* стоп */
+
+	*stop = 0;
+	*usec = 0;
+	for (i=0; i<OPB_RUNS; ++i) {
+		M [OPB_X] = p->x;
+		M [OPB_Y] = p->y;
+		if (opb_kind (op) == OPB_SHIFTX)
+			M [OPB_X] = (t_value) (0100 + p->shift) << 36;
+		M [OPB_Z] = 0;
+		RPU1 = p->x;
+		RA = OPB_RA;
+		OMEGA = p->omega;
+		RMR = p->y;
+		RVK = 1;
+		icount = cpu_icount;
+		time = cpu_time;
+		t0 = host_nsec ();
+		r = sim_instr ();
+		t0 = host_nsec () - t0;
+		if (r != STOP_STOP || RVK != OPB_BODY + 2) {
+			*stop = r;
+			return 0;
+		}
+		/* Последняя команда - стоп, delay - её время. */
+		icount = cpu_icount - icount - 1;
+		time = cpu_time - time - delay;
+		if (t0 < best)
+			best = t0;
+		*usec = time / 2.0 / icount;
+	}
+	return (double) best / (OPB_BODY + 1);
+}
+
+/*
+ * Печать строки с дополнением пробелами до width знаков
+ * (русская буква занимает в UTF-8 два байта).
+ */
+static void opb_puts (FILE *fd, const char *str, int width)
+{
+	const char *p;
+	int n = 0;
+
+	for (p=str; *p; ++p)
+		if ((*p & 0xc0) != 0x80)
+			++n;
+	fprintf (fd, "%s%*s", str, n < width ? width - n : 1, "");
+}
+
+/*
+ * Таблица по всем командам.
+ */
+static void opb_report (FILE *fd)
+{
+	const OPERANDS *p;
+	double ns [8], usec;
+	t_stat stop [8], err;
+	int op, flags;
+
+	fprintf (fd, "; Стоимость команд на хосте, нс/команду, по признакам модификации адресов\n");
+	fprintf (fd, "; код мнемоника операнды      000     001     010     011     100     101     110     111  мкс модели\n");
+	for (op=0; op<64; ++op) {
+		if (opb_kind (op) == OPB_NONE) {
+			fprintf (fd, " %03o ", op);
+			opb_puts (fd, m20_opname [op], 10);
+			fprintf (fd, "ввод-вывод и останов не замеряются\n");
+			continue;
+		}
+		for (p = opb_operands (op); p->name; ++p) {
+			if (opb_run (op, 0, p, &usec, &err) == 0 &&
+			    err == STOP_BADCMD) {
+				fprintf (fd, " %03o ", op);
+				opb_puts (fd, m20_opname [op], 10);
+				fprintf (fd, "нет в этой модели машины\n");
+				break;
+			}
+			err = 0;
+			for (flags=0; flags<8; ++flags) {
+				ns [flags] = opb_run (op, flags, p, &usec, &stop [flags]);
+				if (stop [flags] && ! err)
+					err = stop [flags];
+				if (stop [flags] >= SCPE_BASE)
+					return;		/* прервано с пульта */
+			}
+			fprintf (fd, " %03o ", op);
+			opb_puts (fd, m20_opname [op], 10);
+			opb_puts (fd, p->name, 10);
+			for (flags=0; flags<8; ++flags) {
+				if (stop [flags])
+					fprintf (fd, "    стоп");
+				else
+					fprintf (fd, " %7.1f", ns [flags]);
+			}
+			if (err)
+				fprintf (fd, "  %s", sim_stop_messages [err]);
+			else
+				fprintf (fd, " %10.1f", usec);
+			fprintf (fd, "\n");
+		}
+	}
+}
+
+/*
+ * Команда OPBENCH [file].
+ * Состояние машины сохраняется и восстанавливается; снимки для
+ * обратного хода, профиль, точки останова, трассировка и
+ * автоматические контрольные точки на время замера отключаются.
+ */
+t_stat opbench_cmd (int32 flag, char *cptr)
+{
+	static t_value mem [MEMSIZE];
+	char fname [CBUFSIZE];
+	FILE *fd = stdout;
+	uint32 rvk, ra, omega, brk, flags, dctrl;
+	t_value rk, rr, rmr, rpu1;
+	t_uint64 time, icount, next, usec, nsec, count;
+	int ext [4];
+	int32 ckpt;
+
+	if (cptr && *cptr) {
+		cptr = get_glyph_nc (cptr, fname, 0);
+		if (*cptr)
+			return SCPE_2MARG;
+		fd = sim_fopen (fname, "w");
+		if (! fd)
+			return SCPE_OPENERR;
+	}
+	memcpy (mem, M, sizeof (mem));
+	rvk = RVK; ra = RA; omega = OMEGA;
+	rk = RK; rr = RR; rmr = RMR; rpu1 = RPU1;
+	ext[0] = ext_op; ext[1] = ext_disk_addr;
+	ext[2] = ext_ram_start; ext[3] = ext_ram_finish;
+	time = cpu_time; icount = cpu_icount; next = hist_next;
+	usec = speed_usec; nsec = speed_nsec; count = speed_icount;
+	brk = sim_brk_summ; flags = cpu_unit.flags; dctrl = cpu_dev.dctrl;
+	ckpt = sim_is_active (ckpt_dev.units);
+	cov_save ();
+
+	hist_next = ~0ULL;
+	sim_brk_summ = 0;
+	cpu_unit.flags &= ~(UNIT_PACE | UNIT_PROF | UNIT_FAST | UNIT_FUSE);
+	cpu_dev.dctrl = 0;
+	if (ckpt)
+		sim_cancel (ckpt_dev.units);
+	metr_hold = 1;
+
+	opb_report (fd);
+	if (fd != stdout)
+		fclose (fd);
+
+	metr_hold = 0;
+	if (ckpt)
+		sim_activate (ckpt_dev.units, ckpt - 1);
+	cov_restore ();
+	cpu_dev.dctrl = dctrl; cpu_unit.flags = flags; sim_brk_summ = brk;
+	speed_usec = usec; speed_nsec = nsec; speed_icount = count;
+	cpu_time = time; cpu_icount = icount; hist_next = next;
+	ext_op = ext[0]; ext_disk_addr = ext[1];
+	ext_ram_start = ext[2]; ext_ram_finish = ext[3];
+	RK = rk; RR = rr; RMR = rmr; RPU1 = rpu1;
+	RVK = rvk; RA = ra; OMEGA = omega;
+	memcpy (M, mem, sizeof (mem));
+	return SCPE_OK;
+}
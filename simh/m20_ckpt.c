@@ -0,0 +1,397 @@
+/*
+ * m20_ckpt.c: M-20 checkpoint device
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * Checkpoint is a compact binary image of the machine state:
+ * registers, the whole memory, the name of the attached drum file
+ * and the drum pages modified since the previous checkpoint.
+ * Unlike SAVE/RESTORE of SCP, it is written with one fxwrite()
+ * and includes the drum contents.
+ *
+ * A file attached to CKPT device is a log of checkpoints: every
+ * record is appended to the end of the file.  The first record
+ * contains all drum pages, following records only the changed ones.
+ * Command RECOVER replays the log up to the last complete record,
+ * so a job survives a host crash, losing only the work done since
+ * the last checkpoint.
+ *
+ * Commands:
+ *	ATTACH CKPT file	- append checkpoints to the log
+ *	SET CKPT INTERVAL=n	- automatic checkpoint every n seconds
+ *				  of host time, 0 - disabled
+ *	CHECKPOINT		- append a checkpoint to the log now
+ *	CHECKPOINT file		- write a standalone full checkpoint
+ *	RECOVER file		- restore the state from a checkpoint
+ */
+#include "m20_defs.h"
+#include <unistd.h>
+
+#define CKPT_MAGIC	0x31544b5030324dLL	/* "M20PKT1" */
+#define CKPT_NREGS	17			/* число регистров в записи */
+#define CKPT_NAMEW	(CBUFSIZE / 8)		/* слов на имя файла барабана */
+#define CKPT_NPAGES	(DRUM_SIZE / DRUM_PAGE)
+#define CKPT_MAXW	(2 + CKPT_NREGS + MEMSIZE + 1 + CKPT_NAMEW + 1 + \
+			 CKPT_NPAGES * (2 + DRUM_PAGE) + 1)
+#define CKPT_WAIT	100000			/* период проверки, мкс */
+
+extern int32 sim_quiet;
+
+uint32 ckpt_interval;		/* период автоматической записи, секунды */
+t_uint64 ckpt_last;		/* время хоста последней записи, нс */
+t_uint64 ckpt_count;		/* количество записанных точек */
+
+static t_uint64 ckpt_buf [CKPT_MAXW];
+
+t_stat ckpt_svc (UNIT *uptr);
+t_stat ckpt_reset (DEVICE *dptr);
+t_stat ckpt_attach (UNIT *uptr, char *cptr);
+t_stat ckpt_set_interval (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat ckpt_show_interval (FILE *st, UNIT *uptr, int32 val, void *desc);
+
+/*
+ * CKPT data structures
+ *
+ * ckpt_dev	CKPT device descriptor
+ * ckpt_unit	CKPT unit descriptor
+ * ckpt_reg	CKPT register list
+ * ckpt_mod	CKPT modifiers list
+ */
+UNIT ckpt_unit = {
+	UDATA (&ckpt_svc, UNIT_ATTABLE, 0)
+};
+
+REG ckpt_reg[] = {
+	{ DRDATA (COUNT, ckpt_count, 64), REG_RO },
+	{ 0 }
+};
+
+MTAB ckpt_mod[] = {
+	{ MTAB_XTD|MTAB_VDV|MTAB_VAL, 0, "INTERVAL", "INTERVAL",
+		&ckpt_set_interval, &ckpt_show_interval },
+	{ 0 }
+};
+
+DEVICE ckpt_dev = {
+	"CKPT", &ckpt_unit, ckpt_reg, ckpt_mod,
+	1, 8, 12, 1, 8, 45,
+	NULL, NULL, &ckpt_reset,
+	NULL, &ckpt_attach, NULL, NULL,
+	DEV_DEBUG
+};
+
+/*
+ * Планирование автоматической записи.
+ */
+t_stat ckpt_reset (DEVICE *dptr)
+{
+	sim_cancel (&ckpt_unit);
+	ckpt_last = host_nsec ();
+	if ((ckpt_unit.flags & UNIT_ATT) && ckpt_interval)
+		sim_activate (&ckpt_unit, CKPT_WAIT);
+	return SCPE_OK;
+}
+
+/*
+ * Подключение журнала контрольных точек. Первая запись в журнал
+ * будет содержать барабан целиком.
+ */
+t_stat ckpt_attach (UNIT *uptr, char *cptr)
+{
+	t_stat r;
+
+	r = attach_unit (uptr, cptr);
+	if (r != SCPE_OK)
+		return r;
+	memset (drum_dirty, 1, sizeof (drum_dirty));
+	return ckpt_reset (&ckpt_dev);
+}
+
+t_stat ckpt_set_interval (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+	t_stat r;
+	t_value n;
+
+	if (! cptr)
+		return SCPE_ARG;
+	n = get_uint (cptr, 10, 1000000, &r);
+	if (r != SCPE_OK)
+		return r;
+	ckpt_interval = n;
+	return ckpt_reset (&ckpt_dev);
+}
+
+t_stat ckpt_show_interval (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+	if (ckpt_interval)
+		fprintf (st, "interval=%d sec", ckpt_interval);
+	else
+		fprintf (st, "no auto checkpoint");
+	return SCPE_OK;
+}
+
+/*
+ * Контрольная сумма записи.
+ */
+static t_uint64 ckpt_sum (t_uint64 *w, int n)
+{
+	t_uint64 sum = 14695981039346656037ULL;
+
+	while (n-- > 0)
+		sum = (sum ^ *w++) * 1099511628211ULL;
+	return sum;
+}
+
+/*
+ * Запись контрольной точки в конец файла.
+ * Если full ненулевой, записываются все страницы барабана,
+ * иначе только изменённые с прошлой записи в журнал.
+ */
+t_stat ckpt_write (FILE *fd, int full)
+{
+	t_uint64 *w = ckpt_buf;
+	t_uint64 *npages;
+	int page, n;
+
+	*w++ = CKPT_MAGIC;
+	*w++ = 0;				/* длина, заполним в конце */
+	*w++ = RVK;
+	*w++ = RA;
+	*w++ = OMEGA;
+	*w++ = RK;
+	*w++ = RR;
+	*w++ = RMR;
+	*w++ = RPU1;
+	*w++ = RPU2;
+	*w++ = RPU3;
+	*w++ = RPU4;
+	*w++ = ext_op;
+	*w++ = ext_disk_addr;
+	*w++ = ext_ram_start;
+	*w++ = ext_ram_finish;
+	*w++ = cpu_time;
+	*w++ = cpu_icount;
+	*w++ = cpu_unit.flags & UNIT_UFMASK;
+	memcpy (w, M, sizeof (M));
+	w += MEMSIZE;
+
+	/* Имя файла барабана. */
+	memset (w + 1, 0, CKPT_NAMEW * 8);
+	if (drum_unit.flags & UNIT_ATT) {
+		strncpy ((char*) (w + 1), drum_unit.filename, CKPT_NAMEW*8 - 1);
+		*w = (strlen (drum_unit.filename) + 8) / 8;
+	} else
+		*w = 0;
+	w += 1 + *w;
+
+	/* Изменённые страницы барабана. */
+	npages = w++;
+	*npages = 0;
+	if (drum_unit.flags & UNIT_ATT) {
+		for (page=0; page<CKPT_NPAGES; ++page) {
+			if (! full && ! drum_dirty [page])
+				continue;
+			fseek (drum_unit.fileref, page * DRUM_PAGE * 8, SEEK_SET);
+			n = fxread (w + 2, 8, DRUM_PAGE, drum_unit.fileref);
+			if (n <= 0)
+				continue;
+			w[0] = page;
+			w[1] = n;
+			w += 2 + n;
+			++*npages;
+		}
+	}
+	ckpt_buf[1] = w - ckpt_buf + 1;
+	*w = ckpt_sum (ckpt_buf, w - ckpt_buf);
+	++w;
+
+	fseek (fd, 0, SEEK_END);
+	if (fxwrite (ckpt_buf, 8, w - ckpt_buf, fd) != w - ckpt_buf ||
+	    fflush (fd) != 0)
+		return SCPE_IOERR;
+	fsync (fileno (fd));
+	if (sim_deb && ckpt_dev.dctrl)
+		fprintf (sim_deb, "*** контрольная точка: %d слов, %d страниц барабана\n",
+			(int) (w - ckpt_buf), (int) *npages);
+	return SCPE_OK;
+}
+
+/*
+ * Запись очередной точки в журнал.
+ */
+t_stat ckpt_log (void)
+{
+	t_stat r;
+
+	if (! (ckpt_unit.flags & UNIT_ATT))
+		return SCPE_UNATT;
+	r = ckpt_write (ckpt_unit.fileref, 0);
+	if (r != SCPE_OK)
+		return r;
+	memset (drum_dirty, 0, sizeof (drum_dirty));
+	ckpt_last = host_nsec ();
+	++ckpt_count;
+	return SCPE_OK;
+}
+
+/*
+ * Периодическая проверка: не пора ли записать точку.
+ */
+t_stat ckpt_svc (UNIT *uptr)
+{
+	if (! ckpt_interval || ! (uptr->flags & UNIT_ATT))
+		return SCPE_OK;
+	sim_activate (uptr, CKPT_WAIT);
+	if (host_nsec () - ckpt_last < ckpt_interval * 1000000000ULL)
+		return SCPE_OK;
+	return ckpt_log ();
+}
+
+/*
+ * Команда CHECKPOINT [file].
+ */
+t_stat ckpt_cmd (int32 flag, char *cptr)
+{
+	char fname [CBUFSIZE];
+	FILE *fd;
+	t_stat r;
+
+	if (! cptr || ! *cptr)
+		return ckpt_log ();
+
+	cptr = get_glyph_nc (cptr, fname, 0);
+	if (*cptr)
+		return SCPE_2MARG;
+	fd = sim_fopen (fname, "wb");
+	if (! fd)
+		return SCPE_OPENERR;
+	r = ckpt_write (fd, 1);
+	fclose (fd);
+	return r;
+}
+
+/*
+ * Чтение одной записи. Возвращает длину записи в словах,
+ * или 0 в конце файла или при неполной (испорченной) записи.
+ */
+static int ckpt_read (FILE *fd)
+{
+	t_uint64 n;
+
+	if (fxread (ckpt_buf, 8, 2, fd) != 2 ||
+	    ckpt_buf[0] != CKPT_MAGIC)
+		return 0;
+	n = ckpt_buf[1];
+	if (n < 2 + CKPT_NREGS + MEMSIZE + 3 || n > CKPT_MAXW)
+		return 0;
+	if (fxread (ckpt_buf + 2, 8, n - 2, fd) != n - 2)
+		return 0;
+	if (ckpt_buf[n-1] != ckpt_sum (ckpt_buf, n - 1))
+		return 0;
+	return n;
+}
+
+/*
+ * Применение записи: регистры, память, барабан.
+ */
+static t_stat ckpt_apply (void)
+{
+	t_uint64 *w = ckpt_buf + 2;
+	t_uint64 npages, page, n;
+	char *dname;
+	t_stat r;
+
+	RVK = *w++;
+	RA = *w++;
+	OMEGA = *w++;
+	RK = *w++;
+	RR = *w++;
+	RMR = *w++;
+	RPU1 = *w++;
+	RPU2 = *w++;
+	RPU3 = *w++;
+	RPU4 = *w++;
+	ext_op = *w++;
+	ext_disk_addr = *w++;
+	ext_ram_start = *w++;
+	ext_ram_finish = *w++;
+	cpu_time = *w++;
+	cpu_icount = *w++;
+	cpu_unit.flags = (cpu_unit.flags & ~UNIT_UFMASK) | (*w++ & UNIT_UFMASK);
+	memcpy (M, w, sizeof (M));
+	w += MEMSIZE;
+
+	/* Подключаем тот же файл барабана. */
+	dname = (char*) (w + 1);
+	if (*w && (! (drum_unit.flags & UNIT_ATT) ||
+	    strcmp (drum_unit.filename, dname) != 0)) {
+		if (drum_unit.flags & UNIT_ATT)
+			detach_unit (&drum_unit);
+		r = drum_attach (&drum_unit, dname);
+		if (r != SCPE_OK)
+			return r;
+	}
+	w += 1 + *w;
+
+	/* Восстанавливаем страницы барабана. */
+	npages = *w++;
+	while (npages-- > 0) {
+		page = *w++;
+		n = *w++;
+		if (page >= CKPT_NPAGES || n > DRUM_PAGE)
+			return SCPE_FMT;
+		if (drum_unit.flags & UNIT_ATT) {
+			fseek (drum_unit.fileref, page * DRUM_PAGE * 8, SEEK_SET);
+			fxwrite (w, 8, n, drum_unit.fileref);
+		}
+		w += n;
+	}
+	return SCPE_OK;
+}
+
+/*
+ * Команда RECOVER file: последовательно применяются все
+ * полные записи журнала.
+ */
+t_stat recover_cmd (int32 flag, char *cptr)
+{
+	char fname [CBUFSIZE];
+	FILE *fd;
+	t_stat r;
+	int nrec;
+
+	if (! cptr || ! *cptr)
+		return SCPE_2FARG;
+	cptr = get_glyph_nc (cptr, fname, 0);
+	if (*cptr)
+		return SCPE_2MARG;
+	fd = sim_fopen (fname, "rb");
+	if (! fd)
+		return SCPE_OPENERR;
+	nrec = 0;
+	while (ckpt_read (fd) > 0) {
+		r = ckpt_apply ();
+		if (r != SCPE_OK) {
+			fclose (fd);
+			return r;
+		}
+		++nrec;
+	}
+	fclose (fd);
+	if (nrec == 0)
+		return SCPE_FMT;
+	hist_reset ();
+	if (drum_unit.flags & UNIT_ATT)
+		fflush (drum_unit.fileref);
+
+	/* Если восстановлены из своего же журнала, барабан совпадает
+	 * с последней записью в нём. */
+	if ((ckpt_unit.flags & UNIT_ATT) &&
+	    strcmp (ckpt_unit.filename, fname) == 0)
+		memset (drum_dirty, 0, sizeof (drum_dirty));
+	else
+		memset (drum_dirty, 1, sizeof (drum_dirty));
+	if (! sim_quiet)
+		printf ("Восстановлено записей: %d, РВК: %04o\n", nrec, RVK);
+	return SCPE_OK;
+}
@@ -0,0 +1,252 @@
+/*
+ * m20_cov.c: M-20 memory coverage map
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * For every memory cell the simulator counts how many times
+ * an instruction was executed from it, how much simulated time
+ * it took, and how many times the cell was read or written by
+ * instructions and drum transfers. Counting is always on: it costs
+ * one increment per access.
+ *
+ * Commands:
+ *	COVERAGE file	- write the coverage map to file
+ *	COVERAGE RESET	- clear the counters
+ *	LISTING file	- write the annotated source listing
+ *
+ * The map has one line per cell, which was loaded or accessed,
+ * with labels from the as20 symbol table ("; Таблица символов").
+ * The listing uses the as20 line table ("; Таблица строк") to show
+ * execution counts and microseconds against lines of the source.
+ */
+#include "m20_defs.h"
+
+t_uint64 cov_exec [MEMSIZE];		/* выполнено команд */
+t_uint64 cov_read [MEMSIZE];		/* чтений */
+t_uint64 cov_write [MEMSIZE];		/* записей */
+t_uint64 cov_time [MEMSIZE];		/* время выполнения, 0.5 мкс */
+unsigned char cov_loaded [MEMSIZE];	/* загружено командой LOAD */
+
+static t_uint64 cov_copy [4][MEMSIZE];
+
+/*
+ * Учёт обращения к массиву ячеек при обмене с барабаном.
+ */
+void cov_range (t_uint64 *cnt, int first, int last)
+{
+	for (; first <= last && first < MEMSIZE; ++first)
+		++cnt [first];
+}
+
+/*
+ * Сохранение и восстановление счётчиков на время повторного
+ * выполнения при обратном ходе.
+ */
+void cov_save (void)
+{
+	memcpy (cov_copy[0], cov_exec, sizeof (cov_exec));
+	memcpy (cov_copy[1], cov_read, sizeof (cov_read));
+	memcpy (cov_copy[2], cov_write, sizeof (cov_write));
+	memcpy (cov_copy[3], cov_time, sizeof (cov_time));
+}
+
+void cov_restore (void)
+{
+	memcpy (cov_exec, cov_copy[0], sizeof (cov_exec));
+	memcpy (cov_read, cov_copy[1], sizeof (cov_read));
+	memcpy (cov_write, cov_copy[2], sizeof (cov_write));
+	memcpy (cov_time, cov_copy[3], sizeof (cov_time));
+}
+
+/*
+ * Запись карты покрытия.
+ */
+static void cov_print (FILE *fd)
+{
+	int addr, offset, ncode = 0, ndata = 0, nunused = 0;
+	const char *name;
+
+	fprintf (fd, "; Карта покрытия памяти: X - выполнение, R - чтение, W - запись\n");
+	fprintf (fd, "; адрес вид      выполнено        чтений       записей  метка\n");
+	for (addr=1; addr<MEMSIZE; ++addr) {
+		if (! cov_loaded [addr] && ! cov_exec [addr] &&
+		    ! cov_read [addr] && ! cov_write [addr])
+			continue;
+		if (cov_exec [addr])
+			++ncode;
+		else if (cov_read [addr] || cov_write [addr])
+			++ndata;
+		else
+			++nunused;
+		fprintf (fd, "%04o  %c%c%c  %13llu %13llu %13llu", addr,
+			cov_exec [addr] ? 'X' : '-',
+			cov_read [addr] ? 'R' : '-',
+			cov_write [addr] ? 'W' : '-',
+			cov_exec [addr], cov_read [addr], cov_write [addr]);
+		name = m20_symbol (addr, &offset);
+		if (name) {
+			fprintf (fd, "  %s", name);
+			if (offset)
+				fprintf (fd, "+%o", offset);
+		}
+		fprintf (fd, "\n");
+	}
+	fprintf (fd, "; Код: %d, данные: %d, не использовано: %d слов\n",
+		ncode, ndata, nunused);
+}
+
+/*
+ * Команда COVERAGE file | RESET.
+ */
+t_stat cov_cmd (int32 flag, char *cptr)
+{
+	char fname [CBUFSIZE];
+	FILE *fd;
+
+	if (! cptr || ! *cptr)
+		return SCPE_2FARG;
+	cptr = get_glyph_nc (cptr, fname, 0);
+	if (*cptr)
+		return SCPE_2MARG;
+	if (strcmp (fname, "RESET") == 0 || strcmp (fname, "reset") == 0) {
+		memset (cov_exec, 0, sizeof (cov_exec));
+		memset (cov_read, 0, sizeof (cov_read));
+		memset (cov_write, 0, sizeof (cov_write));
+		memset (cov_time, 0, sizeof (cov_time));
+		return SCPE_OK;
+	}
+	fd = sim_fopen (fname, "w");
+	if (! fd)
+		return SCPE_OPENERR;
+	cov_print (fd);
+	fclose (fd);
+	return SCPE_OK;
+}
+
+/*
+ * Открытие исходного файла. Имя в таблице строк задано
+ * относительно каталога, где запускался as20; если так
+ * не находится, ищем рядом с загруженным файлом.
+ */
+static FILE *cov_open_source (char *path)
+{
+	char buf [CBUFSIZE + CBUFSIZE], *dir, *base;
+	FILE *fd;
+	int len;
+
+	fd = fopen (path, "r");
+	if (fd || path[0] == '/')
+		return fd;
+	dir = strrchr (m20_loadfile, '/');
+	if (! dir)
+		return 0;
+	len = dir - m20_loadfile + 1;
+	sprintf (buf, "%.*s%s", len, m20_loadfile, path);
+	fd = fopen (buf, "r");
+	if (fd)
+		return fd;
+	base = strrchr (path, '/');
+	if (! base)
+		return 0;
+	sprintf (buf, "%.*s%s", len, m20_loadfile, base + 1);
+	return fopen (buf, "r");
+}
+
+/*
+ * Листинг одного исходного файла: количество выполнений,
+ * время в микросекундах и доля от общего времени.
+ */
+static void cov_listing (FILE *fd, int file, double total)
+{
+	t_uint64 *exec, *time;
+	unsigned char *code;
+	char buf [512];
+	int addr, line, nlines;
+	FILE *src;
+
+	nlines = 0;
+	for (addr=1; addr<MEMSIZE; ++addr)
+		if (m20_srcline[addr].file == file &&
+		    m20_srcline[addr].line > nlines)
+			nlines = m20_srcline[addr].line;
+	exec = calloc (nlines + 1, sizeof (t_uint64));
+	time = calloc (nlines + 1, sizeof (t_uint64));
+	code = calloc (nlines + 1, 1);
+	if (! exec || ! time || ! code)
+		goto done;
+	for (addr=1; addr<MEMSIZE; ++addr) {
+		line = m20_srcline[addr].line;
+		if (! line || m20_srcline[addr].file != file)
+			continue;
+		code [line] |= 1;
+		if (cov_read [addr] || cov_write [addr])
+			code [line] |= 2;
+		exec [line] += cov_exec [addr];
+		time [line] += cov_time [addr];
+	}
+
+	fprintf (fd, "; %s\n", m20_srcfile [file]);
+	fprintf (fd, ";  выполнено          мкс       %%\n");
+	src = cov_open_source (m20_srcfile [file]);
+	if (! src) {
+		fprintf (fd, "; исходный файл не найден\n");
+		goto done;
+	}
+	for (line=1; fgets (buf, sizeof (buf), src); ++line) {
+		if (line > nlines || ! code [line])
+			fprintf (fd, "%31s", "");
+		else if (! exec [line] && (code [line] & 2))
+			fprintf (fd, "     данные %12s %6s", "", "");
+		else if (! exec [line])
+			fprintf (fd, "%11s %12s %6s", "#####", "", "");
+		else
+			fprintf (fd, "%11llu %12.1f %6.2f", exec [line],
+				time [line] / 2.0, time [line] * 100.0 / total);
+		fprintf (fd, " | %s", buf);
+
+		/* Длинная строка читается по частям, номер строки
+		 * увеличивается только в конце строки. */
+		while (! strchr (buf, '\n') && fgets (buf, sizeof (buf), src))
+			fputs (buf, fd);
+		if (! strchr (buf, '\n'))
+			fprintf (fd, "\n");
+	}
+	fclose (src);
+done:
+	free (exec);
+	free (time);
+	free (code);
+}
+
+/*
+ * Команда LISTING file.
+ */
+t_stat listing_cmd (int32 flag, char *cptr)
+{
+	char fname [CBUFSIZE];
+	double total;
+	int addr, file;
+	FILE *fd;
+
+	if (! cptr || ! *cptr)
+		return SCPE_2FARG;
+	cptr = get_glyph_nc (cptr, fname, 0);
+	if (*cptr)
+		return SCPE_2MARG;
+	if (m20_nsrc == 0) {
+		printf ("Нет таблицы строк в загруженной программе\n");
+		return SCPE_OK;
+	}
+	fd = sim_fopen (fname, "w");
+	if (! fd)
+		return SCPE_OPENERR;
+	total = 0;
+	for (addr=1; addr<MEMSIZE; ++addr)
+		total += cov_time [addr];
+	if (total == 0)
+		total = 1;
+	for (file=0; file<m20_nsrc; ++file)
+		cov_listing (fd, file, total);
+	fclose (fd);
+	return SCPE_OK;
+}
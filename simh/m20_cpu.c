@@ -28,22 +28,138 @@
  *     are in Russian using UTF-8 encoding. It is assumed, that
  *     user locale is UTF-8.
  * 11) A lot of comments in Russian (UTF-8).
+ * 12) Execution times are taken from a per-opcode table of the
+ *     selected machine model (SET CPU M20, M220 or BESM4) and are
+ *     accumulated exactly in half-microseconds, see register ВРЕМЯ
+ *     and SHOW TIME. Only the M-20 table comes from the machine
+ *     description; the M-220 and BESM-4 tables are approximations
+ *     scaled from their rated speed, and SHOW CPU marks them so.
+ * 13) SET CPU PACE slows the simulation down to the speed of a real
+ *     M-20, using the instruction times as a measure. SHOW CPU SPEED
+ *     reports the achieved speed relative to the real machine,
+ *     and host nanoseconds per instruction.
+ * 14) Command CHECKPOINT saves registers, memory and changed drum pages
+ *     into a log attached to CKPT device (automatically every
+ *     SET CKPT INTERVAL seconds); RECOVER restores the last complete
+ *     checkpoint from the log.
+ * 15) Snapshots of the machine state are taken every SET CPU SNAPSHOT
+ *     instructions; RSTEP and RCONT run the program backwards by
+ *     replaying it from the nearest snapshot. Register СЧК counts
+ *     executed instructions.
+ * 16) Every memory cell has counters of execution, reads and writes;
+ *     COVERAGE file writes them as a map with labels from the as20
+ *     symbol table, found by LOAD in the "; Таблица символов" comments.
+ * 17) SET CPU PROFILE tracks subroutine calls (instruction 016 and
+ *     the return through its cell) and attributes simulated and host
+ *     time to routines; PROFILE REPORT and PROFILE FOLDED print it.
+ * 18) LISTING file writes the source of a program assembled by as20
+ *     with execution counts and microseconds per line, using the
+ *     "; Таблица строк" line table.
+ * 19) OPBENCH [file] measures host nanoseconds per instruction
+ *     for every opcode and address modification flags.
+ * 20) SET CPU FASTLOOP skips iterations of loops on the address
+ *     register, which do not depend on each other, adding their
+ *     time and counters in closed form (see m20_loop.c).
+ * 21) SET CPU FUSE executes frequent pairs of adjacent instructions
+ *     as superinstructions; PROFILE PAIRS shows pair statistics,
+ *     FUSE selects the pairs (see m20_fuse.c).
+ * 22) ATTACH METRICS file keeps run metrics (instructions, time,
+ *     stops, drum transfers, printed lines) as JSON or Prometheus
+ *     text, rewritten after every run and periodically during long
+ *     runs (see m20_metr.c).
  */
 #include "m20_defs.h"
 #include <math.h>
-#include <float.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <time.h>
+
+/*
+ * Режим аутентичной скорости: выполнение сверяется с монотонными
+ * часами хоста не после каждой команды, а пачками по PACE_BATCH
+ * микросекунд модельного времени, чтобы не тратить время на
+ * системные вызовы.
+ */
+#define PACE_BATCH	10000			/* мкс между сверками с часами */
+#define PACE_RESYNC	250000			/* допустимое отставание, мкс */
 
 t_value M [MEMSIZE];
 uint32 RVK, RA, OMEGA;
 t_value RK, RR, RMR, RPU1, RPU2, RPU3, RPU4;
-double delay;
+uint32 delay;			/* время текущей команды, 0.5 мкс */
+t_uint64 cpu_time;		/* модельное время, 0.5 мкс */
+t_uint64 cpu_icount;		/* количество выполненных команд */
+const TIMING *timing;		/* таблица времён текущей модели */
+
+/*
+ * Времена выполнения команд в полумикросекундах: базовое время
+ * и добавка на каждый разряд сдвига (для команд сдвига - по модулю
+ * величины сдвига, для остальных n=0). Для М-20 времена взяты
+ * из описания машины. Для М-220 и БЭСМ-4 это оценки, выведенные
+ * из паспортного быстродействия; команды М-220 сверх системы
+ * команд М-20 здесь не выполняются и имеют нулевое время.
+ */
+#define T(base,shift)	{ base, shift }
+
+static const TIMING m20_timing [64] = {
+/* 000 */ T(48,0),  T(59,0),  T(59,0),  T(59,0),  T(272,0), T(140,0), T(123,0), T(48,0),
+/* 010 */ T(0,0),   T(48,0),  T(48,0),  T(48,0),  T(123,3), T(48,0),  T(48,0),  T(0,0),
+/* 020 */ T(48,0),  T(59,0),  T(59,0),  T(59,0),  T(272,0), T(140,0), T(123,0), T(48,0),
+/* 030 */ T(0,0),   T(48,0),  T(48,0),  T(48,0),  T(48,3),  T(48,0),  T(48,0),  T(0,0),
+/* 040 */ T(0,0),   T(59,0),  T(59,0),  T(59,0),  T(550,0), T(140,0), T(123,0), T(48,0),
+/* 050 */ T(48,0),  T(48,0),  T(48,0),  T(48,0),  T(123,3), T(48,0),  T(48,0),  T(0,0),
+/* 060 */ T(0,0),   T(59,0),  T(59,0),  T(59,0),  T(550,0), T(140,0), T(123,0), T(120,0),
+/* 070 */ T(48,0),  T(48,0),  T(48,0),  T(48,0),  T(48,3),  T(48,0),  T(48,0),  T(48,0),
+};
+
+static const TIMING m220_timing [64] = {
+/* 000 */ T(32,0),  T(44,0),  T(44,0),  T(44,0),  T(200,0), T(100,0), T(88,0),  T(32,0),
+/* 010 */ T(0,0),   T(32,0),  T(32,0),  T(32,0),  T(88,2),  T(32,0),  T(32,0),  T(0,0),
+/* 020 */ T(32,0),  T(44,0),  T(44,0),  T(44,0),  T(200,0), T(100,0), T(88,0),  T(32,0),
+/* 030 */ T(0,0),   T(32,0),  T(32,0),  T(32,0),  T(32,2),  T(32,0),  T(32,0),  T(0,0),
+/* 040 */ T(0,0),   T(44,0),  T(44,0),  T(44,0),  T(400,0), T(100,0), T(88,0),  T(32,0),
+/* 050 */ T(32,0),  T(32,0),  T(32,0),  T(32,0),  T(88,2),  T(32,0),  T(32,0),  T(0,0),
+/* 060 */ T(0,0),   T(44,0),  T(44,0),  T(44,0),  T(400,0), T(100,0), T(88,0),  T(88,0),
+/* 070 */ T(32,0),  T(32,0),  T(32,0),  T(32,0),  T(32,2),  T(32,0),  T(32,0),  T(32,0),
+};
+
+static const TIMING besm4_timing [64] = {
+/* 000 */ T(40,0),  T(50,0),  T(50,0),  T(50,0),  T(240,0), T(120,0), T(100,0), T(40,0),
+/* 010 */ T(0,0),   T(40,0),  T(40,0),  T(40,0),  T(100,2), T(40,0),  T(40,0),  T(0,0),
+/* 020 */ T(40,0),  T(50,0),  T(50,0),  T(50,0),  T(240,0), T(120,0), T(100,0), T(40,0),
+/* 030 */ T(0,0),   T(40,0),  T(40,0),  T(40,0),  T(40,2),  T(40,0),  T(40,0),  T(0,0),
+/* 040 */ T(0,0),   T(50,0),  T(50,0),  T(50,0),  T(480,0), T(120,0), T(100,0), T(40,0),
+/* 050 */ T(40,0),  T(40,0),  T(40,0),  T(40,0),  T(100,2), T(40,0),  T(40,0),  T(0,0),
+/* 060 */ T(0,0),   T(50,0),  T(50,0),  T(50,0),  T(480,0), T(120,0), T(100,0), T(100,0),
+/* 070 */ T(40,0),  T(40,0),  T(40,0),  T(40,0),  T(40,2),  T(40,0),  T(40,0),  T(40,0),
+};
+
+#undef T
+
+const TIMING *model_timing [] = {
+	m20_timing, m220_timing, besm4_timing, m20_timing,
+};
+
+static const char *model_name [] = {
+	"М-20", "М-220 (приближённо)", "БЭСМ-4 (приближённо)", "М-20",
+};
+
+t_uint64 pace_usec;		/* модельное время текущего пуска, мкс */
+t_uint64 pace_next;		/* время следующей сверки с часами, мкс */
+t_uint64 pace_start;		/* время хоста в начале пуска, нс */
+t_uint64 speed_usec;		/* всего модельного времени, мкс */
+t_uint64 speed_nsec;		/* всего времени хоста, нс */
+t_uint64 speed_icount;		/* всего выполнено команд */
+int cpu_running;		/* идёт пуск */
+static t_uint64 run_start;	/* время хоста в начале пуска, нс */
+static t_uint64 run_icount;	/* счётчик команд в начале пуска */
 
 t_stat cpu_examine (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat cpu_deposit (t_value val, t_addr addr, UNIT *uptr, int32 sw);
 t_stat cpu_reset (DEVICE *dptr);
+t_stat cpu_show_speed (FILE *st, UNIT *uptr, int32 val, void *desc);
+void cpu_show_time (FILE *st);
 
 /*
  * CPU data structures
@@ -67,10 +183,31 @@ REG cpu_reg[] = {
 	{ "РПУ2", &RPU2,  8, 45, 0, 1 },	/* регистр 2 пульта управления */
 	{ "РПУ3", &RPU3,  8, 45, 0, 1 },	/* регистр 3 пульта управления */
 	{ "РПУ4", &RPU4,  8, 45, 0, 1 },	/* регистр 4 пульта управления */
+	{ "ВРЕМЯ", &cpu_time, 10, 64, 0, 1 },	/* модельное время, 0.5 мкс */
+	{ "СЧК",  &cpu_icount, 10, 64, 0, 1 },	/* счётчик выполненных команд */
 	{ 0 }
 };
 
 MTAB cpu_mod[] = {
+	{ UNIT_MODEL, 0 << UNIT_V_MODEL, "M20",   "M20",   NULL },
+	{ UNIT_MODEL, 1 << UNIT_V_MODEL, "M220 (approximate timing)", "M220", NULL },
+	{ UNIT_MODEL, 2 << UNIT_V_MODEL, "BESM4 (approximate timing)", "BESM4", NULL },
+	{ UNIT_PACE, 0,		"nopace", "NOPACE", NULL },
+	{ UNIT_PACE, UNIT_PACE,	"pace",	  "PACE",   NULL },
+	{ UNIT_PROF, 0,		NULL,	  "NOPROFILE", NULL },
+	{ UNIT_PROF, UNIT_PROF,	"profile", "PROFILE", NULL },
+	{ UNIT_FAST, 0,		NULL,	  "NOFASTLOOP", NULL },
+	{ UNIT_FAST, UNIT_FAST,	"fastloop", "FASTLOOP", NULL },
+	{ UNIT_FUSE, 0,		NULL,	  "NOFUSE", NULL },
+	{ UNIT_FUSE, UNIT_FUSE,	"fuse",	  "FUSE",   NULL },
+	{ MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, "SPEED", NULL,
+		NULL, &cpu_show_speed },
+	{ MTAB_XTD|MTAB_VDV, 0, "SNAPSHOT", "SNAPSHOT",
+		&hist_set_interval, &hist_show_interval },
+	{ MTAB_XTD|MTAB_VDV, 0, NULL, "SNAPMEM",
+		&hist_set_budget, NULL },
+	{ MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, "HISTORY", NULL,
+		NULL, &hist_show },
 	{ 0 }
 };
 
@@ -102,6 +239,8 @@ int32 sim_emax = 1;	/* максимальное количество слов в
 DEVICE *sim_devices[] = {
 	&cpu_dev,
 	&drum_dev,
+	&ckpt_dev,
+	&metr_dev,
 	0
 };
 
@@ -156,6 +295,7 @@ t_stat cpu_deposit (t_value val, t_addr addr, UNIT *uptr, int32 sw)
 	if (addr >= MEMSIZE)
 		return SCPE_NXM;
 	M [addr] = val;
+	hist_touched = 1;
 	return SCPE_OK;
 }
 
@@ -169,6 +309,85 @@ t_stat cpu_reset (DEVICE *dptr)
 	RMR = 0;
 	RR = 0;
 	sim_brk_types = sim_brk_dflt = SWMASK ('E');
+	cpu_time = 0;
+	cpu_icount = 0;
+	hist_reset ();
+	prof_unwind ();
+	speed_usec = 0;
+	speed_nsec = 0;
+	speed_icount = 0;
+	return SCPE_OK;
+}
+
+/*
+ * Время выполнения команды в полумикросекундах.
+ */
+static inline uint32 inst_time (int op, int n)
+{
+	return timing[op].base + timing[op].shift * (n > 0 ? n : -n);
+}
+
+/*
+ * Дополнение к SHOW TIME: точное модельное время.
+ */
+void cpu_show_time (FILE *st)
+{
+	fprintf (st, "Модельное время %s:\t%llu.%d мкс\n",
+		model_name [CPU_MODEL], cpu_time >> 1,
+		(int) (cpu_time & 1) * 5);
+}
+
+/*
+ * Монотонное время хоста в наносекундах.
+ */
+t_uint64 host_nsec (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (t_uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Сверка модельного времени с часами хоста.
+ * Если модель ушла вперёд, засыпаем на разницу.
+ * Если отстала больше чем на PACE_RESYNC (медленный хост,
+ * ожидание консоли), долг прощается, чтобы потом
+ * не навёрстывать его рывком.
+ */
+void pace_sync (void)
+{
+	t_uint64 now, target;
+	struct timespec ts;
+
+	now = host_nsec ();
+	target = pace_start + pace_usec * 1000;
+	if (target > now) {
+		ts.tv_sec = (target - now) / 1000000000;
+		ts.tv_nsec = (target - now) % 1000000000;
+		nanosleep (&ts, 0);
+	} else if (now - target > PACE_RESYNC * 1000LL) {
+		pace_start = now - pace_usec * 1000;
+	}
+	pace_next = pace_usec + PACE_BATCH;
+}
+
+/*
+ * Печать достигнутой скорости относительно настоящей М-20.
+ */
+t_stat cpu_show_speed (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+	fprintf (st, "модельное время %.6f с, время хоста %.9f с, команд %llu",
+		speed_usec / 1e6, speed_nsec / 1e9, speed_icount);
+	if (speed_nsec > 0)
+		fprintf (st, ", скорость %.3f от М-20",
+			speed_usec * 1e3 / speed_nsec);
+	if (cpu_unit.flags & UNIT_PACE)
+		fprintf (st, " (цель 1.000)");
+	if (speed_icount > 0)
+		fprintf (st, ", %.1f нс/команду",
+			(double) speed_nsec / speed_icount);
+	fprintf (st, "\n");
 	return SCPE_OK;
 }
 
@@ -183,6 +402,7 @@ t_value load (int addr)
 	if (addr == 0)
 		return 0;
 
+	++cov_read [addr];
 	val = M [addr];
 	return val;
 }
@@ -196,6 +416,7 @@ void store (int addr, t_value val)
 	if (addr == 0)
 		return;
 
+	++cov_write [addr];
 	M [addr] = val;
 }
 
@@ -702,6 +923,8 @@ t_stat ext_setup (int a1, int a2, int a3)
  */
 t_stat ext_io (int a1, t_value *sum)
 {
+	int n;
+
 	ext_ram_start = a1;
 
 	*sum = 0;
@@ -723,18 +946,29 @@ t_stat ext_io (int a1, t_value *sum)
 		return STOP_TAPEUNSUPP;
 
 	} else if (ext_op & EXT_PRINT) {
+		/* При повторном выполнении печать не повторяется. */
+		if (hist_replay)
+			return 0;
 		/* Печать. Параметр EXT_PUNCH (накопление в буфере без выдачи)
 		 * пока не реализован. */
 		if (ext_op & EXT_DIS_STOP) {
 			/* Восьмеричная печать */
 			print_octal (ext_ram_start, ext_ram_finish);
+			n = 8;
 		} else if (ext_op & EXT_TAPE_FORMAT) {
 			/* Текстовая печать */
 			print_text (ext_ram_start, ext_ram_finish);
+			n = 128;
 		} else {
 			/* Десятичная печать */
 			print_decimal (ext_ram_start, ext_ram_finish);
+			n = 8;
 		}
+		/* По n ячеек в строке. */
+		if (ext_ram_finish > ext_ram_start)
+			metr_print_lines += (ext_ram_finish - ext_ram_start) / n + 1;
+		else
+			++metr_print_lines;
 		return 0;
 
 	} else if (ext_op & EXT_PUNCH) {
@@ -755,7 +989,7 @@ t_stat ext_io (int a1, t_value *sum)
 /*
  * Execute one instruction, contained in register RK.
  */
-t_stat cpu_one_inst ()
+t_stat cpu_one_inst (void)
 {
 	int flags, op, a1, a2, a3, n = 0;
 	t_value x, y;
@@ -786,7 +1020,7 @@ t_stat cpu_one_inst ()
 		RR = load (a1);
 		store (a3, RR);
 		/* Омега не изменяется. */
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 020: /* чтение пультовых тумблеров */
 		switch (a1) {
@@ -800,14 +1034,14 @@ t_stat cpu_one_inst ()
 		}
 		store (a3, RR);
 		/* Омега не изменяется. */
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 015: /* поразрядное сравнение (исключающее или) */
 	case 035: /* поразрядное сравнение с остановом */
 		RR = load (a1) ^ load (a2);
 logop:		store (a3, RR);
 		OMEGA = (RR == 0);
-		delay += 24;
+		delay += inst_time (op, n);
 		if (op == 035 && ! OMEGA)
 			return STOP_ASSERT; /* останов по несовпадению */
 		break;
@@ -823,7 +1057,7 @@ logop:		store (a3, RR);
 addm:		RR = (x & ~MANTISSA) | (y & MANTISSA);
 		store (a3, RR);
 		OMEGA = (y & BIT37) != 0;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 033: /* вычитание команд */
 		x = load (a1);
@@ -835,7 +1069,7 @@ addm:		RR = (x & ~MANTISSA) | (y & MANTISSA);
 addop:		RR = (x & MANTISSA) | (y & ~MANTISSA & WORD);
 		store (a3, RR);
 		OMEGA = (y & BIT46) != 0;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 073: /* вычитание кодов операций */
 		x = load (a1);
@@ -843,7 +1077,7 @@ addop:		RR = (x & MANTISSA) | (y & ~MANTISSA & WORD);
 		goto addop;
 	case 014: /* сдвиг мантиссы по адресу */
 		n = (a1 & 0177) - 64;
-		delay += 61.5 + 1.5 * (n>0 ? n : -n);
+		delay += inst_time (op, n);
 shm:		y = load (a2);
 		RR = (y & ~MANTISSA);
 		if (n > 0)
@@ -855,11 +1089,11 @@ shm:		y = load (a2);
 		break;
 	case 034: /* сдвиг мантиссы по порядку числа */
 		n = (int) (load (a1) >> 36 & 0177) - 64;
-		delay += 24 + 1.5 * (n>0 ? n : -n);
+		delay += inst_time (op, n);
 		goto shm;
 	case 054: /* сдвиг по адресу */
 		n = (a1 & 0177) - 64;
-		delay += 61.5 + 1.5 * (n>0 ? n : -n);
+		delay += inst_time (op, n);
 shift:		RR = load (a2);
 		if (n > 0)
 			RR = (RR << n) & WORD;
@@ -870,7 +1104,7 @@ shift:		RR = load (a2);
 		break;
 	case 074: /* сдвиг по порядку числа */
 		n = (int) (load (a1) >> 36 & 0177) - 64;
-		delay += 24 + 1.5 * (n>0 ? n : -n);
+		delay += inst_time (op, n);
 		goto shift;
 	case 007: /* циклическое сложение */
 		x = load (a1);
@@ -885,7 +1119,7 @@ csum:		if (RR & BIT46)
 		RR |= y & MANTISSA;
 		store (a3, RR);
 		OMEGA = (y & BIT37) != 0;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 027: /* циклическое вычитание */
 		x = load (a1);
@@ -898,7 +1132,7 @@ csum:		if (RR & BIT46)
 		RR = (x & 07777777) << 24 | (x >> 24 & 07777777);
 		store (a3, RR);
 		/* Омега не изменяется. */
-		delay += 60;
+		delay += inst_time (op, n);
 		break;
 	/*
 	 * Операции управления.
@@ -908,32 +1142,32 @@ csum:		if (RR & BIT46)
 		RR = 016000000000000LL | (a1 << 12);
 		store (a3, RR);
 		RVK = a2;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 036: /* передача управления по условию Ω=1 */
 		RR = load (a1);
 		store (a3, RR);
 		if (OMEGA)
 			RVK = a2;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 056: /* передача управления */
 		RR = load (a1);
 		store (a3, RR);
 		RVK = a2;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 076: /* передача управления по условию Ω=0 */
 		RR = load (a1);
 		store (a3, RR);
 		if (! OMEGA)
 			RVK = a2;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 077: /* останов машины */
 		RR = 0;
 		store (a3, RR);
-		delay += 24;
+		delay += inst_time (op, n);
 		/* Если адреса равны 0, считаем что это штатная,
 		 * "хорошая" остановка.*/
 		return STOP_STOP;
@@ -941,49 +1175,49 @@ csum:		if (RR & BIT46)
 		if (RA < a1 && OMEGA)
 			RVK = a2;
 		RA = a3;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 031: /* переход по >= и Ω=1 */
 		if (RA >= a1 && OMEGA)
 			RVK = a2;
 		RA = a3;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 051: /* переход по < и Ω=0 */
 		if (RA < a1 && ! OMEGA)
 			RVK = a2;
 		RA = a3;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 071: /* переход по >= и Ω=0 */
 		if (RA >= a1 && ! OMEGA)
 			RVK = a2;
 		RA = a3;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 012: /* переход по < */
 		if (RA < a1)
 			RVK = a2;
 		RA = a3;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 032: /* переход по >= */
 		if (RA >= a1)
 			RVK = a2;
 		RA = a3;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 052: /* установка регистра адреса адресом */
 		RR = 052000000000000LL | (a1 << 12);
 		store (a3, RR);
 		RA = a2;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 072: /* установка регистра адреса числом */
 		RR = 052000000000000LL | (a1 << 12);
 		store (a3, RR);
 		RA = load (a2) >> 12 & 07777;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 010: /* ввод с перфокарт */
 	case 030: /* ввод с перфокарт без проверки к.суммы */
@@ -993,7 +1227,7 @@ csum:		if (RR & BIT46)
 		err = ext_setup (a1, a2, a3);
 		if (err)
 			return err;
-		delay += 24;
+		delay += inst_time (op, n);
 		return 0;
 	case 070: /* выполнение обращения к внешнему устройству */
 		if (ext_op == 07777) {
@@ -1009,7 +1243,7 @@ csum:		if (RR & BIT46)
 		}
 		if ((ext_op & EXT_WRITE) && ! (ext_op & EXT_DIS_CHECK))
 			store (a3, RR);
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	/*
 	 * Арифметические операции.
@@ -1025,7 +1259,7 @@ add:		err = addition (&RR, x, y, op >> 4 & 1, op >> 5 & 1);
 			return err;
 		store (a3, RR);
 		OMEGA = (RR & SIGN) != 0;
-		delay += 29.5;
+		delay += inst_time (op, n);
 		break;
 	case 002: /* вычитание с округлением и нормализацией */
 	case 022: /* вычитание без округления с нормализацией */
@@ -1052,7 +1286,7 @@ add:		err = addition (&RR, x, y, op >> 4 & 1, op >> 5 & 1);
 			return err;
 		store (a3, RR);
 		OMEGA = (int) (RR >> 36 & 0177) > 0100;
-		delay += 70;
+		delay += inst_time (op, n);
 		break;
 	case 004: /* деление с округлением */
 	case 024: /* деление без округления */
@@ -1063,7 +1297,7 @@ add:		err = addition (&RR, x, y, op >> 4 & 1, op >> 5 & 1);
 			return err;
 		store (a3, RR);
 		OMEGA = (int) (RR >> 36 & 0177) > 0100;
-		delay += 136;
+		delay += inst_time (op, n);
 		break;
 	case 044: /* извлечение корня с округлением */
 	case 064: /* извлечение корня без округления */
@@ -1073,13 +1307,13 @@ add:		err = addition (&RR, x, y, op >> 4 & 1, op >> 5 & 1);
 			return err;
 		store (a3, RR);
 		OMEGA = (int) (RR >> 36 & 0177) > 0100;
-		delay += 275;
+		delay += inst_time (op, n);
 		break;
 	case 047: /* выдача младших разрядов произведения */
 		RR = RMR;
 		store (a3, RR);
 		OMEGA = (RR & MANTISSA) == 0;
-		delay += 24;
+		delay += inst_time (op, n);
 		break;
 	case 006: /* сложение порядка с адресом */
 		n = (a1 & 0177) - 64;
@@ -1089,7 +1323,7 @@ addexp:		err = add_exponent (&RR, y, n);
 			return err;
 		store (a3, RR);
 		OMEGA = (int) (RR >> 36 & 0177) > 0100;
-		delay += 61.5;
+		delay += inst_time (op, n);
 		break;
 	case 026: /* сложение порядков чисел */
 		x = load (a2);
@@ -1111,17 +1345,41 @@ addexp:		err = add_exponent (&RR, y, n);
 }
 
 /*
- * Main instruction fetch/decode loop
+ * Выполнение одной команды по адресу РВК.
  */
-t_stat sim_instr (void)
+t_stat cpu_step (void)
 {
 	t_stat r;
-	int ticks;
+	int addr = RVK;
+
+	++cov_exec [addr];
+	RK = M [RVK];				/* get instruction */
+	RVK += 1;				/* increment RVK */
 
-	/* Restore register state */
-	RVK = RVK & 07777;				/* mask RVK */
-	sim_cancel_step ();				/* defang SCP step */
 	delay = 0;
+	r = cpu_one_inst ();
+
+	cpu_time += delay;			/* exact time, 0.5 us */
+	cov_time [addr] += delay;
+	++cpu_icount;
+	return r;
+}
+
+/*
+ * Main instruction fetch/decode loop
+ */
+t_stat cpu_loop (void)
+{
+	t_stat r;
+	int ticks, half = 0, addr, first, fuse;
+	t_uint64 skip;
+	FUSEFN fn;
+
+	/* Суперкоманды не нужны при отладке и профилировании. */
+	fuse = (cpu_unit.flags & UNIT_FUSE) && ! sim_step &&
+		! (sim_deb && cpu_dev.dctrl) && ! (cpu_unit.flags & UNIT_PROF);
+	if (fuse)
+		fuse_init ();
 
 	/* Main instruction fetch/decode loop */
 	for (;;) {
@@ -1135,31 +1393,114 @@ t_stat sim_instr (void)
 			return STOP_RUNOUT;		/* stop simulation */
 		}
 
+		if (cpu_icount >= hist_next)		/* снимок для обратного хода */
+			hist_save ();
+
 		if (sim_brk_summ &&			/* breakpoint? */
 		    sim_brk_test (RVK, SWMASK ('E'))) {
 			return STOP_IBKPT;		/* stop simulation */
 		}
 
-		RK = M [RVK];				/* get instruction */
 		if (sim_deb && cpu_dev.dctrl) {
 			/*fprintf (sim_deb, "*** (%.0f) %04o: ", sim_gtime(), RVK);*/
 			fprintf (sim_deb, "*** %04o: ", RVK);
-			fprint_sym (sim_deb, RVK, &RK, 0, SWMASK ('M'));
+			fprint_sym (sim_deb, RVK, &M [RVK], 0, SWMASK ('M'));
 			fprintf (sim_deb, "\n");
 		}
-		RVK += 1;				/* increment RVK */
 
-		r = cpu_one_inst ();
+		addr = RVK;
+		if (fuse && addr < MEMSIZE-1 &&		/* суперкоманда? */
+		    (fn = fuse_tab [M[addr] >> 36 & 077] [M[addr+1] >> 36 & 077]) &&
+		    cpu_icount + 1 < hist_next &&
+		    ! (sim_brk_summ && sim_brk_fnd (addr+1))) {
+			first = addr;
+			r = fn (&addr, 2 * (t_int64) sim_interval - half);
+
+			/* Проверка точки останова на второй команде
+			 * сбрасывает признак повтора останова. */
+			if (sim_brk_summ && addr != first)
+				sim_brk_test (addr, SWMASK ('E'));
+		} else
+			r = cpu_step ();
+		if (cpu_unit.flags & UNIT_PROF)		/* профиль подпрограмм */
+			prof_inst (addr);
+
+		half += delay;
+		ticks = half >> 1;			/* clock ticks are 1 us */
+		half &= 1;
+		sim_interval -= ticks;
+		pace_usec += ticks;
+
+		if (! r && RVK <= addr &&		/* переход назад */
+		    (cpu_unit.flags & UNIT_FAST)) {
+			skip = loop_forward (addr, sim_interval > 0 ?
+				2 * (t_uint64) sim_interval : 0);
+			if (skip) {
+				skip += half;
+				half = skip & 1;
+				sim_interval -= skip >> 1;
+				pace_usec += skip >> 1;
+			}
+		}
+
 		if (r)					/* one instr; error? */
 			return r;
 
-		ticks = 1;
-		if (delay > 0)				/* delay to next instr */
-			ticks += delay - DBL_EPSILON;
-		delay -= ticks;				/* count down delay */
-		sim_interval -= ticks;
+		if ((cpu_unit.flags & UNIT_PACE) &&	/* authentic speed */
+		    pace_usec >= pace_next)
+			pace_sync ();
 
 		if (sim_step && (--sim_step <= 0))	/* do step count */
 			return SCPE_STOP;
 	}
 }
+
+t_stat sim_instr (void)
+{
+	t_stat r;
+
+	/* Restore register state */
+	RVK = RVK & 07777;				/* mask RVK */
+	sim_cancel_step ();				/* defang SCP step */
+	timing = model_timing [CPU_MODEL];
+	loop_flush ();
+	hist_start ();				/* снимок, если что-то изменено */
+
+	pace_usec = 0;
+	pace_next = PACE_BATCH;
+	run_start = host_nsec ();
+	pace_start = run_start;
+	run_icount = cpu_icount;
+	cpu_running = 1;
+
+	if (cpu_unit.flags & UNIT_PROF)
+		prof_start ();
+	r = cpu_loop ();
+	if (cpu_unit.flags & UNIT_PROF)
+		prof_stop ();
+	if (cpu_unit.flags & UNIT_PACE)
+		pace_sync ();
+
+	speed_usec += pace_usec;
+	speed_nsec += host_nsec () - run_start;
+	speed_icount += cpu_icount - run_icount;
+	cpu_running = 0;
+	hist_stop ();
+	metr_stop (r);
+	return r;
+}
+
+/*
+ * Итоги всех пусков, включая текущий.
+ */
+void cpu_totals (t_uint64 *usec, t_uint64 *nsec, t_uint64 *icount)
+{
+	*usec = speed_usec;
+	*nsec = speed_nsec;
+	*icount = speed_icount;
+	if (cpu_running) {
+		*usec += pace_usec;
+		*nsec += host_nsec () - run_start;
+		*icount += cpu_icount - run_icount;
+	}
+}
@@ -13,6 +13,7 @@
  */
 #define MEMSIZE		4096			/* memory size */
 #define DRUM_SIZE	040000			/* drum size */
+#define DRUM_PAGE	0400			/* drum page for checkpoints */
 
 /*
  * Simulator stop codes
@@ -73,14 +74,48 @@ enum {
 #define EXT_WRITE	00004   /* 27 - Зп - запись */
 #define EXT_UNIT	00003   /* 26,25 - номер барабана или ленты */
 
+/*
+ * Флаги процессора.
+ */
+#define UNIT_V_PACE	(UNIT_V_UF + 0)		/* режим реальной скорости */
+#define UNIT_PACE	(1 << UNIT_V_PACE)
+
+#define UNIT_V_MODEL	(UNIT_V_UF + 1)		/* модель машины */
+#define UNIT_MODEL	(3 << UNIT_V_MODEL)
+#define CPU_MODEL	((cpu_unit.flags & UNIT_MODEL) >> UNIT_V_MODEL)
+
+#define UNIT_V_PROF	(UNIT_V_UF + 3)		/* профилирование подпрограмм */
+#define UNIT_PROF	(1 << UNIT_V_PROF)
+
+#define UNIT_V_FAST	(UNIT_V_UF + 4)		/* пропуск витков циклов */
+#define UNIT_FAST	(1 << UNIT_V_FAST)
+
+#define UNIT_V_FUSE	(UNIT_V_UF + 5)		/* суперкоманды */
+#define UNIT_FUSE	(1 << UNIT_V_FUSE)
+
 extern uint32 sim_brk_types, sim_brk_dflt, sim_brk_summ; /* breakpoint info */
 extern int32 sim_interval, sim_step;
 extern FILE *sim_deb;
 
+/*
+ * Время выполнения команды: базовое и добавка на разряд сдвига,
+ * в полумикросекундах.
+ */
+typedef struct {
+	uint16 base;
+	uint16 shift;
+} TIMING;
+
 extern UNIT cpu_unit;
+extern const TIMING *timing;
+extern const TIMING *model_timing [];
 extern t_value M [MEMSIZE];
-extern uint32 RVK;
-extern DEVICE drum_dev;
+extern uint32 RVK, RA, OMEGA;
+extern t_value RK, RR, RMR, RPU1, RPU2, RPU3, RPU4;
+extern t_uint64 cpu_time, cpu_icount;
+extern DEVICE cpu_dev, drum_dev, ckpt_dev, metr_dev;
+extern UNIT drum_unit;
+extern unsigned char drum_dirty [DRUM_SIZE / DRUM_PAGE];
 
 /* Параметры обмена с внешним устройством. */
 extern int ext_op;		/* УЧ - условное число */
@@ -93,6 +128,128 @@ extern int ext_ram_finish;	/* ω_МОЗУ - конечный адрес памя
  * Все параметры находятся в регистрах УЧ, А_МЗУ, α_МОЗУ, ω_МОЗУ.
  */
 t_stat drum (t_value *sum);
+t_stat drum_attach (UNIT *uptr, char *cptr);
+void drum_mark_dirty (int addr, int nwords);
+
+t_stat sim_instr (void);
+t_stat cpu_one_inst (void);
+t_stat cpu_step (void);
+void cpu_show_time (FILE *st);
+void cpu_totals (t_uint64 *usec, t_uint64 *nsec, t_uint64 *icount);
+t_uint64 host_nsec (void);
+extern int cpu_running;
+
+/*
+ * Контрольные точки.
+ */
+t_stat ckpt_cmd (int32 flag, char *cptr);
+t_stat recover_cmd (int32 flag, char *cptr);
+
+/*
+ * История выполнения и обратный ход.
+ */
+extern t_uint64 hist_next;
+extern int hist_replay;
+void hist_reset (void);
+void hist_save (void);
+void hist_start (void);
+void hist_stop (void);
+extern int hist_touched;
+void hist_drum_write (int addr, int nwords);
+t_stat rstep_cmd (int32 flag, char *cptr);
+t_stat rcont_cmd (int32 flag, char *cptr);
+t_stat hist_set_interval (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat hist_set_budget (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat hist_show_interval (FILE *st, UNIT *uptr, int32 val, void *desc);
+t_stat hist_show (FILE *st, UNIT *uptr, int32 val, void *desc);
+
+/*
+ * Карта покрытия памяти.
+ */
+extern t_uint64 cov_exec [MEMSIZE], cov_read [MEMSIZE], cov_write [MEMSIZE];
+extern t_uint64 cov_time [MEMSIZE];
+extern unsigned char cov_loaded [MEMSIZE];
+void cov_range (t_uint64 *cnt, int first, int last);
+void cov_save (void);
+void cov_restore (void);
+t_stat cov_cmd (int32 flag, char *cptr);
+t_stat listing_cmd (int32 flag, char *cptr);
+
+/*
+ * Профилирование подпрограмм.
+ */
+extern uint32 delay;
+void prof_start (void);
+void prof_stop (void);
+void prof_unwind (void);
+void prof_inst (int addr);
+t_stat prof_cmd (int32 flag, char *cptr);
+extern t_uint64 prof_pair [64][64];
+
+/*
+ * Пропуск витков циклов по РА.
+ */
+void loop_flush (void);
+t_uint64 loop_forward (int addr, t_uint64 budget);
+
+/*
+ * Суперкоманды: пары команд, выполняемые вместе.
+ * Функция выполняет пару по адресу *addr, если до следующего
+ * события остаётся больше limit полумикросекунд, иначе одну
+ * команду. В *addr возвращается адрес последней выполненной
+ * команды, в delay - общее время.
+ */
+typedef t_stat (*FUSEFN) (int *addr, t_int64 limit);
+extern FUSEFN fuse_tab [64][64];
+void fuse_init (void);
+int fuse_mark (int op1, int op2);
+t_stat fuse_cmd (int32 flag, char *cptr);
+
+/*
+ * Замер стоимости команд.
+ */
+extern t_uint64 speed_usec, speed_nsec, speed_icount;
+t_stat opbench_cmd (int32 flag, char *cptr);
+
+/*
+ * Метрики работы: счётчики и запись в файл METRICS.
+ */
+extern t_uint64 metr_drum_reads, metr_drum_writes;
+extern t_uint64 metr_drum_rwords, metr_drum_wwords;
+extern t_uint64 metr_print_lines;
+extern int metr_hold;
+void metr_stop (t_stat r);
+t_stat metr_write (char *fname);
+t_stat metr_cmd (int32 flag, char *cptr);
+
+/*
+ * Метка программы из таблицы символов as20.
+ */
+typedef struct {
+	int addr;
+	char name [64];
+} SYMBOL;
+
+extern SYMBOL *m20_sym;
+extern int m20_nsym;
+const char *m20_symbol (int addr, int *offset);
+
+/*
+ * Строка исходного текста из таблицы строк as20.
+ */
+#define M20_MAXSRC	64		/* макс. исходных файлов */
+
+typedef struct {
+	int file;			/* номер исходного файла */
+	int line;			/* номер строки, 0 - нет */
+} SRCLINE;
+
+extern char *m20_srcfile [M20_MAXSRC];
+extern int m20_nsrc;
+extern SRCLINE m20_srcline [MEMSIZE];
+extern char m20_loadfile [CBUFSIZE];
+
+extern const char *m20_opname [64];
 
 t_stat fprint_sym (FILE *of, t_addr addr, t_value *val,
 	UNIT *uptr, int32 sw);
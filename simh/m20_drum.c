@@ -17,6 +17,11 @@ int ext_disk_addr;		/* А_МЗУ - начальный адрес на бараб
 int ext_ram_start;		/* α_МОЗУ - начальный адрес памяти */
 int ext_ram_finish;		/* ω_МОЗУ - конечный адрес памяти */
 
+/*
+ * Страницы барабана, изменённые с момента последней контрольной точки.
+ */
+unsigned char drum_dirty [DRUM_SIZE / DRUM_PAGE];
+
 /*
  * DRUM data structures
  *
@@ -41,12 +46,14 @@ MTAB drum_mod[] = {
 };
 
 t_stat drum_reset (DEVICE *dptr);
+t_stat drum_attach (UNIT *uptr, char *cptr);
+t_stat drum_detach (UNIT *uptr);
 
 DEVICE drum_dev = {
 	"DRUM", &drum_unit, drum_reg, drum_mod,
 	1, 8, 12, 1, 8, 45,
 	NULL, NULL, &drum_reset,
-	NULL, NULL, NULL, NULL,
+	NULL, &drum_attach, &drum_detach, NULL,
 	DEV_DISABLE | DEV_DEBUG
 };
 
@@ -63,6 +70,49 @@ t_stat drum_reset (DEVICE *dptr)
 	return SCPE_OK;
 }
 
+/*
+ * Подключение файла барабана. Содержимое нового файла целиком
+ * считается изменённым и попадёт в следующую контрольную точку.
+ * Снимки истории относятся к прежнему файлу и забываются:
+ * откат по ним испортил бы новый барабан.
+ */
+t_stat drum_attach (UNIT *uptr, char *cptr)
+{
+	t_stat r;
+
+	r = attach_unit (uptr, cptr);
+	if (r == SCPE_OK) {
+		memset (drum_dirty, 1, sizeof (drum_dirty));
+		hist_reset ();
+	}
+	return r;
+}
+
+/*
+ * Отключение файла барабана, история тоже забывается.
+ */
+t_stat drum_detach (UNIT *uptr)
+{
+	t_stat r;
+
+	r = detach_unit (uptr);
+	if (r == SCPE_OK)
+		hist_reset ();
+	return r;
+}
+
+/*
+ * Отметка страниц барабана, затронутых записью nwords слов с адреса addr.
+ */
+void drum_mark_dirty (int addr, int nwords)
+{
+	int page;
+
+	for (page = addr / DRUM_PAGE; page <= (addr + nwords - 1) / DRUM_PAGE &&
+	    page < DRUM_SIZE / DRUM_PAGE; ++page)
+		drum_dirty [page] = 1;
+}
+
 /*
  * Подсчет контрольной суммы, как в команде СЛЦ.
  */
@@ -96,6 +146,10 @@ t_stat drum_write (int addr, int first, int last, t_value *sum)
 	if (sim_deb && drum_dev.dctrl)
 		fprintf (sim_deb, "*** запись МБ %05o память %04o-%04o\n",
 			addr, first, last);
+	/* Контрольная сумма занимает ещё одно слово за массивом. */
+	hist_drum_write (addr, nwords + (sum != 0));
+	cov_range (cov_read, first, last);
+	drum_mark_dirty (addr, nwords + (sum != 0));
 	fseek (drum_unit.fileref, addr*8, SEEK_SET);
 	fxwrite (&M[first], 8, nwords, drum_unit.fileref);
 	if (ferror (drum_unit.fileref))
@@ -130,6 +184,7 @@ t_stat drum_read (int addr, int first, int last, t_value *sum)
 	i = fxread (&M[first], 8, nwords, drum_unit.fileref);
 	if (ferror (drum_unit.fileref))
 		return SCPE_IOERR;
+	cov_range (cov_write, first, first + i - 1);
 	if (i != nwords) {
 		/* Чтение неинициализированного барабана */
 		return STOP_DRUMINVDATA;
@@ -152,17 +207,28 @@ t_stat drum_read (int addr, int first, int last, t_value *sum)
  */
 t_stat drum (t_value *sum)
 {
+	t_stat r;
+
 	if ((drum_dev.flags & DEV_DIS) || ! drum_unit.fileref) {
 		/* Device not attached. */
 		return SCPE_UNATT;
 	}
 	if (ext_op & EXT_WRITE) {
-		return drum_write ((ext_op & EXT_UNIT) << 12 | ext_disk_addr,
+		r = drum_write ((ext_op & EXT_UNIT) << 12 | ext_disk_addr,
 			ext_ram_start, ext_ram_finish,
 			(ext_op & EXT_DIS_CHECK) ? 0 : sum);
+		if (r == 0 && ! hist_replay) {
+			++metr_drum_writes;
+			metr_drum_wwords += ext_ram_finish - ext_ram_start + 1;
+		}
 	} else {
-		return drum_read ((ext_op & EXT_UNIT) << 12 | ext_disk_addr,
+		r = drum_read ((ext_op & EXT_UNIT) << 12 | ext_disk_addr,
 		    ext_ram_start, ext_ram_finish,
 		    (ext_op & EXT_DIS_CHECK) ? 0 : sum);
+		if (r == 0 && ! hist_replay) {
+			++metr_drum_reads;
+			metr_drum_rwords += ext_ram_finish - ext_ram_start + 1;
+		}
 	}
+	return r;
 }
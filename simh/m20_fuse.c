@@ -0,0 +1,334 @@
+/*
+ * m20_fuse.c: M-20 superinstructions
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * A superinstruction executes two instructions from adjacent cells
+ * in one pass of the main loop, with the first (and for some pairs
+ * the second) instruction decoded and executed inline, without the
+ * general opcode switch. Implemented pairs:
+ *	- logical operation or addition of commands, followed by
+ *	  transfer of control (015, 055, 075, 013, 033, 053, 073 and
+ *	  036, 056, 076): test and branch;
+ *	- setting of the address register (052, 072), followed by any
+ *	  instruction, usually with modified addresses;
+ *	- two moves (000 000).
+ * Each instruction of a pair updates РК, РР, Ω, time, counters and
+ * coverage exactly as when executed alone. The second instruction
+ * is not executed in the same pass, when the first one stops the
+ * machine, jumps, changes the second cell, or uses up the time
+ * before the next event. Pairs are not fused at a breakpoint on the
+ * second cell, before a reverse execution snapshot, and not at all
+ * during single steps, debug trace and profiling.
+ *
+ * Which pairs are fused, is chosen from the pair statistics
+ * collected by the profiler (PROFILE PAIRS).
+ *
+ * Commands:
+ *	SET CPU FUSE		- enable superinstructions
+ *	FUSE			- list fused pairs
+ *	FUSE n			- fuse n most frequent pairs from the profile
+ *	FUSE ALL		- fuse all implemented pairs
+ */
+#include "m20_defs.h"
+
+static FUSEFN fuse_impl [64][64];	/* реализованные суперкоманды */
+FUSEFN fuse_tab [64][64];		/* включённые суперкоманды */
+static int fuse_ready;
+
+/*
+ * Чтение и запись памяти, как load() и store().
+ */
+static inline t_value fuse_load (int addr)
+{
+	if (addr == 0)
+		return 0;
+	++cov_read [addr];
+	return M [addr];
+}
+
+static inline void fuse_store (int addr, t_value val)
+{
+	if (addr == 0)
+		return;
+	++cov_write [addr];
+	M [addr] = val;
+}
+
+/*
+ * Выборка команды из ячейки addr: РК, код операции и адреса
+ * с модификацией по РА.
+ */
+#define FETCH(addr, op, a1, a2, a3) {			\
+	int flags;					\
+	++cov_exec [addr];				\
+	RK = M [addr];					\
+	RVK = (addr) + 1;				\
+	flags = RK >> 42 & 7;				\
+	op = RK >> 36 & 077;				\
+	a1 = RK >> 24 & 07777;				\
+	a2 = RK >> 12 & 07777;				\
+	a3 = RK & 07777;				\
+	if (flags & 4) a1 = (a1 + RA) & 07777;		\
+	if (flags & 2) a2 = (a2 + RA) & 07777;		\
+	if (flags & 1) a3 = (a3 + RA) & 07777;		\
+	}
+
+/*
+ * Конец команды по адресу addr, выполненной за время t.
+ */
+#define RETIRE(addr, t) {				\
+	cpu_time += t;					\
+	cov_time [addr] += t;				\
+	++cpu_icount;					\
+	ext_op = 07777;					\
+	}
+
+/*
+ * Можно ли выполнить вторую команду пары после первой,
+ * занявшей t полумикросекунд: управление перешло к ней,
+ * её ячейка не изменилась, событие ещё не наступило.
+ */
+#define CONTINUE(addr, word, t, limit) \
+	(RVK == (addr) + 1 && M [(addr) + 1] == (word) && (t) < (limit))
+
+/*
+ * Логическая операция или сложение команд.
+ */
+static inline void fuse_logic (int op, int a1, int a2, int a3)
+{
+	t_value x, y;
+
+	switch (op) {
+	case 015: /* поразрядное сравнение */
+		RR = fuse_load (a1) ^ fuse_load (a2);
+		OMEGA = (RR == 0);
+		break;
+	case 055: /* логическое умножение */
+		RR = fuse_load (a1) & fuse_load (a2);
+		OMEGA = (RR == 0);
+		break;
+	case 075: /* логическое сложение */
+		RR = fuse_load (a1) | fuse_load (a2);
+		OMEGA = (RR == 0);
+		break;
+	case 013: /* сложение команд */
+	case 033: /* вычитание команд */
+		x = fuse_load (a1);
+		y = fuse_load (a2) & MANTISSA;
+		y = (op == 013) ? (x & MANTISSA) + y : (x & MANTISSA) - y;
+		RR = (x & ~MANTISSA) | (y & MANTISSA);
+		OMEGA = (y & BIT37) != 0;
+		break;
+	case 053: /* сложение кодов операций */
+	case 073: /* вычитание кодов операций */
+		x = fuse_load (a1);
+		y = fuse_load (a2) & ~MANTISSA;
+		y = (op == 053) ? (x & ~MANTISSA) + y : (x & ~MANTISSA) - y;
+		RR = (x & MANTISSA) | (y & ~MANTISSA & WORD);
+		OMEGA = (y & BIT46) != 0;
+		break;
+	}
+	fuse_store (a3, RR);
+}
+
+/*
+ * Передача управления 036, 056, 076.
+ */
+static inline void fuse_jump (int op, int a1, int a2, int a3)
+{
+	RR = fuse_load (a1);
+	fuse_store (a3, RR);
+	if (op == 056 || (op == 036 ? OMEGA : ! OMEGA))
+		RVK = a2;
+}
+
+/*
+ * Логическая операция и переход.
+ */
+static t_stat fuse_logic_jump (int *addr, t_int64 limit)
+{
+	int a = *addr, op, a1, a2, a3;
+	t_value next = M [a+1];
+	uint32 t1, t2;
+
+	FETCH (a, op, a1, a2, a3);
+	fuse_logic (op, a1, a2, a3);
+	t1 = timing[op].base;
+	RETIRE (a, t1);
+	delay = t1;
+	if (! CONTINUE (a, next, t1, limit))
+		return 0;
+
+	*addr = ++a;
+	FETCH (a, op, a1, a2, a3);
+	fuse_jump (op, a1, a2, a3);
+	t2 = timing[op].base;
+	RETIRE (a, t2);
+	delay += t2;
+	return 0;
+}
+
+/*
+ * Установка регистра адреса и любая команда.
+ */
+static t_stat fuse_setra (int *addr, t_int64 limit)
+{
+	int a = *addr, op, a1, a2, a3;
+	t_value next = M [a+1];
+	uint32 t1;
+	t_stat r;
+
+	FETCH (a, op, a1, a2, a3);
+	RR = 052000000000000LL | (a1 << 12);
+	fuse_store (a3, RR);
+	RA = (op == 052) ? a2 : fuse_load (a2) >> 12 & 07777;
+	t1 = timing[op].base;
+	RETIRE (a, t1);
+	delay = t1;
+	if (! CONTINUE (a, next, t1, limit))
+		return 0;
+
+	/* Вторая команда - обычным порядком. */
+	*addr = ++a;
+	++cov_exec [a];
+	RK = next;
+	RVK = a + 1;
+	delay = 0;
+	r = cpu_one_inst ();
+	cpu_time += delay;
+	cov_time [a] += delay;
+	++cpu_icount;
+	delay += t1;
+	return r;
+}
+
+/*
+ * Две пересылки.
+ */
+static t_stat fuse_move_move (int *addr, t_int64 limit)
+{
+	int a = *addr, op, a1, a2, a3;
+	t_value next = M [a+1];
+	uint32 t;
+
+	FETCH (a, op, a1, a2, a3);
+	RR = fuse_load (a1);
+	fuse_store (a3, RR);
+	t = timing[op].base;
+	RETIRE (a, t);
+	delay = t;
+	if (! CONTINUE (a, next, t, limit))
+		return 0;
+
+	*addr = ++a;
+	FETCH (a, op, a1, a2, a3);
+	RR = fuse_load (a1);
+	fuse_store (a3, RR);
+	RETIRE (a, t);
+	delay += t;
+	return 0;
+}
+
+/*
+ * Таблица реализованных суперкоманд; сначала включены все.
+ */
+void fuse_init (void)
+{
+	static const int logic [] = { 015, 055, 075, 013, 033, 053, 073 };
+	static const int jump [] = { 036, 056, 076 };
+	int i, j;
+
+	if (fuse_ready)
+		return;
+	for (i=0; i<7; ++i)
+		for (j=0; j<3; ++j)
+			fuse_impl [logic[i]] [jump[j]] = fuse_logic_jump;
+	for (j=0; j<64; ++j) {
+		/* Ввод-вывод и останов - без объединения. */
+		if (j == 050 || j == 070 || j == 077)
+			continue;
+		fuse_impl [052] [j] = fuse_setra;
+		fuse_impl [072] [j] = fuse_setra;
+	}
+	fuse_impl [000] [000] = fuse_move_move;
+	memcpy (fuse_tab, fuse_impl, sizeof (fuse_tab));
+	fuse_ready = 1;
+}
+
+/*
+ * Отметка пары для отчёта PROFILE PAIRS.
+ */
+int fuse_mark (int op1, int op2)
+{
+	fuse_init ();
+	if (fuse_tab [op1] [op2])
+		return '+';
+	if (fuse_impl [op1] [op2])
+		return '*';
+	return ' ';
+}
+
+static int compare_count (const void *a, const void *b)
+{
+	t_uint64 x = prof_pair [*(const int*) a >> 6] [*(const int*) a & 077];
+	t_uint64 y = prof_pair [*(const int*) b >> 6] [*(const int*) b & 077];
+
+	return x < y ? 1 : x > y ? -1 : *(const int*) a - *(const int*) b;
+}
+
+/*
+ * Команда FUSE [n | ALL].
+ */
+t_stat fuse_cmd (int32 flag, char *cptr)
+{
+	static int order [64*64];
+	char gbuf [CBUFSIZE];
+	int i, p, n, npairs;
+	t_stat r;
+
+	fuse_init ();
+	if (cptr && *cptr) {
+		cptr = get_glyph (cptr, gbuf, 0);
+		if (*cptr)
+			return SCPE_2MARG;
+		if (strcmp (gbuf, "ALL") == 0) {
+			memcpy (fuse_tab, fuse_impl, sizeof (fuse_tab));
+		} else {
+			n = (int) get_uint (gbuf, 10, 64*64, &r);
+			if (r != SCPE_OK)
+				return SCPE_ARG;
+
+			/* Самые частые пары, для которых есть суперкоманда. */
+			npairs = 0;
+			for (p=0; p<64*64; ++p)
+				if (fuse_impl [p >> 6] [p & 077] &&
+				    prof_pair [p >> 6] [p & 077])
+					order [npairs++] = p;
+			if (npairs == 0) {
+				printf ("Нет статистики пар: SET CPU PROFILE и запуск программы\n");
+				return SCPE_OK;
+			}
+			qsort (order, npairs, sizeof (int), compare_count);
+			memset (fuse_tab, 0, sizeof (fuse_tab));
+			for (i=0; i<n && i<npairs; ++i) {
+				p = order [i];
+				fuse_tab [p >> 6] [p & 077] =
+					fuse_impl [p >> 6] [p & 077];
+			}
+		}
+	}
+
+	/* Список включённых пар. */
+	n = 0;
+	for (p=0; p<64*64; ++p) {
+		if (! fuse_tab [p >> 6] [p & 077])
+			continue;
+		printf ("%s%02o %02o", (n % 8) ? "   " : n ? "\n" : "",
+			p >> 6, p & 077);
+		++n;
+	}
+	printf ("%sСуперкоманд: %d%s\n", n ? "\n" : "", n,
+		(cpu_unit.flags & UNIT_FUSE) ? "" : " (выключены, SET CPU FUSE)");
+	return SCPE_OK;
+}
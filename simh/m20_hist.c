@@ -0,0 +1,492 @@
+/*
+ * m20_hist.c: M-20 execution history and reverse execution
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * Every SET CPU SNAPSHOT=n instructions the simulator keeps
+ * a snapshot of the memory and registers in host memory. Before
+ * the first write to a drum page after a snapshot, the old contents
+ * of the page is saved in the undo log of that snapshot.
+ * Snapshots keep the console switches РПУ1-РПУ4 and the machine
+ * model too. At the start of a run, a snapshot is taken only when
+ * memory, registers, switches or model were changed from the console
+ * since the last stop.
+ *
+ * To get back to an earlier instruction count, the drum is rolled back
+ * by undo logs, the nearest previous snapshot is restored, and
+ * the program is replayed forward up to the target. Replay is
+ * deterministic: there are no interrupts in M-20, printer output
+ * is suppressed and breakpoints are ignored. Coverage counters
+ * are not affected by replay.
+ *
+ * Total size of snapshots is limited by SET CPU SNAPMEM=n (megabytes);
+ * the oldest snapshots are discarded when the limit is exceeded.
+ *
+ * Commands:
+ *	RSTEP [n]	- step back n instructions (1 by default)
+ *	RCONT		- run back to the previous breakpoint
+ */
+#include "m20_defs.h"
+#include <unistd.h>
+
+#define HIST_NPAGES	(DRUM_SIZE / DRUM_PAGE)
+
+extern REG *sim_PC;
+extern t_bool sim_brk_pend [];
+extern t_addr sim_brk_ploc [];
+
+/*
+ * Старое содержимое страницы барабана.
+ */
+typedef struct _hpage {
+	struct _hpage *next;
+	int page;			/* номер страницы */
+	int nwords;			/* сколько слов было в файле */
+	t_value data [DRUM_PAGE];
+} HPAGE;
+
+/*
+ * Регистры процессора, пульта и режим работы.
+ */
+typedef struct {
+	t_uint64 icount;		/* номер команды */
+	t_uint64 time;			/* модельное время */
+	uint32 rvk, ra, omega;
+	t_value rk, rr, rmr;
+	t_value rpu [4];		/* регистры пульта управления */
+	int32 model;			/* модель машины */
+	int ext_op, ext_disk_addr, ext_ram_start, ext_ram_finish;
+} HREGS;
+
+/*
+ * Снимок состояния машины.
+ */
+typedef struct {
+	HREGS r;
+	uint32 drum_bytes;		/* длина файла барабана */
+	t_uint64 mask;			/* сохранённые страницы барабана */
+	HPAGE *undo;			/* журнал отката барабана */
+	t_value mem [MEMSIZE];
+} SNAP;
+
+uint32 hist_interval = 100000;		/* период снимков, команд */
+uint32 hist_budget = 32;		/* предел памяти, мегабайт */
+t_uint64 hist_next = ~0ULL;		/* номер команды следующего снимка */
+int hist_replay;			/* идёт повторное выполнение */
+
+static SNAP **hist_snap;		/* снимки, от старых к новым */
+static int hist_count;
+static int hist_alloc;
+static t_uint64 hist_mem;		/* занято памяти, байт */
+static HREGS hist_stop_regs;		/* состояние при последнем останове */
+static int hist_stopped;		/* hist_stop_regs действительны */
+int hist_touched;			/* память изменена с пульта */
+
+/*
+ * Сохранение и восстановление регистров.
+ */
+static void hist_get_regs (HREGS *r)
+{
+	memset (r, 0, sizeof (*r));
+	r->icount = cpu_icount;
+	r->time = cpu_time;
+	r->rvk = RVK;
+	r->ra = RA;
+	r->omega = OMEGA;
+	r->rk = RK;
+	r->rr = RR;
+	r->rmr = RMR;
+	r->rpu[0] = RPU1;
+	r->rpu[1] = RPU2;
+	r->rpu[2] = RPU3;
+	r->rpu[3] = RPU4;
+	r->model = cpu_unit.flags & UNIT_MODEL;
+	r->ext_op = ext_op;
+	r->ext_disk_addr = ext_disk_addr;
+	r->ext_ram_start = ext_ram_start;
+	r->ext_ram_finish = ext_ram_finish;
+}
+
+static void hist_set_regs (const HREGS *r)
+{
+	cpu_icount = r->icount;
+	cpu_time = r->time;
+	RVK = r->rvk;
+	RA = r->ra;
+	OMEGA = r->omega;
+	RK = r->rk;
+	RR = r->rr;
+	RMR = r->rmr;
+	RPU1 = r->rpu[0];
+	RPU2 = r->rpu[1];
+	RPU3 = r->rpu[2];
+	RPU4 = r->rpu[3];
+	cpu_unit.flags = (cpu_unit.flags & ~UNIT_MODEL) | r->model;
+	timing = model_timing [CPU_MODEL];
+	ext_op = r->ext_op;
+	ext_disk_addr = r->ext_disk_addr;
+	ext_ram_start = r->ext_ram_start;
+	ext_ram_finish = r->ext_ram_finish;
+}
+
+/*
+ * Освобождение журнала отката.
+ */
+static void hist_free_undo (SNAP *s)
+{
+	HPAGE *hp;
+
+	while (s->undo) {
+		hp = s->undo;
+		s->undo = hp->next;
+		free (hp);
+		hist_mem -= sizeof (HPAGE);
+	}
+	s->mask = 0;
+}
+
+/*
+ * Удаление самого старого снимка.
+ */
+static void hist_drop_oldest (void)
+{
+	hist_free_undo (hist_snap[0]);
+	free (hist_snap[0]);
+	hist_mem -= sizeof (SNAP);
+	--hist_count;
+	memmove (hist_snap, hist_snap + 1, hist_count * sizeof (SNAP*));
+}
+
+/*
+ * Забыть всю историю.
+ */
+void hist_reset (void)
+{
+	while (hist_count > 0)
+		hist_drop_oldest ();
+	hist_next = hist_interval ? cpu_icount : ~0ULL;
+	hist_stopped = 0;
+}
+
+/*
+ * Снимок текущего состояния.
+ */
+void hist_save (void)
+{
+	SNAP *s;
+
+	if (hist_count > 0 && hist_snap[hist_count-1]->r.icount == cpu_icount) {
+		/* Команды не выполнялись, но пользователь мог
+		 * изменить память или регистры. */
+		s = hist_snap[hist_count-1];
+	} else {
+		if (hist_count >= hist_alloc) {
+			SNAP **p = realloc (hist_snap,
+				(hist_alloc + 64) * sizeof (SNAP*));
+			if (! p) {
+				hist_next = ~0ULL;
+				return;
+			}
+			hist_snap = p;
+			hist_alloc += 64;
+		}
+		s = malloc (sizeof (SNAP));
+		if (! s) {
+			hist_next = ~0ULL;
+			return;
+		}
+		s->mask = 0;
+		s->undo = 0;
+		hist_snap [hist_count++] = s;
+		hist_mem += sizeof (SNAP);
+	}
+	hist_get_regs (&s->r);
+	s->drum_bytes = (drum_unit.flags & UNIT_ATT) ?
+		sim_fsize (drum_unit.fileref) : 0;
+	memcpy (s->mem, M, sizeof (M));
+
+	hist_next = hist_interval ? cpu_icount + hist_interval : ~0ULL;
+	while (hist_count > 1 && hist_mem > (t_uint64) hist_budget << 20)
+		hist_drop_oldest ();
+}
+
+/*
+ * Начало пуска. Если с последнего останова не изменились ни память,
+ * ни регистры, ни пульт, ни режим, снимок не нужен: повтор от
+ * предыдущего снимка придёт в то же состояние.
+ */
+void hist_start (void)
+{
+	HREGS r;
+
+	if (hist_next == ~0ULL)
+		return;
+	hist_get_regs (&r);
+	if (hist_count == 0 || ! hist_stopped || hist_touched ||
+	    memcmp (&r, &hist_stop_regs, sizeof (r)) != 0)
+		hist_save ();
+}
+
+/*
+ * Останов: запоминаем состояние для сравнения при следующем пуске.
+ */
+void hist_stop (void)
+{
+	hist_get_regs (&hist_stop_regs);
+	hist_stopped = 1;
+	hist_touched = 0;
+}
+
+/*
+ * Перед записью на барабан: сохраняем старое содержимое страниц,
+ * если они ещё не сохранены после последнего снимка.
+ */
+void hist_drum_write (int addr, int nwords)
+{
+	SNAP *s;
+	HPAGE *hp;
+	int page;
+
+	if (hist_count == 0)
+		return;
+	s = hist_snap [hist_count-1];
+	for (page = addr / DRUM_PAGE; page <= (addr + nwords - 1) / DRUM_PAGE &&
+	    page < HIST_NPAGES; ++page) {
+		if (s->mask >> page & 1)
+			continue;
+		hp = malloc (sizeof (HPAGE));
+		if (! hp)
+			return;
+		hp->page = page;
+		fseek (drum_unit.fileref, page * DRUM_PAGE * 8, SEEK_SET);
+		hp->nwords = fxread (hp->data, 8, DRUM_PAGE, drum_unit.fileref);
+		if (hp->nwords < 0)
+			hp->nwords = 0;
+		hp->next = s->undo;
+		s->undo = hp;
+		s->mask |= 1ULL << page;
+		hist_mem += sizeof (HPAGE);
+	}
+}
+
+/*
+ * Возврат к снимку с номером k. Барабан откатывается журналами
+ * всех более новых снимков, сами эти снимки удаляются.
+ */
+static void hist_restore (int k)
+{
+	SNAP *s = 0;
+	HPAGE *hp;
+	int i;
+
+	for (i = hist_count-1; i >= k; --i) {
+		s = hist_snap[i];
+		for (hp = s->undo; hp; hp = hp->next) {
+			if (! (drum_unit.flags & UNIT_ATT))
+				continue;
+			fseek (drum_unit.fileref, hp->page * DRUM_PAGE * 8, SEEK_SET);
+			fxwrite (hp->data, 8, hp->nwords, drum_unit.fileref);
+			drum_mark_dirty (hp->page * DRUM_PAGE, DRUM_PAGE);
+		}
+		hist_free_undo (s);
+		if (i > k) {
+			free (s);
+			hist_mem -= sizeof (SNAP);
+		}
+	}
+	hist_count = k + 1;
+	if (drum_unit.flags & UNIT_ATT) {
+		fflush (drum_unit.fileref);
+		if (sim_fsize (drum_unit.fileref) > s->drum_bytes)
+			ftruncate (fileno (drum_unit.fileref), s->drum_bytes);
+	}
+
+	hist_set_regs (&s->r);
+	memcpy (M, s->mem, sizeof (M));
+	hist_next = hist_interval ? cpu_icount + hist_interval : ~0ULL;
+}
+
+/*
+ * Повторное выполнение до команды с номером target.
+ * Если save ненулевой, по пути делаются снимки.
+ * Если bkpt ненулевой, туда заносится номер последней команды,
+ * стоящей на точке останова.
+ */
+static t_stat hist_run (t_uint64 target, int save, t_uint64 *bkpt)
+{
+	BRKTAB *bp;
+	t_stat r = SCPE_OK;
+
+	hist_replay = 1;
+	cov_save ();
+	while (cpu_icount < target) {
+		if (RVK >= MEMSIZE) {
+			r = STOP_RUNOUT;
+			break;
+		}
+		if (save && cpu_icount >= hist_next)
+			hist_save ();
+		if (bkpt && sim_brk_summ && (bp = sim_brk_fnd (RVK)) &&
+		    (bp->typ & SWMASK ('E')))
+			*bkpt = cpu_icount;
+		r = cpu_step ();
+		if (r)
+			break;
+	}
+	cov_restore ();
+	hist_replay = 0;
+	if (cpu_icount < target) {
+		/* Расхождение с первоначальным выполнением. */
+		printf ("Повтор остановлен на команде %llu\n", cpu_icount);
+		return r;
+	}
+	return SCPE_OK;
+}
+
+/*
+ * Номер последнего снимка, сделанного не позже команды target.
+ */
+static int hist_find (t_uint64 target)
+{
+	int k;
+
+	for (k = hist_count-1; k > 0; --k)
+		if (hist_snap[k]->r.icount <= target)
+			break;
+	return k;
+}
+
+/*
+ * Команда RSTEP [n].
+ */
+t_stat rstep_cmd (int32 flag, char *cptr)
+{
+	t_uint64 target;
+	t_value n = 1;
+	t_stat r;
+	int k;
+
+	if (cptr && *cptr) {
+		n = get_uint (cptr, 10, 0xffffffff, &r);
+		if (r != SCPE_OK)
+			return r;
+	}
+	if (hist_count == 0) {
+		printf ("История выполнения пуста\n");
+		return SCPE_OK;
+	}
+	target = cpu_icount > n ? cpu_icount - n : 0;
+	k = hist_find (target);
+	if (target < hist_snap[k]->r.icount) {
+		target = hist_snap[k]->r.icount;
+		printf ("Достигнуто начало истории\n");
+	}
+	hist_restore (k);
+	r = hist_run (target, 1, 0);
+	if (r != SCPE_OK)
+		return r;
+	hist_stop ();
+	fprint_stopped_gen (stdout, SCPE_STEP, sim_PC, &cpu_dev);
+	return SCPE_OK;
+}
+
+/*
+ * Команда RCONT: обратное выполнение до предыдущей точки останова.
+ * Отрезки между снимками просматриваются от новых к старым.
+ */
+t_stat rcont_cmd (int32 flag, char *cptr)
+{
+	t_uint64 end, found;
+	t_stat r;
+	int k;
+
+	if (hist_count == 0) {
+		printf ("История выполнения пуста\n");
+		return SCPE_OK;
+	}
+	end = cpu_icount;
+	for (k = hist_count-1; k >= 0; --k) {
+		if (hist_snap[k]->r.icount >= end)
+			continue;
+		hist_restore (k);
+		found = ~0ULL;
+		r = hist_run (end, 0, &found);
+		if (r != SCPE_OK)
+			return r;
+		if (found != ~0ULL) {
+			hist_restore (k);
+			r = hist_run (found, 1, 0);
+			if (r != SCPE_OK)
+				return r;
+			hist_stop ();
+			sim_brk_pend[0] = TRUE;		/* не останавливаться */
+			sim_brk_ploc[0] = RVK;		/* повторно при CONT */
+			fprint_stopped_gen (stdout, STOP_IBKPT, sim_PC, &cpu_dev);
+			return SCPE_OK;
+		}
+		end = hist_snap[k]->r.icount;
+	}
+	hist_restore (0);
+	hist_stop ();
+	printf ("Достигнуто начало истории\n");
+	fprint_stopped_gen (stdout, SCPE_STEP, sim_PC, &cpu_dev);
+	return SCPE_OK;
+}
+
+/*
+ * SET CPU SNAPSHOT=n, SET CPU SNAPMEM=n.
+ */
+t_stat hist_set_interval (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+	t_stat r;
+	t_value n;
+
+	if (! cptr)
+		return SCPE_ARG;
+	n = get_uint (cptr, 10, 0xffffffff, &r);
+	if (r != SCPE_OK)
+		return r;
+	hist_interval = n;
+	hist_reset ();
+	return SCPE_OK;
+}
+
+t_stat hist_set_budget (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+	t_stat r;
+	t_value n;
+
+	if (! cptr)
+		return SCPE_ARG;
+	n = get_uint (cptr, 10, 65536, &r);
+	if (r != SCPE_OK || n == 0)
+		return SCPE_ARG;
+	hist_budget = n;
+	while (hist_count > 1 && hist_mem > (t_uint64) hist_budget << 20)
+		hist_drop_oldest ();
+	return SCPE_OK;
+}
+
+t_stat hist_show_interval (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+	if (hist_interval)
+		fprintf (st, "snapshot=%d", hist_interval);
+	else
+		fprintf (st, "no history");
+	return SCPE_OK;
+}
+
+/*
+ * SHOW CPU HISTORY.
+ */
+t_stat hist_show (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+	if (hist_count == 0) {
+		fprintf (st, "история пуста\n");
+		return SCPE_OK;
+	}
+	fprintf (st, "снимков %d, команды %llu-%llu, память %llu из %d КБ\n",
+		hist_count, hist_snap[0]->r.icount, cpu_icount,
+		hist_mem >> 10, hist_budget << 10);
+	return SCPE_OK;
+}
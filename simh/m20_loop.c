@@ -0,0 +1,342 @@
+/*
+ * m20_loop.c: M-20 fast-forward of counted loops
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * A loop on the address register is a straight run of instructions,
+ * closed by a jump 011, 012, 031, 032, 051 or 071 back to its first
+ * cell; the jump steps РА through its a3 field. If iterations of such
+ * a loop do not depend on each other, all of them but the last can be
+ * skipped: the simulator adds their instruction count, exact time and
+ * coverage counters, sets РА and executes the last iteration as usual.
+ * РР, Ω, РМР and memory come out the same as after step-by-step
+ * execution.
+ *
+ * The body of the loop qualifies when:
+ *	- it has no jumps, stops, input/output, 047 or СЧП РР;
+ *	- stores go to fixed cells outside the loop, and a fixed cell,
+ *	  stored by the loop, is read only after the store in the same
+ *	  iteration;
+ *	- cells read with РА modification are not stored by the loop;
+ *	- instructions, which may stop the machine (arithmetic, 035),
+ *	  and shifts by exponent get the same operands in every iteration;
+ *	- for jumps on Ω, no instruction of the body changes Ω.
+ * Skipping starts on the second pass of the closing jump in a row,
+ * so the whole body has been executed at least once. It is off during
+ * single steps, with breakpoints, debug trace and profiling, and stops
+ * before the next reverse execution snapshot and the next event.
+ *
+ * Command:
+ *	SET CPU FASTLOOP	- enable fast-forward
+ */
+#include "m20_defs.h"
+
+#define LOOP_MAXBODY	64			/* макс. длина тела цикла */
+#define LOOP_MAXSKIP	1000000			/* макс. витков за один раз */
+
+/*
+ * Чтение ячейки в теле цикла.
+ */
+typedef struct {
+	int addr;			/* адрес из команды */
+	int mod;			/* модифицируется по РА */
+	int local;			/* записана раньше в том же витке */
+} LREAD;
+
+static LREAD loop_read [3 * LOOP_MAXBODY];
+static int loop_nread;
+static int loop_write [LOOP_MAXBODY];	/* ячейки, куда пишет тело */
+static int loop_wvary [LOOP_MAXBODY];	/* записанное значение меняется */
+static int loop_nwrite;
+static uint32 loop_time [LOOP_MAXBODY];	/* время команды, 0.5 мкс */
+static int loop_sop [LOOP_MAXBODY];	/* сдвиг на модифицированный адрес: */
+static int loop_sa1 [LOOP_MAXBODY];	/* код операции и a1, иначе 0 */
+static uint32 loop_tconst;		/* постоянная часть времени витка */
+
+static int loop_addr = -1;		/* переход предыдущего витка */
+static t_uint64 loop_icount;		/* СЧК после него */
+static unsigned char loop_badf [MEMSIZE];
+static t_value loop_bad [MEMSIZE];	/* слово перехода негодного цикла */
+
+/*
+ * Забыть всё о циклах: новый пуск, память могла измениться.
+ */
+void loop_flush (void)
+{
+	loop_addr = -1;
+	memset (loop_badf, 0, sizeof (loop_badf));
+}
+
+/*
+ * Последняя запись в ячейку addr среди первых n записей тела.
+ */
+static int loop_find_write (int addr, int n)
+{
+	while (--n >= 0)
+		if (loop_write [n] == addr)
+			return n;
+	return -1;
+}
+
+/*
+ * Учёт чтения ячейки addr; vary отмечает операнд, меняющийся
+ * от витка к витку.
+ */
+static void loop_add_read (int addr, int mod, int *vary)
+{
+	LREAD *r;
+	int w;
+
+	if (! mod && addr == 0)
+		return;				/* ячейка 0 читается как 0 */
+	r = &loop_read [loop_nread++];
+	r->addr = addr;
+	r->mod = mod;
+	r->local = 0;
+	if (mod) {
+		*vary = 1;
+		return;
+	}
+	w = loop_find_write (addr, loop_nwrite);
+	if (w >= 0) {
+		r->local = 1;
+		*vary |= loop_wvary [w];
+	}
+}
+
+/*
+ * Разбор тела цикла first..last, last - адрес перехода с кодом jop.
+ * Возвращает 0, если цикл не подходит.
+ */
+static int loop_body (int first, int last, int jop)
+{
+	int i, j, flags, op, a1, a2, a3, n, vary, fault, omega = 0;
+	t_value cmd;
+
+	loop_nread = 0;
+	loop_nwrite = 0;
+	loop_tconst = timing[jop].base;
+	for (i=0; first+i < last; ++i) {
+		cmd = M [first+i];
+		flags = cmd >> 42 & 7;
+		op = cmd >> 36 & 077;
+		a1 = cmd >> 24 & 07777;
+		a2 = cmd >> 12 & 07777;
+		a3 = cmd & 07777;
+		n = 0;
+		vary = 0;
+		fault = 0;
+		loop_sop [i] = 0;
+		switch (op) {
+		default:
+			return 0;
+		case 020: /* чтение пультовых тумблеров */
+			if ((flags & 4) || a1 > 4)
+				return 0;
+			break;
+		case 000: /* пересылка */
+		case 067: /* циклический сдвиг */
+			loop_add_read (a1, flags & 4, &vary);
+			break;
+		case 035: /* поразрядное сравнение с остановом */
+			fault = 1;
+			/* fall through */
+		case 015: case 055: case 075:	/* логические */
+		case 013: case 033: case 053: case 073:	/* сложение команд */
+		case 007: case 027:		/* циклическое сложение */
+			loop_add_read (a1, flags & 4, &vary);
+			loop_add_read (a2, flags & 2, &vary);
+			omega = 1;
+			break;
+		case 014: /* сдвиг мантиссы по адресу */
+		case 054: /* сдвиг по адресу */
+			loop_add_read (a2, flags & 2, &vary);
+			if (flags & 4) {
+				/* Время сдвига зависит от РА. */
+				loop_sop [i] = op;
+				loop_sa1 [i] = a1;
+			} else
+				n = (a1 & 0177) - 64;
+			omega = 1;
+			break;
+		case 034: /* сдвиг мантиссы по порядку числа */
+		case 074: /* сдвиг по порядку числа */
+			loop_add_read (a1, flags & 4, &vary);
+			if (vary)
+				return 0;
+			n = (int) ((a1 ? M[a1] : 0) >> 36 & 0177) - 64;
+			loop_add_read (a2, flags & 2, &vary);
+			omega = 1;
+			break;
+		case 001: case 021: case 041: case 061:	/* сложение */
+		case 002: case 022: case 042: case 062:	/* вычитание */
+		case 003: case 023: case 043: case 063:	/* вычитание модулей */
+		case 005: case 025: case 045: case 065:	/* умножение */
+		case 004: case 024:			/* деление */
+			loop_add_read (a1, flags & 4, &vary);
+			loop_add_read (a2, flags & 2, &vary);
+			fault = omega = 1;
+			break;
+		case 044: case 064:			/* корень */
+			loop_add_read (a1, flags & 4, &vary);
+			fault = omega = 1;
+			break;
+		case 006: case 046:			/* порядок и адрес */
+			loop_add_read (a2, flags & 2, &vary);
+			fault = omega = 1;
+			break;
+		case 026: case 066:			/* порядки чисел */
+			loop_add_read (a2, flags & 2, &vary);
+			loop_add_read (a2, flags & 2, &vary);
+			fault = omega = 1;
+			break;
+		}
+		if (fault && vary)
+			return 0;
+
+		/* Все эти команды пишут результат в a3. */
+		if ((flags & 1) || (a3 >= first && a3 <= last))
+			return 0;
+		if (a3) {
+			loop_write [loop_nwrite] = a3;
+			loop_wvary [loop_nwrite++] = vary;
+		}
+		loop_time [i] = timing[op].base +
+			timing[op].shift * (n > 0 ? n : -n);
+		if (! loop_sop [i])
+			loop_tconst += loop_time [i];
+	}
+	loop_sop [i] = 0;
+	loop_time [i] = timing[jop].base;
+
+	/* Переход по Ω: тело не должно менять Ω. */
+	if (omega && (jop & 7) == 1)
+		return 0;
+
+	/* Ячейку, которую тело пишет, нельзя читать до записи:
+	 * иначе виток зависит от предыдущего. */
+	for (j=0; j<loop_nread; ++j)
+		if (! loop_read[j].mod && ! loop_read[j].local &&
+		    loop_find_write (loop_read[j].addr, loop_nwrite) >= 0)
+			return 0;
+	return 1;
+}
+
+/*
+ * Вызывается после перехода по адресу addr назад, к началу цикла.
+ * Пропускает витки цикла, кроме последнего, не больше чем на budget
+ * полумикросекунд. Возвращает пропущенное время в полумикросекундах.
+ */
+t_uint64 loop_forward (int addr, t_uint64 budget)
+{
+	t_value cmd = M [addr];
+	int op, a1, a3, step, first, len, i, r, a, n;
+	t_uint64 m, limit, total, t;
+	uint32 ts;
+
+	op = cmd >> 36 & 077;
+	switch (op) {
+	default:
+		return 0;
+	case 011: case 012: case 031: case 032: case 051: case 071:
+		break;
+	}
+	if (sim_step || sim_brk_summ || (sim_deb && cpu_dev.dctrl) ||
+	    (cpu_unit.flags & UNIT_PROF) || (cmd >> 42 & 6))
+		return 0;
+	first = cmd >> 12 & 07777;
+	if (first == 0 || first > addr || addr - first >= LOOP_MAXBODY)
+		return 0;
+	if (loop_badf [addr] && loop_bad [addr] == cmd)
+		return 0;
+	len = addr - first + 1;
+	if (loop_addr != addr || cpu_icount - loop_icount != len) {
+		/* Тело ещё не выполнялось целиком. */
+		loop_addr = addr;
+		loop_icount = cpu_icount;
+		return 0;
+	}
+	loop_icount = cpu_icount;
+	if (! loop_body (first, addr, op)) {
+		loop_badf [addr] = 1;
+		loop_bad [addr] = cmd;
+		return 0;
+	}
+
+	/* Не дальше следующего снимка для обратного хода. */
+	limit = LOOP_MAXSKIP;
+	if (hist_next != ~0ULL) {
+		if (hist_next <= cpu_icount)
+			return 0;
+		if ((hist_next - cpu_icount) / len < limit)
+			limit = (hist_next - cpu_icount) / len;
+	}
+	a1 = cmd >> 24 & 07777;
+	a3 = cmd & 07777;
+	step = cmd >> 42 & 1;
+	r = RA;
+	total = 0;
+	for (m=0; m<limit; ++m) {
+		/* Переход в конце витка не сработает: виток последний. */
+		if ((op & 020) ? r < a1 : r >= a1)
+			break;
+
+		/* Модифицированное чтение не должно попадать
+		 * в ячейки, которые пишет тело. */
+		for (i=0; i<loop_nread; ++i) {
+			if (! loop_read[i].mod)
+				continue;
+			a = (loop_read[i].addr + r) & 07777;
+			if (loop_find_write (a, loop_nwrite) >= 0)
+				goto done;
+		}
+		t = loop_tconst;
+		for (i=0; i<len; ++i) {
+			if (! loop_sop [i])
+				continue;
+			n = ((loop_sa1 [i] + r) & 0177) - 64;
+			t += timing[loop_sop[i]].base +
+				timing[loop_sop[i]].shift * (n > 0 ? n : -n);
+		}
+		if (total + t > budget)
+			break;
+		total += t;
+
+		/* Счётчики покрытия, зависящие от РА. */
+		for (i=0; i<loop_nread; ++i) {
+			if (! loop_read[i].mod)
+				continue;
+			a = (loop_read[i].addr + r) & 07777;
+			if (a)
+				++cov_read [a];
+		}
+		for (i=0; i<len; ++i) {
+			if (! loop_sop [i])
+				continue;
+			n = ((loop_sa1 [i] + r) & 0177) - 64;
+			ts = timing[loop_sop[i]].base +
+				timing[loop_sop[i]].shift * (n > 0 ? n : -n);
+			cov_time [first+i] += ts;
+		}
+		r = step ? (a3 + r) & 07777 : a3;
+	}
+done:
+	if (m == 0)
+		return 0;
+
+	RA = r;
+	cpu_icount += m * len;
+	cpu_time += total;
+	for (i=0; i<len; ++i) {
+		cov_exec [first+i] += m;
+		if (! loop_sop [i])
+			cov_time [first+i] += m * loop_time [i];
+	}
+	for (i=0; i<loop_nread; ++i)
+		if (! loop_read[i].mod)
+			cov_read [loop_read[i].addr] += m;
+	for (i=0; i<loop_nwrite; ++i)
+		cov_write [loop_write[i]] += m;
+	loop_icount = cpu_icount;
+	return total;
+}
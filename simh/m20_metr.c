@@ -0,0 +1,392 @@
+/*
+ * m20_metr.c: M-20 run metrics
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * Counters of the simulation session in a machine-readable form:
+ * executed instructions, simulated and host time, runs and the way
+ * each of them stopped, drum transfers, printed lines and breakpoint
+ * hits. The file attached to METRICS device is rewritten after every
+ * run, every SET METRICS INTERVAL=n seconds of host time during a run,
+ * and on detach (also at exit). The new contents are written into
+ * a temporary file, which is renamed over the old one, so a reader
+ * never sees a partial file.
+ *
+ * Commands:
+ *	ATTACH METRICS file	- keep metrics in the file
+ *	SET METRICS JSON	- JSON object (default)
+ *	SET METRICS PROMETHEUS	- Prometheus text exposition format
+ *	SET METRICS INTERVAL=n	- rewrite every n seconds during a run,
+ *				  0 - only after a run
+ *	METRICS [file]		- print metrics now
+ */
+#include "m20_defs.h"
+#include <time.h>
+
+#define METR_WAIT	100000			/* период проверки, мкс */
+#define METR_NSTOPS	128			/* коды остановов: свои и SCP */
+
+#define UNIT_V_PROM	(UNIT_V_UF + 0)		/* формат Prometheus */
+#define UNIT_PROM	(1 << UNIT_V_PROM)
+
+extern const char *sim_stop_messages [];
+extern const char *scp_error_messages [];
+
+t_uint64 metr_drum_reads;	/* обращений к барабану на чтение */
+t_uint64 metr_drum_writes;	/* обращений к барабану на запись */
+t_uint64 metr_drum_rwords;	/* прочитано слов */
+t_uint64 metr_drum_wwords;	/* записано слов */
+t_uint64 metr_print_lines;	/* напечатано строк */
+
+static t_uint64 metr_runs;	/* пусков */
+static t_uint64 metr_brk;	/* остановов по точке останова */
+static t_uint64 metr_stops [METR_NSTOPS]; /* пусков по кодам останова */
+static t_stat metr_last = -1;	/* код последнего останова */
+static uint32 metr_last_rvk;	/* РВК при последнем останове */
+static uint32 metr_interval;	/* период записи, секунды */
+static t_uint64 metr_written;	/* время хоста последней записи, нс */
+int metr_hold;			/* не учитывать пуски (замер OPBENCH) */
+
+t_stat metr_svc (UNIT *uptr);
+t_stat metr_reset (DEVICE *dptr);
+t_stat metr_attach (UNIT *uptr, char *cptr);
+t_stat metr_detach (UNIT *uptr);
+t_stat metr_set_interval (UNIT *uptr, int32 val, char *cptr, void *desc);
+t_stat metr_show_interval (FILE *st, UNIT *uptr, int32 val, void *desc);
+
+/*
+ * METRICS data structures
+ *
+ * metr_dev	METRICS device descriptor
+ * metr_unit	METRICS unit descriptor
+ * metr_mod	METRICS modifiers list
+ */
+UNIT metr_unit = {
+	UDATA (&metr_svc, UNIT_ATTABLE, 0)
+};
+
+MTAB metr_mod[] = {
+	{ UNIT_PROM, 0,		"JSON",	      "JSON",	    NULL },
+	{ UNIT_PROM, UNIT_PROM,	"PROMETHEUS", "PROMETHEUS", NULL },
+	{ MTAB_XTD|MTAB_VDV|MTAB_VAL, 0, "INTERVAL", "INTERVAL",
+		&metr_set_interval, &metr_show_interval },
+	{ 0 }
+};
+
+DEVICE metr_dev = {
+	"METRICS", &metr_unit, NULL, metr_mod,
+	1, 8, 12, 1, 8, 45,
+	NULL, NULL, &metr_reset,
+	NULL, &metr_attach, &metr_detach, NULL,
+	0
+};
+
+/*
+ * Текст сообщения об останове с кодом r.
+ */
+static const char *metr_message (t_stat r)
+{
+	if (r >= SCPE_BASE && r <= SCPE_AFAIL)
+		return scp_error_messages [r - SCPE_BASE];
+	if (r > 0 && r <= STOP_MBINVAL)
+		return sim_stop_messages [r];
+	return "";
+}
+
+/*
+ * Индекс в таблице счётчиков остановов: сначала коды М-20,
+ * потом коды SCP.
+ */
+static int metr_index (t_stat r)
+{
+	if (r >= SCPE_BASE && r - SCPE_BASE < METR_NSTOPS/2)
+		return METR_NSTOPS/2 + r - SCPE_BASE;
+	if (r >= 0 && r < METR_NSTOPS/2)
+		return r;
+	return -1;
+}
+
+static t_stat metr_code (int i)
+{
+	return i < METR_NSTOPS/2 ? i : i - METR_NSTOPS/2 + SCPE_BASE;
+}
+
+/*
+ * Учёт окончания пуска с кодом r.
+ */
+void metr_stop (t_stat r)
+{
+	int i = metr_index (r);
+
+	if (metr_hold)
+		return;
+	++metr_runs;
+	if (i >= 0)
+		++metr_stops [i];
+	if (r == STOP_IBKPT)
+		++metr_brk;
+	metr_last = r;
+	metr_last_rvk = RVK;
+	if (metr_unit.flags & UNIT_ATT)
+		metr_write (metr_unit.filename);
+}
+
+/*
+ * Строка в кавычках для JSON и меток Prometheus.
+ */
+static void metr_string (FILE *fd, const char *s)
+{
+	putc ('"', fd);
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\')
+			putc ('\\', fd);
+		if (*s == '\n')
+			fputs ("\\n", fd);
+		else
+			putc (*s, fd);
+	}
+	putc ('"', fd);
+}
+
+/*
+ * Метрики в формате JSON.
+ */
+static void metr_json (FILE *fd, t_uint64 usec, t_uint64 nsec, t_uint64 icount)
+{
+	int i, n;
+
+	fprintf (fd, "{\n");
+	fprintf (fd, "  \"timestamp\": %llu,\n", (t_uint64) time (0));
+	fprintf (fd, "  \"running\": %s,\n", cpu_running ? "true" : "false");
+	fprintf (fd, "  \"instructions\": %llu,\n", icount);
+	fprintf (fd, "  \"sim_time_us\": %llu,\n", usec);
+	fprintf (fd, "  \"host_time_ns\": %llu,\n", nsec);
+	fprintf (fd, "  \"runs\": %llu,\n", metr_runs);
+	fprintf (fd, "  \"last_stop\": ");
+	if (metr_last < 0)
+		fprintf (fd, "null,\n");
+	else {
+		fprintf (fd, "{ \"code\": %d, \"message\": ", metr_last);
+		metr_string (fd, metr_message (metr_last));
+		fprintf (fd, ", \"rvk\": \"%04o\" },\n", metr_last_rvk);
+	}
+	fprintf (fd, "  \"stops\": [");
+	n = 0;
+	for (i=0; i<METR_NSTOPS; ++i) {
+		if (! metr_stops [i])
+			continue;
+		fprintf (fd, "%s\n    { \"code\": %d, \"message\": ",
+			n++ ? "," : "", metr_code (i));
+		metr_string (fd, metr_message (metr_code (i)));
+		fprintf (fd, ", \"count\": %llu }", metr_stops [i]);
+	}
+	fprintf (fd, "%s],\n", n ? "\n  " : "");
+	fprintf (fd, "  \"breakpoint_hits\": %llu,\n", metr_brk);
+	fprintf (fd, "  \"drum\": { \"reads\": %llu, \"writes\": %llu, "
+		"\"read_bytes\": %llu, \"write_bytes\": %llu },\n",
+		metr_drum_reads, metr_drum_writes,
+		metr_drum_rwords * 8, metr_drum_wwords * 8);
+	fprintf (fd, "  \"printer_lines\": %llu\n", metr_print_lines);
+	fprintf (fd, "}\n");
+}
+
+/*
+ * Одна метрика Prometheus: описание, тип и значение.
+ */
+static void metr_prom1 (FILE *fd, const char *name, const char *type,
+	const char *help, t_uint64 val)
+{
+	fprintf (fd, "# HELP %s %s\n", name, help);
+	fprintf (fd, "# TYPE %s %s\n", name, type);
+	fprintf (fd, "%s %llu\n", name, val);
+}
+
+/*
+ * Метрики в текстовом формате Prometheus.
+ */
+static void metr_prom (FILE *fd, t_uint64 usec, t_uint64 nsec, t_uint64 icount)
+{
+	int i;
+
+	metr_prom1 (fd, "m20_instructions_total", "counter",
+		"Executed instructions.", icount);
+	fprintf (fd, "# HELP m20_sim_seconds_total Simulated time.\n");
+	fprintf (fd, "# TYPE m20_sim_seconds_total counter\n");
+	fprintf (fd, "m20_sim_seconds_total %.6f\n", usec / 1e6);
+	fprintf (fd, "# HELP m20_host_seconds_total Host time spent in runs.\n");
+	fprintf (fd, "# TYPE m20_host_seconds_total counter\n");
+	fprintf (fd, "m20_host_seconds_total %.9f\n", nsec / 1e9);
+	metr_prom1 (fd, "m20_running", "gauge",
+		"1 while the processor runs.", cpu_running);
+	metr_prom1 (fd, "m20_runs_total", "counter",
+		"Finished runs.", metr_runs);
+
+	fprintf (fd, "# HELP m20_stops_total Finished runs by stop code.\n");
+	fprintf (fd, "# TYPE m20_stops_total counter\n");
+	for (i=0; i<METR_NSTOPS; ++i) {
+		if (! metr_stops [i])
+			continue;
+		fprintf (fd, "m20_stops_total{code=\"%d\",message=",
+			metr_code (i));
+		metr_string (fd, metr_message (metr_code (i)));
+		fprintf (fd, "} %llu\n", metr_stops [i]);
+	}
+	if (metr_last >= 0) {
+		fprintf (fd, "# HELP m20_last_stop Stop code of the last run.\n");
+		fprintf (fd, "# TYPE m20_last_stop gauge\n");
+		fprintf (fd, "m20_last_stop{message=");
+		metr_string (fd, metr_message (metr_last));
+		fprintf (fd, ",rvk=\"%04o\"} %d\n", metr_last_rvk, metr_last);
+	}
+	metr_prom1 (fd, "m20_breakpoint_hits_total", "counter",
+		"Stops on breakpoints.", metr_brk);
+	metr_prom1 (fd, "m20_drum_reads_total", "counter",
+		"Drum read transfers.", metr_drum_reads);
+	metr_prom1 (fd, "m20_drum_writes_total", "counter",
+		"Drum write transfers.", metr_drum_writes);
+	metr_prom1 (fd, "m20_drum_read_bytes_total", "counter",
+		"Bytes read from the drum.", metr_drum_rwords * 8);
+	metr_prom1 (fd, "m20_drum_write_bytes_total", "counter",
+		"Bytes written to the drum.", metr_drum_wwords * 8);
+	metr_prom1 (fd, "m20_printer_lines_total", "counter",
+		"Printed lines.", metr_print_lines);
+}
+
+/*
+ * Печать метрик в выбранном формате.
+ */
+static void metr_print (FILE *fd)
+{
+	t_uint64 usec, nsec, icount;
+
+	cpu_totals (&usec, &nsec, &icount);
+	if (metr_unit.flags & UNIT_PROM)
+		metr_prom (fd, usec, nsec, icount);
+	else
+		metr_json (fd, usec, nsec, icount);
+}
+
+/*
+ * Запись метрик в файл: через временный файл и переименование.
+ */
+t_stat metr_write (char *fname)
+{
+	char tmp [CBUFSIZE + 8];
+	FILE *fd;
+
+	metr_written = host_nsec ();
+	snprintf (tmp, sizeof (tmp), "%s.tmp", fname);
+	fd = fopen (tmp, "w");
+	if (! fd)
+		return SCPE_OPENERR;
+	metr_print (fd);
+	if (fclose (fd) != 0 || rename (tmp, fname) != 0) {
+		remove (tmp);
+		return SCPE_IOERR;
+	}
+	return SCPE_OK;
+}
+
+/*
+ * Периодическая запись во время пуска.
+ */
+t_stat metr_svc (UNIT *uptr)
+{
+	if (! metr_interval || ! (uptr->flags & UNIT_ATT))
+		return SCPE_OK;
+	if (metr_hold)
+		return sim_activate (uptr, METR_WAIT);
+	sim_activate (uptr, METR_WAIT);
+	if (host_nsec () - metr_written < metr_interval * 1000000000ULL)
+		return SCPE_OK;
+	return metr_write (uptr->filename);
+}
+
+t_stat metr_reset (DEVICE *dptr)
+{
+	sim_cancel (&metr_unit);
+	if ((metr_unit.flags & UNIT_ATT) && metr_interval)
+		sim_activate (&metr_unit, METR_WAIT);
+	return SCPE_OK;
+}
+
+/*
+ * Подключение файла метрик. Файл не держится открытым:
+ * при каждой записи он заменяется новым.
+ */
+t_stat metr_attach (UNIT *uptr, char *cptr)
+{
+	t_stat r;
+
+	if (uptr->flags & UNIT_ATT)
+		metr_detach (uptr);
+	uptr->filename = (char*) calloc (CBUFSIZE, sizeof (char));
+	if (! uptr->filename)
+		return SCPE_MEM;
+	strncpy (uptr->filename, cptr, CBUFSIZE - 1);
+	r = metr_write (uptr->filename);
+	if (r != SCPE_OK) {
+		free (uptr->filename);
+		uptr->filename = 0;
+		return r;
+	}
+	uptr->flags |= UNIT_ATT;
+	return metr_reset (&metr_dev);
+}
+
+/*
+ * Отключение, в том числе при выходе: последняя запись.
+ */
+t_stat metr_detach (UNIT *uptr)
+{
+	t_stat r;
+
+	if (! (uptr->flags & UNIT_ATT))
+		return SCPE_OK;
+	r = metr_write (uptr->filename);
+	sim_cancel (uptr);
+	free (uptr->filename);
+	uptr->filename = 0;
+	uptr->flags &= ~UNIT_ATT;
+	return r;
+}
+
+t_stat metr_set_interval (UNIT *uptr, int32 val, char *cptr, void *desc)
+{
+	t_stat r;
+	t_value n;
+
+	if (! cptr)
+		return SCPE_ARG;
+	n = get_uint (cptr, 10, 1000000, &r);
+	if (r != SCPE_OK)
+		return r;
+	metr_interval = n;
+	return metr_reset (&metr_dev);
+}
+
+t_stat metr_show_interval (FILE *st, UNIT *uptr, int32 val, void *desc)
+{
+	if (metr_interval)
+		fprintf (st, "interval=%d sec", metr_interval);
+	else
+		fprintf (st, "after every run");
+	return SCPE_OK;
+}
+
+/*
+ * Команда METRICS [file].
+ */
+t_stat metr_cmd (int32 flag, char *cptr)
+{
+	char fname [CBUFSIZE];
+
+	if (cptr && *cptr) {
+		cptr = get_glyph_nc (cptr, fname, 0);
+		if (*cptr)
+			return SCPE_2MARG;
+		return metr_write (fname);
+	}
+	metr_print (stdout);
+	return SCPE_OK;
+}
@@ -0,0 +1,449 @@
+/*
+ * m20_prof.c: M-20 call-graph profiler
+ *
+ * Copyright (c) 2009, Serge Vakulenko
+ *
+ * Subroutines of M-20 are called by instruction 016 (пв): it stores
+ * a return jump into the cell a3 and passes control to a2. To return,
+ * the subroutine executes the instruction in that cell. The profiler
+ * keeps a shadow stack of calls: 016 with nonzero a3 pushes a frame,
+ * execution of the frame's return cell pops it (and all frames above,
+ * if the program exits a nested routine past its callers).
+ *
+ * Simulated time is attributed per instruction, host time per call
+ * and return, to nodes of a calling context tree. Routines are
+ * named by labels of the as20 symbol table.
+ *
+ * The profiler also counts pairs of opcodes executed one after another
+ * from adjacent cells; FUSE uses them to choose superinstructions.
+ *
+ * Commands:
+ *	SET CPU PROFILE		- enable profiling
+ *	PROFILE REPORT [file]	- routines sorted by inclusive time
+ *	PROFILE FOLDED file	- folded stacks for flame graphs
+ *	PROFILE PAIRS [file]	- most frequent pairs of opcodes
+ *	PROFILE RESET		- clear collected data
+ */
+#include "m20_defs.h"
+
+#define PROF_DEPTH	1024			/* глубина теневого стека */
+
+/*
+ * Узел дерева вызовов.
+ */
+typedef struct {
+	int parent;			/* вызывающий узел */
+	int child;			/* первый вызываемый узел */
+	int sibling;			/* следующий узел того же уровня */
+	int entry;			/* адрес входа в подпрограмму */
+	t_uint64 calls;			/* количество вызовов */
+	t_uint64 time;			/* собственное модельное время, 0.5 мкс */
+	t_uint64 host;			/* собственное время хоста, нс */
+} PNODE;
+
+/*
+ * Кадр теневого стека.
+ */
+typedef struct {
+	int node;			/* узел дерева вызовов */
+	int cell;			/* ячейка возврата */
+	t_uint64 time0;			/* модельное время при входе */
+	t_uint64 host0;			/* время хоста при входе */
+} PFRAME;
+
+static PNODE *prof_node;
+static int prof_nnodes, prof_alloc;
+static int prof_roots = -1;		/* корни дерева: точки пуска */
+static PFRAME prof_stack [PROF_DEPTH];
+static int prof_depth;			/* 0 - стек пуст */
+static t_uint64 prof_time;		/* всего модельного времени */
+static t_uint64 prof_host;		/* всего времени хоста */
+static t_uint64 prof_event;		/* время хоста последнего события */
+static t_uint64 prof_lost;		/* вызовы сверх PROF_DEPTH */
+
+/* Пары команд из соседних ячеек: код первой и второй. */
+t_uint64 prof_pair [64][64];
+static int prof_last = -1;		/* адрес предыдущей команды */
+static int prof_lastop;			/* её код операции */
+
+#define PAIR_COUNT(p)	prof_pair [(p) >> 6] [(p) & 077]
+
+/* Включительное время подпрограмм, по адресу входа. */
+static t_uint64 prof_incl_time [MEMSIZE];
+static t_uint64 prof_incl_host [MEMSIZE];
+
+/*
+ * Новый узел дерева вызовов.
+ */
+static int prof_new_node (int parent, int entry)
+{
+	PNODE *p;
+
+	if (prof_nnodes >= prof_alloc) {
+		p = realloc (prof_node, (prof_alloc + 256) * sizeof (PNODE));
+		if (! p)
+			return -1;
+		prof_node = p;
+		prof_alloc += 256;
+	}
+	p = &prof_node [prof_nnodes];
+	memset (p, 0, sizeof (*p));
+	p->parent = parent;
+	p->entry = entry;
+	p->child = -1;
+	p->sibling = -1;
+	if (parent >= 0) {
+		p->sibling = prof_node[parent].child;
+		prof_node[parent].child = prof_nnodes;
+	} else {
+		p->sibling = prof_roots;
+		prof_roots = prof_nnodes;
+	}
+	return prof_nnodes++;
+}
+
+/*
+ * Учёт времени хоста, прошедшего с предыдущего события.
+ */
+static void prof_host_tick (void)
+{
+	t_uint64 now = host_nsec ();
+
+	if (prof_depth > 0) {
+		prof_node [prof_stack[prof_depth-1].node].host += now - prof_event;
+		prof_host += now - prof_event;
+	}
+	prof_event = now;
+}
+
+/*
+ * Подпрограмма entry уже есть в стеке ниже кадра n?
+ */
+static int prof_active (int entry, int n)
+{
+	while (--n >= 0)
+		if (prof_node [prof_stack[n].node].entry == entry)
+			return 1;
+	return 0;
+}
+
+/*
+ * Снятие верхнего кадра.
+ */
+static void prof_pop (void)
+{
+	PFRAME *f = &prof_stack [--prof_depth];
+	int entry = prof_node [f->node].entry;
+
+	if (! prof_active (entry, prof_depth)) {
+		prof_incl_time [entry] += prof_time - f->time0;
+		prof_incl_host [entry] += prof_host - f->host0;
+	}
+}
+
+/*
+ * Вход в подпрограмму.
+ */
+static void prof_push (int entry, int cell)
+{
+	PFRAME *f;
+	int parent, n;
+
+	if (prof_depth >= PROF_DEPTH) {
+		++prof_lost;
+		return;
+	}
+	parent = prof_depth > 0 ? prof_stack[prof_depth-1].node : -1;
+	n = parent >= 0 ? prof_node[parent].child : prof_roots;
+	for (; n >= 0; n = prof_node[n].sibling)
+		if (prof_node[n].entry == entry)
+			break;
+	if (n < 0) {
+		n = prof_new_node (parent, entry);
+		if (n < 0)
+			return;
+	}
+	++prof_node[n].calls;
+	f = &prof_stack [prof_depth++];
+	f->node = n;
+	f->cell = cell;
+	f->time0 = prof_time;
+	f->host0 = prof_host;
+}
+
+/*
+ * Начало и конец пуска: время за пультом не учитывается.
+ */
+void prof_start (void)
+{
+	prof_event = host_nsec ();
+	prof_last = -1;
+	if (prof_depth == 0)
+		prof_push (RVK, -1);		/* корень: точка пуска */
+}
+
+void prof_stop (void)
+{
+	prof_host_tick ();
+}
+
+/*
+ * Снятие всех кадров при сбросе процессора.
+ */
+void prof_unwind (void)
+{
+	while (prof_depth > 0)
+		prof_pop ();
+}
+
+/*
+ * Учёт команды, выполненной по адресу addr.
+ * Регистр РК содержит команду, delay - время её выполнения.
+ */
+void prof_inst (int addr)
+{
+	int n, op, a2, a3;
+
+	op = RK >> 36 & 077;
+	if (addr == prof_last + 1)
+		++prof_pair [prof_lastop][op];
+	prof_last = addr;
+	prof_lastop = op;
+
+	if (prof_depth == 0)
+		return;
+	prof_node [prof_stack[prof_depth-1].node].time += delay;
+	prof_time += delay;
+
+	/* Возврат: выполнена команда из ячейки возврата. */
+	for (n = prof_depth-1; n > 0; --n) {
+		if (prof_stack[n].cell == addr) {
+			prof_host_tick ();
+			while (prof_depth > n)
+				prof_pop ();
+			break;
+		}
+	}
+
+	/* Вызов: пв с ненулевой ячейкой возврата. */
+	if (op == 016) {
+		a2 = RK >> 12 & 07777;
+		a3 = RK & 07777;
+		if (RK >> 42 & 2)
+			a2 = (a2 + RA) & 07777;
+		if (RK >> 42 & 1)
+			a3 = (a3 + RA) & 07777;
+		if (a3) {
+			prof_host_tick ();
+			prof_push (a2, a3);
+		}
+	}
+}
+
+/*
+ * Имя подпрограммы по адресу входа.
+ */
+static void prof_name (FILE *fd, int entry)
+{
+	const char *name;
+	int offset;
+
+	name = m20_symbol (entry, &offset);
+	if (! name)
+		fprintf (fd, "%04o", entry);
+	else if (offset)
+		fprintf (fd, "%s+%o", name, offset);
+	else
+		fprintf (fd, "%s", name);
+}
+
+/*
+ * Свёрнутые стеки: путь вызовов через ';' и собственное время в мкс.
+ */
+static void prof_fold (FILE *fd, int n)
+{
+	static int path [PROF_DEPTH];
+	int depth, i;
+
+	for (; n >= 0; n = prof_node[n].sibling) {
+		if (prof_node[n].time >= 2) {
+			depth = 0;
+			for (i = n; i >= 0 && depth < PROF_DEPTH;
+			    i = prof_node[i].parent)
+				path [depth++] = prof_node[i].entry;
+			while (--depth >= 0) {
+				prof_name (fd, path [depth]);
+				putc (depth ? ';' : ' ', fd);
+			}
+			fprintf (fd, "%llu\n", prof_node[n].time >> 1);
+		}
+		prof_fold (fd, prof_node[n].child);
+	}
+}
+
+static int compare_incl (const void *a, const void *b)
+{
+	t_uint64 x = prof_incl_time [*(const int*) a];
+	t_uint64 y = prof_incl_time [*(const int*) b];
+
+	return x < y ? 1 : x > y ? -1 : *(const int*) a - *(const int*) b;
+}
+
+/*
+ * Отчёт по подпрограммам.
+ */
+static void prof_report (FILE *fd)
+{
+	static t_uint64 calls [MEMSIZE], excl_time [MEMSIZE], excl_host [MEMSIZE];
+	static t_uint64 incl_time [MEMSIZE], incl_host [MEMSIZE];
+	static int order [MEMSIZE];
+	int i, n, entry, nroutines;
+	double total;
+
+	memset (calls, 0, sizeof (calls));
+	memset (excl_time, 0, sizeof (excl_time));
+	memset (excl_host, 0, sizeof (excl_host));
+	for (i=0; i<prof_nnodes; ++i) {
+		entry = prof_node[i].entry;
+		calls [entry] += prof_node[i].calls;
+		excl_time [entry] += prof_node[i].time;
+		excl_host [entry] += prof_node[i].host;
+	}
+
+	/* Незавершённые вызовы. */
+	memcpy (incl_time, prof_incl_time, sizeof (incl_time));
+	memcpy (incl_host, prof_incl_host, sizeof (incl_host));
+	for (i=0; i<prof_depth; ++i) {
+		entry = prof_node [prof_stack[i].node].entry;
+		if (! prof_active (entry, i)) {
+			prof_incl_time [entry] += prof_time - prof_stack[i].time0;
+			prof_incl_host [entry] += prof_host - prof_stack[i].host0;
+		}
+	}
+	nroutines = 0;
+	for (entry=0; entry<MEMSIZE; ++entry)
+		if (calls [entry])
+			order [nroutines++] = entry;
+	qsort (order, nroutines, sizeof (int), compare_incl);
+
+	total = prof_time ? prof_time : 1;
+	fprintf (fd, "; Профиль: модельное время %llu мкс, время хоста %.3f мс",
+		prof_time >> 1, prof_host / 1e6);
+	if (prof_lost)
+		fprintf (fd, ", потеряно вызовов %llu", prof_lost);
+	fprintf (fd, "\n");
+	fprintf (fd, ";     вызовов  включ.мкс      %%   собств.мкс      %%  включ.мс  собств.мс  подпрограмма\n");
+	for (i=0; i<nroutines; ++i) {
+		n = order [i];
+		fprintf (fd, "%12llu %10llu %6.2f %12llu %6.2f %9.3f %10.3f  ",
+			calls [n], prof_incl_time [n] >> 1,
+			prof_incl_time [n] * 100.0 / total,
+			excl_time [n] >> 1, excl_time [n] * 100.0 / total,
+			prof_incl_host [n] / 1e6, excl_host [n] / 1e6);
+		prof_name (fd, n);
+		fprintf (fd, "\n");
+	}
+	memcpy (prof_incl_time, incl_time, sizeof (incl_time));
+	memcpy (prof_incl_host, incl_host, sizeof (incl_host));
+}
+
+static int compare_pair (const void *a, const void *b)
+{
+	t_uint64 x = PAIR_COUNT (*(const int*) a);
+	t_uint64 y = PAIR_COUNT (*(const int*) b);
+
+	return x < y ? 1 : x > y ? -1 : *(const int*) a - *(const int*) b;
+}
+
+/*
+ * Частые пары команд, по убыванию. Номер пары - код первой
+ * команды * 64 плюс код второй. Пары, для которых есть
+ * суперкоманда, отмечены '*', включённые командой FUSE - '+'.
+ */
+static void prof_pairs (FILE *fd)
+{
+	static int order [64*64];
+	int i, p, npairs;
+	t_uint64 total, sum;
+
+	total = 0;
+	npairs = 0;
+	for (p=0; p<64*64; ++p) {
+		if (PAIR_COUNT (p)) {
+			total += PAIR_COUNT (p);
+			order [npairs++] = p;
+		}
+	}
+	qsort (order, npairs, sizeof (int), compare_pair);
+
+	fprintf (fd, "; Пары команд: всего %llu\n", total);
+	fprintf (fd, ";            пар      %%   накоп.%%  коды  пара\n");
+	sum = 0;
+	for (i=0; i<npairs; ++i) {
+		p = order [i];
+		sum += PAIR_COUNT (p);
+		fprintf (fd, "%16llu %6.2f %8.2f  %02o %02o %c %s %s\n",
+			PAIR_COUNT (p), PAIR_COUNT (p) * 100.0 / total,
+			sum * 100.0 / total, p >> 6, p & 077,
+			fuse_mark (p >> 6, p & 077),
+			m20_opname [p >> 6], m20_opname [p & 077]);
+	}
+}
+
+/*
+ * Сброс профиля.
+ */
+void prof_reset (void)
+{
+	prof_nnodes = 0;
+	prof_roots = -1;
+	prof_depth = 0;
+	prof_time = 0;
+	prof_host = 0;
+	prof_lost = 0;
+	memset (prof_incl_time, 0, sizeof (prof_incl_time));
+	memset (prof_incl_host, 0, sizeof (prof_incl_host));
+	memset (prof_pair, 0, sizeof (prof_pair));
+	prof_last = -1;
+}
+
+/*
+ * Команда PROFILE REPORT [file] | FOLDED file | PAIRS [file] | RESET.
+ */
+t_stat prof_cmd (int32 flag, char *cptr)
+{
+	char gbuf [CBUFSIZE], fname [CBUFSIZE];
+	FILE *fd = stdout;
+
+	if (! cptr || ! *cptr)
+		return SCPE_2FARG;
+	cptr = get_glyph (cptr, gbuf, 0);
+	if (strcmp (gbuf, "RESET") == 0) {
+		if (*cptr)
+			return SCPE_2MARG;
+		prof_reset ();
+		return SCPE_OK;
+	}
+	if (strcmp (gbuf, "REPORT") != 0 && strcmp (gbuf, "FOLDED") != 0 &&
+	    strcmp (gbuf, "PAIRS") != 0)
+		return SCPE_ARG;
+	if (*cptr) {
+		cptr = get_glyph_nc (cptr, fname, 0);
+		if (*cptr)
+			return SCPE_2MARG;
+		fd = sim_fopen (fname, "w");
+		if (! fd)
+			return SCPE_OPENERR;
+	} else if (gbuf[0] == 'F')
+		return SCPE_2FARG;
+
+	if (gbuf[0] == 'F')
+		prof_fold (fd, prof_roots);
+	else if (gbuf[0] == 'P')
+		prof_pairs (fd);
+	else
+		prof_report (fd);
+	if (fd != stdout)
+		fclose (fd);
+	return SCPE_OK;
+}
@@ -3,10 +3,12 @@
  *
  * Copyright (c) 2009, Serge Vakulenko
  *
- * This file implements three essential functions:
+ * This file implements the following functions:
  *
+ * m20_init()	- simulator initialization, called once by SCP
  * sim_load()   - loading and dumping memory and CPU state
  *		  in a way, specific for M20 architecture
+ * m20_symbol()	- find a label from the as20 symbol table
  * fprint_sym() - print a machune instruction using
  *  		  opcode mnemonic or in a digital format
  * parse_sym()	- scan a string and build an instruction
@@ -15,6 +17,50 @@
 #include "m20_defs.h"
 #include <math.h>
 
+extern void (*sim_vm_show_time) (FILE *st);
+extern CTAB *sim_vm_cmd;
+
+/*
+ * Дополнительные команды.
+ */
+CTAB m20_cmd[] = {
+	{ "CHECKPOINT", &ckpt_cmd, 0,
+	  "checkpoint {file}        save checkpoint to CKPT log or to file\n" },
+	{ "RECOVER", &recover_cmd, 0,
+	  "recover <file>           restore state from checkpoint file\n" },
+	{ "RSTEP", &rstep_cmd, 0,
+	  "rs{tep} {n}              step back n instructions\n" },
+	{ "RCONT", &rcont_cmd, 0,
+	  "rc{ont}                  run back to previous breakpoint\n" },
+	{ "COVERAGE", &cov_cmd, 0,
+	  "coverage <file>|RESET    write memory coverage map\n" },
+	{ "PROFILE", &prof_cmd, 0,
+	  "profile REPORT {file}    print subroutine profile\n"
+	  "profile FOLDED <file>    write folded stacks for flame graph\n"
+	  "profile PAIRS {file}     print statistics of instruction pairs\n"
+	  "profile RESET            clear subroutine profile\n" },
+	{ "LISTING", &listing_cmd, 0,
+	  "listing <file>           write source listing with execution counts\n" },
+	{ "FUSE", &fuse_cmd, 0,
+	  "fuse {n|ALL}             select instruction pairs for superinstructions\n" },
+	{ "OPBENCH", &opbench_cmd, 0,
+	  "opbench {file}           measure host time of every instruction\n" },
+	{ "METRICS", &metr_cmd, 0,
+	  "metrics {file}           print run metrics or write them to file\n" },
+	{ NULL }
+};
+
+/*
+ * Начальная настройка симулятора.
+ */
+void m20_init (void)
+{
+	sim_vm_show_time = &cpu_show_time;
+	sim_vm_cmd = m20_cmd;
+}
+
+void (*sim_vm_init) (void) = &m20_init;
+
 /*
  * Преобразование вещественного числа в формат М-20.
  *
@@ -67,10 +113,123 @@ char *skip_spaces (char *p)
 	return p;
 }
 
+/*
+ * Таблица символов загруженной программы.
+ */
+SYMBOL *m20_sym;
+int m20_nsym;
+static int m20_sym_alloc;
+
+static int compare_sym (const void *a, const void *b)
+{
+	return ((const SYMBOL*) a)->addr - ((const SYMBOL*) b)->addr;
+}
+
+/*
+ * Ближайший символ, не превосходящий адрес addr.
+ * В offset возвращается смещение от него.
+ */
+const char *m20_symbol (int addr, int *offset)
+{
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = m20_nsym - 1;
+	if (hi < 0 || m20_sym[0].addr > addr)
+		return 0;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (m20_sym[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	if (offset)
+		*offset = addr - m20_sym[lo].addr;
+	return m20_sym[lo].name;
+}
+
+/*
+ * Добавление символа в таблицу.
+ */
+static void m20_add_symbol (int addr, char *name)
+{
+	if (m20_nsym >= m20_sym_alloc) {
+		SYMBOL *p = realloc (m20_sym,
+			(m20_sym_alloc + 256) * sizeof (SYMBOL));
+		if (! p)
+			return;
+		m20_sym = p;
+		m20_sym_alloc += 256;
+	}
+	m20_sym[m20_nsym].addr = addr;
+	strncpy (m20_sym[m20_nsym].name, name, sizeof (m20_sym[0].name) - 1);
+	m20_sym[m20_nsym].name [sizeof (m20_sym[0].name) - 1] = 0;
+	++m20_nsym;
+}
+
+/*
+ * Таблица строк исходного текста загруженной программы.
+ */
+char *m20_srcfile [M20_MAXSRC];
+int m20_nsrc;
+SRCLINE m20_srcline [MEMSIZE];
+char m20_loadfile [CBUFSIZE];
+
+/*
+ * Разбор комментариев, которые выдаёт as20: таблицы символов
+ * и таблицы строк. В section запоминается текущая таблица.
+ */
+static void m20_comment (char *p, int *section)
+{
+	static const char symtab_title[] = "; Таблица символов";
+	static const char linetab_title[] = "; Таблица строк";
+	static const char file_title[] = "; файл";
+	char name [64], *q;
+	unsigned addr;
+	int file, line;
+	char c;
+
+	if (strncmp (p, symtab_title, sizeof (symtab_title) - 1) == 0) {
+		*section = 'S';
+		return;
+	}
+	if (strncmp (p, linetab_title, sizeof (linetab_title) - 1) == 0) {
+		*section = 'L';
+		return;
+	}
+	switch (*section) {
+	case 'S':
+		if (sscanf (p, "; %o %c %63s", &addr, &c, name) == 3 &&
+		    c == 'T' && name[0] != '<' && addr < MEMSIZE)
+			m20_add_symbol (addr, name);
+		break;
+	case 'L':
+		if (strncmp (p, file_title, sizeof (file_title) - 1) == 0) {
+			p = skip_spaces (p + sizeof (file_title) - 1);
+			file = strtol (p, &p, 10);
+			p = skip_spaces (p);
+			q = p + strlen (p);
+			while (q > p && (q[-1] == '\n' || q[-1] == '\r'))
+				*--q = 0;
+			if (file == m20_nsrc && file < M20_MAXSRC)
+				m20_srcfile [m20_nsrc++] = strdup (p);
+			break;
+		}
+		if (sscanf (p, "; %o %d %d", &addr, &file, &line) == 3 &&
+		    addr < MEMSIZE && file < m20_nsrc) {
+			m20_srcline[addr].file = file;
+			m20_srcline[addr].line = line;
+		}
+		break;
+	}
+}
+
 /*
  * Чтение строки входного файла.
+ * Комментарии возвращаются с типом ';', текст в comment.
  */
-t_stat m20_read_line (FILE *input, int *type, t_value *val)
+t_stat m20_read_line (FILE *input, int *type, t_value *val, char *comment)
 {
 	char buf [512], *p;
 	int i;
@@ -80,7 +239,12 @@ again:
 		return SCPE_OK;
 	}
 	p = skip_spaces (buf);
-	if (*p == '\n' || *p == ';')
+	if (*p == ';') {
+		*type = ';';
+		strcpy (comment, p);
+		return SCPE_OK;
+	}
+	if (*p == '\n')
 		goto again;
 	if (*p == ':') {
 		/* Адрес размещения данных. */
@@ -121,33 +285,46 @@ again:
 
 /*
  * Load memory from file.
+ * Таблицы символов и строк, а также отметки загруженных ячеек
+ * прежней программы забываются: у новой программы они свои.
  */
 t_stat m20_load (FILE *input)
 {
-	int addr, type;
+	int addr, type, section = 0;
 	t_value word;
 	t_stat err;
+	char comment [512];
+
+	m20_nsym = 0;
+	while (m20_nsrc > 0)
+		free (m20_srcfile [--m20_nsrc]);
+	memset (m20_srcline, 0, sizeof (m20_srcline));
+	memset (cov_loaded, 0, sizeof (cov_loaded));
 
 	addr = 1;
 	RVK = 1;
 	for (;;) {
-		err = m20_read_line (input, &type, &word);
+		err = m20_read_line (input, &type, &word, comment);
 		if (err)
 			return err;
 		switch (type) {
 		case 0:			/* EOF */
+			qsort (m20_sym, m20_nsym, sizeof (SYMBOL), compare_sym);
 			return SCPE_OK;
 		case ':':		/* address */
 			addr = word;
 			break;
 		case '=':		/* word */
 			M [addr] = word;
-			/* ram_dirty [addr] = 1; */
+			cov_loaded [addr] = 1;
 			++addr;
 			break;
 		case '@':		/* start address */
 			RVK = word;
 			break;
+		case ';':		/* comment */
+			m20_comment (comment, &section);
+			break;
 		}
 		if (addr > MEMSIZE)
 			return SCPE_FMT;
@@ -190,6 +367,8 @@ t_stat sim_load (FILE *fi, char *cptr, char *fnam, int dump_flag)
 	if (dump_flag)
 		return m20_dump (fi, fnam);
 
+	strncpy (m20_loadfile, fnam, sizeof (m20_loadfile) - 1);
+	hist_touched = 1;
 	return m20_load (fi);
 }
 
@@ -258,12 +258,17 @@ extern t_stat parse_sym (char *cptr, t_addr addr, UNIT *uptr, t_value *val,
 /* The per-simulator init routine is a weak global that defaults to NULL
    The other per-simulator pointers can be overrriden by the init routine */
 
+#if defined (__GNUC__)
+void (*sim_vm_init) (void) __attribute__ ((weak));
+#else
 void (*sim_vm_init) (void);
+#endif
 char* (*sim_vm_read) (char *ptr, int32 size, FILE *stream) = NULL;
 void (*sim_vm_post) (t_bool from_scp) = NULL;
 CTAB *sim_vm_cmd = NULL;
 void (*sim_vm_fprint_addr) (FILE *st, DEVICE *dptr, t_addr addr) = NULL;
 t_addr (*sim_vm_parse_addr) (DEVICE *dptr, char *cptr, char **tptr) = NULL;
+void (*sim_vm_show_time) (FILE *st) = NULL;
 
 /* Prototypes */
 
@@ -1572,6 +1577,8 @@ t_stat show_time (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, char *cptr)
 if (cptr && (*cptr != 0))
     return SCPE_2MARG;
 fprintf (st, "Time:\t%.0f\n", sim_time);
+if (sim_vm_show_time)
+    (*sim_vm_show_time) (st);
 return SCPE_OK;
 }
 
@@ -3759,7 +3766,8 @@ if ((cptr == NULL) || (dptr == NULL) || (dptr->registers == NULL))
 tptr = cptr;
 do {
     tptr++;
-    } while (isalnum (*tptr) || (*tptr == '*') || (*tptr == '_'));
+    } while (isalnum (*tptr) || (*tptr & 0x80) ||      /* UTF-8 names */
+        (*tptr == '*') || (*tptr == '_'));
 slnt = tptr - cptr;
 for (rptr = dptr->registers; rptr->name != NULL; rptr++) {
     if ((slnt == strlen (rptr->name)) &&